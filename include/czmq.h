@@ -31,6 +31,7 @@
 
 //  Opaque class structures to allow forward references
 typedef struct _zactor_t zactor_t;
+typedef struct _zactor_options_t zactor_options_t;
 typedef struct _zcert_t zcert_t;
 typedef struct _zcertstore_t zcertstore_t;
 typedef struct _zchunk_t zchunk_t;
@@ -46,8 +47,10 @@ typedef struct _zlist_t zlist_t;
 typedef struct _zloop_t zloop_t;
 typedef struct _zmsg_t zmsg_t;
 typedef struct _zpoller_t zpoller_t;
+typedef struct _zqueue_t zqueue_t;
 typedef struct _zrex_t zrex_t;
 typedef struct _zring_t zring_t;
+typedef struct _zsignal_t zsignal_t;
 typedef struct _zsock_t zsock_t;
 typedef struct _zuuid_t zuuid_t;
 //  Deprecated V2 classes, remove some time after 3.0 stability
@@ -91,8 +94,10 @@ typedef int (czmq_comparator) (const void *item1, const void *item2);
 #include "zmsg.h"
 #include "zpoller.h"
 #include "zproxy.h"
+#include "zqueue.h"
 #include "zrex.h"
 #include "zring.h"
+#include "zsignal.h"
 #include "zsock.h"
 #include "zsock_option.h"
 #include "zstr.h"
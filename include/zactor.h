@@ -22,10 +22,29 @@ extern "C" {
 //  Actors get a pipe and arguments from caller
 typedef void (zactor_fn) (zsock_t *pipe, void *args);
 
+//  Pooled actors get a call, with their pipe and arguments, each time
+//  the pipe has input. Return 0 to carry on, or -1 to end the actor.
+typedef int (zactor_handler_fn) (zsock_t *pipe, void *args);
+
 //  Create a new actor passing arbitrary arguments reference.
 CZMQ_EXPORT zactor_t *
     zactor_new (zactor_fn *task, void *args);
 
+//  Create a new actor, as zactor_new, and set up its thread with the given
+//  options before the actor function runs. The options are copied, so the
+//  caller may destroy them straight away. If options is NULL, this is the
+//  same as zactor_new.
+CZMQ_EXPORT zactor_t *
+    zactor_new_with (zactor_fn *task, void *args, zactor_options_t *options);
+
+//  Create a new pooled actor, passing arbitrary arguments reference. The
+//  handler is called from a shared thread pool each time the actor's pipe
+//  has input, and must receive one message. It returns 0 to carry on, or
+//  -1 to end the actor, which it must do on $TERM. A pooled actor is ready
+//  as soon as it's created, so there is no startup handshake.
+CZMQ_EXPORT zactor_t *
+    zactor_new_pooled (zactor_handler_fn *handler, void *args);
+
 //  Destroy an actor.
 CZMQ_EXPORT void
     zactor_destroy (zactor_t **p_self);
@@ -51,6 +70,53 @@ CZMQ_EXPORT bool
 CZMQ_EXPORT void *
     zactor_resolve (void *self);
 
+//  Return the actor's zsock handle. Use this when you absolutely need to
+//  work with the zsock instance rather than the actor.
+CZMQ_EXPORT zsock_t *
+    zactor_sock (zactor_t *self);
+
+//  Create a new set of actor thread options. By default, the thread runs
+//  on any CPU, has no name, uses the zsys_thread_stack_size stack size, and
+//  has the operating system's default scheduling.
+CZMQ_EXPORT zactor_options_t *
+    zactor_options_new (void);
+
+//  Destroy a set of actor thread options.
+CZMQ_EXPORT void
+    zactor_options_destroy (zactor_options_t **self_p);
+
+//  Pin the actor thread to a list of CPUs, like "0-3,8", as for
+//  zsys_thread_set_cpus.
+CZMQ_EXPORT void
+    zactor_options_set_cpus (zactor_options_t *self, const char *cpus);
+
+//  Pin the actor thread to the CPUs of a NUMA node, as for
+//  zsys_thread_set_numa_node. This replaces any CPU list.
+CZMQ_EXPORT void
+    zactor_options_set_numa_node (zactor_options_t *self, int node);
+
+//  Name the actor thread, as for zsys_thread_set_name.
+CZMQ_EXPORT void
+    zactor_options_set_name (zactor_options_t *self, const char *name);
+
+//  Set the stack size, in bytes, of the actor thread. Zero means the
+//  zsys_thread_stack_size default.
+CZMQ_EXPORT void
+    zactor_options_set_stack_size (zactor_options_t *self, size_t stack_size);
+
+//  Set the scheduling policy and priority of the actor thread, as for
+//  zsys_thread_set_sched.
+CZMQ_EXPORT void
+    zactor_options_set_sched (zactor_options_t *self, int policy, int priority);
+
+//  Send signals from the actor to its parent through a zsignal_t, rather
+//  than the pipe, where the platform supports it. This makes the actor's
+//  handshakes cheaper, but these signals do not wake a poller that watches
+//  the actor, and zmsg_signal does not see them; use zsock_wait to collect
+//  them. The default is false.
+CZMQ_EXPORT void
+    zactor_options_set_signals (zactor_options_t *self, bool signals);
+
 //  Self test of this class
 CZMQ_EXPORT void
     zactor_test (bool verbose);
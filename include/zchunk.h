@@ -74,6 +74,17 @@ CZMQ_EXPORT bool
 CZMQ_EXPORT zchunk_t *
     zchunk_read (FILE *handle, size_t bytes);
     
+//  Map part of an open file into a chunk, without reading it. The chunk
+//  data points straight at the file's pages, which are read-only, and the
+//  kernel is told we will read them sequentially. Maps up to the specified
+//  number of bytes, starting at the offset, and stops at the end of file.
+//  You cannot modify a mapped chunk, and the file must not be truncated
+//  while it is mapped. Use zchunk_packx to send the chunk without copying
+//  it. On systems without mmap, reads the data instead. Returns a new
+//  chunk, or NULL if the file could not be mapped.
+CZMQ_EXPORT zchunk_t *
+    zchunk_map (FILE *handle, size_t bytes, off_t offset);
+
 //  Write chunk to an open file descriptor
 CZMQ_EXPORT int
     zchunk_write (zchunk_t *self, FILE *handle);
@@ -109,6 +120,14 @@ CZMQ_EXPORT bool
 CZMQ_EXPORT zframe_t *
     zchunk_pack (zchunk_t *self);
 
+//  Transform zchunk into a zframe that can be sent in a message, without
+//  copying the chunk data. The frame takes ownership of the chunk, which
+//  is destroyed when libzmq has finished with the data. Nullifies the
+//  caller's reference to the chunk. Returns NULL, and leaves the chunk
+//  alone, if there was not enough memory.
+CZMQ_EXPORT zframe_t *
+    zchunk_packx (zchunk_t **self_p);
+
 //  Transform a zframe into a zchunk.
 CZMQ_EXPORT zchunk_t *
     zchunk_unpack (zframe_t *frame);
@@ -31,6 +31,10 @@ CZMQ_EXPORT int64_t
 CZMQ_EXPORT int64_t
     zclock_mono (void);
 
+//  Return current monotonic clock in microseconds
+CZMQ_EXPORT int64_t
+    zclock_usecs (void);
+
 //  Return formatted date/time as fresh string. Free using zstr_free().
 CZMQ_EXPORT char *
     zclock_timestr (void);
@@ -25,10 +25,26 @@ extern "C" {
 CZMQ_EXPORT zdir_t *
     zdir_new (const char *path, const char *parent);
 
+//  Create a new directory item like zdir_new, loading subdirectories in
+//  parallel over the specified number of threads. If threads is zero, uses
+//  one thread per CPU core. On platforms without POSIX threads, loads the
+//  tree in the calling thread.
+CZMQ_EXPORT zdir_t *
+    zdir_new_parallel (const char *path, const char *parent, size_t threads);
+
 //  Destroy a directory tree and all children it contains.
 CZMQ_EXPORT void
     zdir_destroy (zdir_t **self_p);
 
+//  Bring a directory tree up to date with the disk, reusing what it already
+//  holds. Reads the entries only of directories that were modified since
+//  they were last read, and restats the files in all others, as files can
+//  change without changing their directory. Uses as many threads as the
+//  tree was created with. Returns 0 if OK, or -1 if the directory could no
+//  longer be read, in which case it is now empty.
+CZMQ_EXPORT int
+    zdir_refresh (zdir_t *self);
+
 //  Return directory path
 CZMQ_EXPORT char *
     zdir_path (zdir_t *self);
@@ -72,13 +88,26 @@ CZMQ_EXPORT void
 CZMQ_EXPORT zlist_t *
     zdir_diff (zdir_t *older, zdir_t *newer, const char *alias);
 
+//  Calculate differences between two versions of a directory tree, like
+//  zdir_diff, but do not report files that were touched or rewritten with
+//  the same contents. The digests table holds the SHA-1 digest of each file
+//  in the older tree, as returned by zdir_cache. When a file has the same
+//  size as before, but a new modification time, we calculate its digest,
+//  and compare that to the older digest. Files with no older digest are
+//  reported as by zdir_diff.
+CZMQ_EXPORT zlist_t *
+    zdir_diff_digest (zdir_t *older, zdir_t *newer, const char *alias, zhash_t *digests);
+
 //  Return full contents of directory as a zdir_patch list.
 CZMQ_EXPORT zlist_t *
     zdir_resync (zdir_t *self, const char *alias);
 
 //  Load directory cache; returns a hash table containing the SHA-1 digests
-//  of every file in the tree. The cache is saved between runs in .cache.
-//  The caller must destroy the hash table when done with it.
+//  of every file in the tree. The cache is saved between runs in .cache,
+//  along with the size and modification time of each file, and a digest
+//  is only recalculated when the file changed. Digests are calculated over
+//  as many threads as the tree was created with. The caller must destroy
+//  the hash table when done with it.
 CZMQ_EXPORT zhash_t *
     zdir_cache (zdir_t *self);
 
@@ -90,6 +119,44 @@ CZMQ_EXPORT void
 CZMQ_EXPORT void
     zdir_print (zdir_t *self, int indent);
 
+//  Create new zdir_watch actor instance to watch a directory tree:
+//
+//      zactor_t *watch = zactor_new (zdir_watch, "/some/path");
+//
+//  Destroy zdir_watch instance.
+//
+//      zactor_destroy (&watch);
+//
+//  Enable verbose logging of commands and activity.
+//
+//      zstr_send (watch, "VERBOSE");
+//
+//  Set the polling interval in msecs, used when the system does not tell
+//  us about changes (default 1000):
+//
+//      zstr_sendx (watch, "TIMEOUT", "500", NULL);
+//
+//  Stop using system notifications, and poll the directory instead:
+//
+//      zstr_send (watch, "POLL");
+//
+//  Receive the next change, as a patch that you must destroy; the patch
+//  path is relative to the watched directory, and the patch is a create
+//  for new or changed files, and a delete for deleted files:
+//
+//      char *command;
+//      zdir_patch_t *patch;
+//      zsock_recv (watch, "sp", &command, &patch);
+//
+//  The directory may be absent when the actor starts, or go away at any
+//  time. On Linux, the actor uses inotify; elsewhere, or if it runs out of
+//  inotify watches, it polls the directory.
+//
+//  This is the zdir_watch constructor as a zactor_fn; the argument is the
+//  path of the directory to watch.
+CZMQ_EXPORT void
+    zdir_watch (zsock_t *pipe, void *args);
+
 //  Self test of this class
 CZMQ_EXPORT void
     zdir_test (bool verbose);
@@ -42,7 +42,7 @@ CZMQ_EXPORT char *
 
 //  Refresh file properties from disk; this is not done automatically
 //  on access methods, otherwise it is not possible to compare directory
-//  snapshots.
+//  snapshots. If the file changed, forgets any digest calculated for it.
 CZMQ_EXPORT void
     zfile_restat (zfile_t *self);
 
@@ -104,15 +104,33 @@ CZMQ_EXPORT int
     zfile_output (zfile_t *self);
 
 //  Read chunk from file at specified position. If this was the last chunk,
-//  sets self->eof. Returns a null chunk in case of error.
+//  sets self->eof. Returns a null chunk in case of error. Reads and writes
+//  do not move a shared file position, so several threads can work on
+//  different ranges of one open file at the same time. The eof flag is
+//  then meaningless, as every read sets it; each thread knows it read the
+//  last chunk when the chunk is shorter than it asked for.
 CZMQ_EXPORT zchunk_t *
     zfile_read (zfile_t *self, size_t bytes, off_t offset);
 
+//  Map chunk from file at specified position, without reading it. Works
+//  like zfile_read, except the chunk is read-only and shares the file's
+//  pages; see zchunk_map. Send it with zchunk_packx to transmit file data
+//  without copying it. Returns a null chunk in case of error.
+CZMQ_EXPORT zchunk_t *
+    zfile_map (zfile_t *self, size_t bytes, off_t offset);
+
 //  Write chunk to file at specified position
 //  Return 0 if OK, else -1
 CZMQ_EXPORT int
     zfile_write (zfile_t *self, zchunk_t *chunk, off_t offset);
 
+//  Set or clear streaming mode. In streaming mode, the file tells the
+//  kernel that it will be read sequentially, and drops each range it reads
+//  from the page cache afterwards, so reading a very large file once does
+//  not flush everything else out of memory. Off by default.
+CZMQ_EXPORT void
+    zfile_set_streaming (zfile_t *self, bool streaming);
+
 //  Close file, if open
 CZMQ_EXPORT void
     zfile_close (zfile_t *self);
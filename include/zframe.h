@@ -23,6 +23,9 @@ extern "C" {
 #define ZFRAME_REUSE    2
 #define ZFRAME_DONTWAIT 4
 
+//  Callback function for zero-copy frames
+typedef void (zframe_free_fn) (void *data, void *arg);
+
 //  Create a new frame with optional size, and optional data
 CZMQ_EXPORT zframe_t *
     zframe_new (const void *data, size_t size);
@@ -31,6 +34,14 @@ CZMQ_EXPORT zframe_t *
 CZMQ_EXPORT zframe_t *
     zframe_new_empty (void);
 
+//  Create a frame that refers to an existing buffer, without copying it.
+//  When the frame, or the message libzmq sent from it, is done with the
+//  buffer, calls free_fn with the data and arg, if free_fn is not null.
+//  The callback may run in a libzmq I/O thread. Until then, the caller
+//  must not change or release the buffer.
+CZMQ_EXPORT zframe_t *
+    zframe_new_zero_copy (void *data, size_t size, zframe_free_fn *free_fn, void *arg);
+
 //  Destroy a frame
 CZMQ_EXPORT void
     zframe_destroy (zframe_t **self_p);
@@ -59,6 +70,14 @@ CZMQ_EXPORT byte *
 CZMQ_EXPORT zframe_t *
     zframe_dup (zframe_t *self);
 
+//  Create a new frame that shares the data of an existing frame, without
+//  copying it. The data is reference counted, and released when the last
+//  frame that shares it has been sent, or destroyed. Frames that share
+//  data must not modify it. If frame is null, or memory was exhausted,
+//  returns null.
+CZMQ_EXPORT zframe_t *
+    zframe_share (zframe_t *self);
+
 //  Return frame data encoded as printable hex string, useful for 0MQ UUIDs.
 //  Caller must free string when finished with it.
 CZMQ_EXPORT char *
@@ -29,6 +29,13 @@ typedef size_t (zhash_hash_fn) (const void *key);
 CZMQ_EXPORT zhash_t *
     zhash_new (void);
 
+//  Create a new, empty hash container that uses open addressing rather
+//  than chained buckets. Items are stored inline, so inserts and deletes
+//  do not allocate memory per item. Apart from the constructor, you use
+//  the table exactly as one created with zhash_new.
+CZMQ_EXPORT zhash_t *
+    zhash_new_compact (void);
+
 //  Destroy a hash container and all items in it
 CZMQ_EXPORT void
     zhash_destroy (zhash_t **self_p);
@@ -54,7 +61,8 @@ CZMQ_EXPORT void
 
 //  Delete all items from the hash table. If the key destructor is
 //  set, calls it on every key. If the item destructor is set, calls
-//  it on every item.
+//  it on every item. The table shrinks back to its initial size, or to
+//  the size asked for by zhash_reserve.
 CZMQ_EXPORT void
     zhash_purge (zhash_t *self);
 
@@ -79,6 +87,23 @@ CZMQ_EXPORT void *
 CZMQ_EXPORT size_t
     zhash_size (zhash_t *self);
 
+//  Make sure the table can grow to hold the specified number of items
+//  without allocating any more heap memory, so long as you don't copy
+//  keys and values. Sizes the bucket or slot array up front; in a chained
+//  table, items come from a pool that belongs to the table, and deleted
+//  items go back to the pool for reuse. The reserved space is kept until
+//  the table is destroyed, also when it is purged. Returns 0 if OK, -1 if
+//  the process ran out of heap memory.
+CZMQ_EXPORT int
+    zhash_reserve (zhash_t *self, size_t size);
+
+//  Report item pool statistics: the number of items the table has allocated
+//  from the heap, and how many of those are free for reuse. A table created
+//  with zhash_new_compact reports its slots instead. Either pointer may be
+//  NULL.
+CZMQ_EXPORT void
+    zhash_pool_stats (zhash_t *self, size_t *allocated, size_t *available);
+
 //  Return a zlist_t containing the keys for the items in the
 //  table. Uses the key_duplicator to duplicate all keys and sets the
 //  key_destructor as destructor for the list.
@@ -88,7 +113,9 @@ CZMQ_EXPORT zlist_t *
 //  Simple iterator; returns first item in hash table, in no given order,
 //  or NULL if the table is empty. This method is simpler to use than the
 //  foreach() method, which is deprecated. To access the key for this item
-//  use zhash_cursor(). NOTE: do NOT modify the table while iterating.
+//  use zhash_cursor(). NOTE: do NOT modify the table while iterating,
+//  except that a table made with zhash_new lets you delete the item just
+//  returned.
 CZMQ_EXPORT void *
     zhash_first (zhash_t *self);
 
@@ -97,7 +124,8 @@ CZMQ_EXPORT void *
 //  zhash_first() to process all items in a hash table. If you need the
 //  items in sorted order, use zhash_keys() and then zlist_sort(). To
 //  access the key for this item use zhash_cursor(). NOTE: do NOT modify
-//  the table while iterating.
+//  the table while iterating, except that a table made with zhash_new
+//  lets you delete the item just returned.
 CZMQ_EXPORT void *
     zhash_next (zhash_t *self);
 
@@ -196,10 +224,17 @@ CZMQ_EXPORT void
     zhash_set_key_comparator (zhash_t *self, czmq_comparator comparator);
 
 //  Set a user-defined hash function for keys; by default keys are
-//  hashed by a modified Bernstein hashing function.
+//  hashed by a fast word-at-a-time string hashing function.
 CZMQ_EXPORT void
     zhash_set_key_hasher (zhash_t *self, zhash_hash_fn hasher);
 
+//  Set the table to grow incrementally. When it needs more buckets, the
+//  old and new bucket arrays coexist and each following insert, lookup or
+//  delete moves a few buckets across, so no single call pays for the whole
+//  resize. Has no effect on tables created with zhash_new_compact.
+CZMQ_EXPORT void
+    zhash_set_incremental (zhash_t *self, bool incremental);
+
 //  DEPRECATED by zhash_dup
 //  Make copy of hash table; if supplied table is null, returns null.
 //  Does not copy items themselves. Rebuilds new table so may be slow on
@@ -95,6 +95,22 @@ zlist_purge (zlist_t *self);
 CZMQ_EXPORT size_t
     zlist_size (zlist_t *self);
 
+//  Make sure the list can grow to hold the specified number of items
+//  without allocating any more heap memory. List nodes come from a pool
+//  that belongs to the list; nodes freed by pop, remove, and purge go
+//  back to the pool and are reused. The list keeps the reserved space
+//  until it is destroyed; other free nodes stay in the pool until the
+//  list is purged. Returns 0 if OK, -1 if the process
+//  ran out of heap memory.
+CZMQ_EXPORT int
+    zlist_reserve (zlist_t *self, size_t size);
+
+//  Report node pool statistics: the number of nodes the list has allocated
+//  from the heap, and how many of those are free for reuse. Either pointer
+//  may be NULL.
+CZMQ_EXPORT void
+    zlist_pool_stats (zlist_t *self, size_t *allocated, size_t *available);
+
 //  Sort the list by ascending key value using a straight ASCII comparison.
 //  The sort is not stable, so may reorder items with the same keys.
 CZMQ_EXPORT void
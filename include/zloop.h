@@ -39,7 +39,8 @@ CZMQ_EXPORT void
 //  Register socket reader with the reactor. When the reader has messages,
 //  the reactor will call the handler, passing the arg. Returns 0 if OK, -1
 //  if there was an error. If you register the same socket more than once,
-//  each instance will invoke its corresponding handler.
+//  each instance will invoke its corresponding handler. The socket may also
+//  be a zsignal_t or zqueue_t, cast to a zsock_t *.
 CZMQ_EXPORT int
     zloop_reader (zloop_t *self, zsock_t *sock, zloop_reader_fn handler, void *arg);
 
@@ -53,6 +54,16 @@ CZMQ_EXPORT void
 CZMQ_EXPORT void
     zloop_reader_set_tolerant (zloop_t *self, zsock_t *sock);
 
+//  Set the budget for a registered reader. When the reader has input, the
+//  reactor calls its handler up to this many times in a row, as long as
+//  the socket still has input, before moving on to other readers. If
+//  usecs is not zero, it also stops once it has spent that long. The
+//  handler should read one message per call. The default budget is one
+//  call. A budget lets a busy reader handle messages in batches, without
+//  the cost of polling between each one.
+CZMQ_EXPORT void
+    zloop_reader_set_budget (zloop_t *self, zsock_t *sock, size_t messages, size_t usecs);
+
 //  Register low-level libzmq pollitem with the reactor. When the pollitem
 //  is ready, will call the handler, passing the arg. Returns 0 if OK, -1
 //  if there was an error. If you register the pollitem more than once, each
@@ -84,6 +95,44 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zloop_timer_end (zloop_t *self, int timer_id);
 
+//  Register a ticket timer. Ticket timers are very fast in the case where
+//  you use a lot of timers (thousands), and frequently remove and add them.
+//  The main use case is expiry timers for servers that handle many clients,
+//  and which reset the expiry timer for each message received from a client.
+//  All tickets share the delay set by zloop_set_ticket_delay, which you must
+//  call before creating a ticket. A ticket runs once, when it expires, and
+//  is then destroyed, unless its handler resets it. Returns a handle to the
+//  ticket that you use in zloop_ticket_reset and zloop_ticket_delete, or
+//  NULL if there was an error.
+CZMQ_EXPORT void *
+    zloop_ticket (zloop_t *self, zloop_timer_fn handler, void *arg);
+
+//  Reset a ticket timer, which moves it to the end of the ticket list and
+//  resets its execution time. This is a very fast operation.
+CZMQ_EXPORT void
+    zloop_ticket_reset (zloop_t *self, void *handle);
+
+//  Delete a ticket timer. We do not free the ticket here, as other code may
+//  still refer to it; we take it off the ticket list, mark it as deleted,
+//  and free it later on, safely.
+CZMQ_EXPORT void
+    zloop_ticket_delete (zloop_t *self, void *handle);
+
+//  Set the ticket delay, which applies to all tickets. If you lower the
+//  delay and there are already tickets created, the results are undefined.
+CZMQ_EXPORT void
+    zloop_set_ticket_delay (zloop_t *self, size_t ticket_delay);
+
+//  Switch the reactor to the epoll backend, or back to zmq_poll. The epoll
+//  backend suits reactors with many readers and pollers, as adding or
+//  removing one does not rebuild the poll set, and each pass only looks
+//  at the items that are ready. Handlers work exactly as before. Readers
+//  on raw libzmq sockets are checked on every pass, so use zsock_t instead.
+//  Returns 0 if OK, -1 if epoll is not available on this platform, or
+//  failed.
+CZMQ_EXPORT int
+    zloop_set_epoll (zloop_t *self, bool epoll);
+
 //  Set verbose tracing of reactor on/off
 CZMQ_EXPORT void
     zloop_set_verbose (zloop_t *self, bool verbose);
@@ -148,11 +148,43 @@ CZMQ_EXPORT size_t
 CZMQ_EXPORT zmsg_t *
     zmsg_decode (byte *buffer, size_t buffer_size);
 
+//  Return the number of bytes that zmsg_encode or zmsg_encode_buffer will
+//  produce for the message.
+CZMQ_EXPORT size_t
+    zmsg_encode_size (zmsg_t *self);
+
+//  Serialize multipart message into a buffer that the caller provides, in
+//  the same format as zmsg_encode, without allocating memory. Returns the
+//  number of bytes written, or 0 if the buffer was too small, in which
+//  case it writes nothing. Use zmsg_encode_size to size the buffer.
+CZMQ_EXPORT size_t
+    zmsg_encode_buffer (zmsg_t *self, byte *buffer, size_t buffer_size);
+
+//  Decodes a serialized message buffer created by zmsg_encode () without
+//  copying frame data. Frames of 256 bytes or more refer to their part of
+//  the buffer; smaller frames are copied, as that is cheaper. When the
+//  message and all frames taken from it, including frames sent to sockets,
+//  are done with the buffer, calls free_fn with the buffer and arg, if
+//  free_fn is not null. Until then, the caller must not change or release
+//  the buffer. Returns NULL if the buffer was badly formatted or there was
+//  insufficient memory to work, in which case it does not call free_fn,
+//  and the caller still owns the buffer.
+CZMQ_EXPORT zmsg_t *
+    zmsg_decode_zero_copy (byte *buffer, size_t buffer_size, zframe_free_fn *free_fn, void *arg);
+
 //  Create copy of message, as new message object. Returns a fresh zmsg_t
 //  object. If message is null, or memory was exhausted, returns null.
 CZMQ_EXPORT zmsg_t *
     zmsg_dup (zmsg_t *self);
 
+//  Create a new message whose frames share the data of this message's
+//  frames, without copying it. Use this to send the same message to many
+//  sockets: you can add frames, such as a routing id, to each copy, but
+//  must not modify the shared data. Returns a fresh zmsg_t object. If
+//  message is null, or memory was exhausted, returns null.
+CZMQ_EXPORT zmsg_t *
+    zmsg_share (zmsg_t *self);
+
 //  Send message to zsys log sink (may be stdout, or system facility as
 //  configured by zsys_set_logstream).
 CZMQ_EXPORT void
@@ -39,18 +39,52 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zpoller_remove (zpoller_t *self, void *reader);
 
+//  Switch the poller to the epoll backend, or back to zmq_poll. The epoll
+//  backend suits large sets of readers, as adding or removing a reader
+//  does not rebuild the poll set, and waiting only looks at readers that
+//  are ready. Raw libzmq sockets are checked on every wait, so use zsock_t
+//  instead. Returns 0 if OK, -1 if epoll is not available on this
+//  platform, or failed.
+CZMQ_EXPORT int
+    zpoller_set_epoll (zpoller_t *self, bool epoll);
+
 //  Poll the registered readers for I/O, return first reader that has input.
 //  The reader will be a libzmq void * socket, or a zsock_t or zactor_t
 //  instance as specified in zpoller_new/zpoller_add. The order that
-//  sockets are defined in the poll list affects their priority. If you
-//  need a balanced poll, use the low level zmq_poll method directly. If
-//  the poll call was interrupted (SIGINT), or the ZMQ context was
-//  destroyed, or the timeout expired, returns NULL. You can test the
-//  actual exit condition by calling zpoller_expired () and
-//  zpoller_terminated (). The timeout is in msec.
+//  sockets are defined in the poll list affects their priority, unless
+//  you called zpoller_set_fair. If you need to handle all ready readers
+//  at once, use zpoller_wait_all. If the poll call was interrupted
+//  (SIGINT), or the ZMQ context was destroyed, or the timeout expired,
+//  returns NULL. You can test the actual exit condition by calling
+//  zpoller_expired () and zpoller_terminated (). The timeout is in msec.
 CZMQ_EXPORT void *
     zpoller_wait (zpoller_t *self, int timeout);
 
+//  Poll the registered readers for I/O once, and return the number of
+//  readers that have input, or zero if the poll call was interrupted, or
+//  the ZMQ context was destroyed, or the timeout expired. Use
+//  zpoller_ready_first and zpoller_ready_next to get the readers. The
+//  timeout is in msec.
+CZMQ_EXPORT size_t
+    zpoller_wait_all (zpoller_t *self, int timeout);
+
+//  Return the first reader that had input in the last zpoller_wait_all
+//  call, or NULL if none did.
+CZMQ_EXPORT void *
+    zpoller_ready_first (zpoller_t *self);
+
+//  Return the next reader that had input in the last zpoller_wait_all
+//  call, or NULL if there are no more.
+CZMQ_EXPORT void *
+    zpoller_ready_next (zpoller_t *self);
+
+//  Set whether polling is fair. If true, each poll starts looking at the
+//  reader after the one that came first last time, so readers are served
+//  round-robin, and a busy reader cannot starve the others. Default is
+//  false, so readers added first have priority.
+CZMQ_EXPORT void
+    zpoller_set_fair (zpoller_t *self, bool fair);
+
 //  Return true if the last zpoller_wait () call ended because the timeout
 //  expired, without any error.
 CZMQ_EXPORT bool
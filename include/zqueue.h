@@ -0,0 +1,75 @@
+/*  =========================================================================
+    zqueue - lock-free queue between threads
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZQUEUE_H_INCLUDED__
+#define __ZQUEUE_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new queue that holds up to limit items. The limit is rounded
+//  up to a power of two. Returns NULL if the platform does not support
+//  queues, or the process ran out of memory.
+CZMQ_EXPORT zqueue_t *
+    zqueue_new (size_t limit);
+
+//  Destroy a queue. Messages still in the queue are destroyed; other items
+//  are dropped, and remain the caller's problem.
+CZMQ_EXPORT void
+    zqueue_destroy (zqueue_t **self_p);
+
+//  Add an item, which may not be NULL, to the queue. Any thread may call
+//  this. Returns 0 if OK, -1 if the queue is full.
+CZMQ_EXPORT int
+    zqueue_send (zqueue_t *self, void *item);
+
+//  Take the oldest item from the queue, waiting for up to timeout msecs,
+//  or forever if timeout is -1. Only one thread may receive from a queue.
+//  Returns NULL if the timeout expired or the call was interrupted.
+CZMQ_EXPORT void *
+    zqueue_recv (zqueue_t *self, int timeout);
+
+//  Add a message to the queue, and take ownership of it. A queue carries
+//  either messages or other items, not both. Returns 0 if OK, or -1 if the
+//  queue is full, and then the caller still owns the message.
+CZMQ_EXPORT int
+    zqueue_send_msg (zqueue_t *self, zmsg_t **msg_p);
+
+//  Take the oldest message from the queue, as for zqueue_recv. The caller
+//  owns the message, and must destroy it when finished with it.
+CZMQ_EXPORT zmsg_t *
+    zqueue_recv_msg (zqueue_t *self, int timeout);
+
+//  Return the number of items in the queue. While other threads are using
+//  the queue, this is only a hint.
+CZMQ_EXPORT size_t
+    zqueue_size (zqueue_t *self);
+
+//  Return the file descriptor that is readable while the queue has items.
+//  A zqueue_t also starts with this descriptor, so you can pass it as-is
+//  to zpoller_add, and to zloop_reader cast to a zsock_t *.
+CZMQ_EXPORT SOCKET
+    zqueue_fd (zqueue_t *self);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zqueue_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -94,6 +94,23 @@ CZMQ_EXPORT void
 CZMQ_EXPORT size_t
     zring_size (zring_t *self);
 
+//  Make sure the ring can grow to hold the specified number of items
+//  without allocating any more heap memory. Ring nodes come from a pool
+//  that belongs to the ring; nodes freed by detach, remove, and purge go
+//  back to the pool and are reused. The ring keeps the reserved space
+//  until it is destroyed; other free nodes stay in the pool until the
+//  ring is purged. If the ring has a dictionary, also
+//  reserves space in that. Returns 0 if OK, -1 if the process ran out of
+//  heap memory.
+CZMQ_EXPORT int
+    zring_reserve (zring_t *self, size_t size);
+
+//  Report node pool statistics: the number of nodes the ring has allocated
+//  from the heap, and how many of those are free for reuse. Either pointer
+//  may be NULL.
+CZMQ_EXPORT void
+    zring_pool_stats (zring_t *self, size_t *allocated, size_t *available);
+
 //  Return the item at the head of ring. If the ring is empty, returns NULL.
 //  Leaves cursor pointing at the head item, or NULL if the ring is empty.
 CZMQ_EXPORT void *
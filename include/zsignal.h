@@ -0,0 +1,59 @@
+/*  =========================================================================
+    zsignal - lightweight pollable signal between threads
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZSIGNAL_H_INCLUDED__
+#define __ZSIGNAL_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new signal. Returns NULL if the platform does not support
+//  signals, or the process ran out of file handles.
+CZMQ_EXPORT zsignal_t *
+    zsignal_new (void);
+
+//  Destroy a signal
+CZMQ_EXPORT void
+    zsignal_destroy (zsignal_t **self_p);
+
+//  Raise the signal with a status code (by convention, 0 means OK). Any
+//  thread may call this. Returns 0 if OK, -1 if the signal could not be
+//  raised.
+CZMQ_EXPORT int
+    zsignal_send (zsignal_t *self, byte status);
+
+//  Wait for the signal to be raised, for up to timeout msecs, or forever if
+//  timeout is -1. Each wait consumes one signal. Returns the status of the
+//  signal it consumed, in the order signals were raised, or -1 if the
+//  timeout expired or the call was interrupted.
+CZMQ_EXPORT int
+    zsignal_wait (zsignal_t *self, int timeout);
+
+//  Return the file descriptor that becomes readable when the signal is
+//  raised. A zsignal_t also starts with this descriptor, so you can pass
+//  it as-is to zpoller_add, and zpoller_wait will return it.
+CZMQ_EXPORT SOCKET
+    zsignal_fd (zsignal_t *self);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zsignal_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
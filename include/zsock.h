@@ -224,6 +224,54 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zsock_recv (void *self, const char *picture, ...);
 
+//  Send a binary encoded 'picture' message to the socket (or actor). This
+//  works like zsock_send, except that all arguments go into one frame, in
+//  a compact binary encoding, so sending costs one allocation at most and
+//  no formatting. The picture can contain any of these characters, each
+//  corresponding to one or two arguments:
+//
+//      1 = uint8_t
+//      2 = uint16_t
+//      4 = uint32_t
+//      8 = uint64_t
+//      s = char *, up to 255 characters
+//      S = char *, any length up to 4GB
+//      b = byte *, size_t (2 arguments), up to 4GB
+//      p = void * (sends the pointer value, only meaningful over inproc)
+//
+//  Integers are sent in network byte order. Does not change or take
+//  ownership of any arguments. Returns 0 if successful, -1 if a string or
+//  data is too long, or sending failed for any reason.
+CZMQ_EXPORT int
+    zsock_bsend (void *self, const char *picture, ...);
+
+//  Receive a binary encoded 'picture' message from the socket (or actor).
+//  See zsock_bsend for the format and meaning of the picture. Returns the
+//  picture elements into a series of pointers as provided by the caller:
+//
+//      1 = uint8_t * (stores integer)
+//      2 = uint16_t * (stores integer)
+//      4 = uint32_t * (stores integer)
+//      8 = uint64_t * (stores integer)
+//      s = char ** (stores pointer into socket buffer)
+//      S = char ** (stores pointer into socket buffer)
+//      b = byte **, size_t * (2 arguments) (stores pointer into frame)
+//      p = void ** (stores pointer)
+//
+//  Note that zsock_brecv does not allocate anything once the socket has
+//  received a message of the same size: data are returned as pointers into
+//  the received frame, and strings as pointers into a buffer the socket
+//  owns. Both stay valid until the next zsock_brecv call, or until the
+//  socket is destroyed. You must copy any values you want to keep beyond
+//  that, and must not change them, as the frame may be shared with other
+//  receivers. Returns 0 if successful, or -1 if it failed to receive a
+//  message, or the message did not match the picture, in which case the
+//  pointers are not all set. If an argument pointer is NULL, does not store
+//  any value (skips it). Takes a zsock_t or zactor_t argument, not a
+//  libzmq socket.
+CZMQ_EXPORT int
+    zsock_brecv (void *self, const char *picture, ...);
+
 //  Set socket to use unbounded pipes (HWM=0); use this in cases when you are
 //  totally certain the message volume can fit in memory. This method works
 //  across all versions of ZeroMQ. Takes a polymorphic socket reference.
@@ -232,16 +280,22 @@ CZMQ_EXPORT void
 
 //  Send a signal over a socket. A signal is a short message carrying a
 //  success/failure code (by convention, 0 means OK). Signals are encoded
-//  to be distinguishable from "normal" messages. Accepts a zock_t or a
-//  zactor_t argument, and returns 0 if successful, -1 if the signal could
-//  not be sent. Takes a polymorphic socket reference.
+//  to be distinguishable from "normal" messages. If the socket has an
+//  outgoing zsignal_t, as an actor's pipe does when it was created with
+//  zactor_options_set_signals, the signal goes through that instead of the
+//  socket. Accepts a zock_t or a zactor_t argument, and returns 0 if
+//  successful, -1 if the signal could not be sent. Takes a polymorphic
+//  socket reference.
 CZMQ_EXPORT int
     zsock_signal (void *self, byte status);
     
 //  Wait on a signal. Use this to coordinate between threads, over pipe
-//  pairs. Blocks until the signal is received. Returns -1 on error, 0 or
-//  greater on success. Accepts a zsock_t or a zactor_t as argument.
-//  Takes a polymorphic socket reference.
+//  pairs. Blocks until the signal is received, or the socket's receive
+//  timeout expires. If the socket has an incoming zsignal_t, as a zactor
+//  does when created with zactor_options_set_signals, waits on that
+//  instead of the socket. Returns -1 on error, 0 or greater on success.
+//  Accepts a zsock_t or a zactor_t as argument. Takes a polymorphic socket
+//  reference.
 CZMQ_EXPORT int
     zsock_wait (void *self);
 
@@ -257,9 +311,12 @@ CZMQ_EXPORT bool
     zsock_is (void *self);
 
 //  Probe the supplied reference. If it looks like a zsock_t instance, return
-//  the underlying libzmq socket handle; elsie if it looks like a file
+//  the underlying libzmq socket handle; else if it looks like a file
 //  descriptor, return NULL; else if it looks like a libzmq socket handle,
-//  return the supplied value. Takes a polymorphic socket reference.
+//  return the supplied value. Takes a polymorphic socket reference. The
+//  answer for libzmq handles and file descriptors is cached per thread, so
+//  only the first call for each costs a system call; a file descriptor must
+//  be valid when it is passed.
 CZMQ_EXPORT void *
     zsock_resolve (void *self);
 
@@ -268,6 +325,12 @@ CZMQ_EXPORT void
     zsock_test (bool verbose);
 //  @end
 
+//  Set or clear the zsignal_t objects that zsock_signal and zsock_wait use
+//  instead of the socket. The caller keeps ownership of the signals.
+//  *** This is for CZMQ internal use only and may change arbitrarily ***
+CZMQ_EXPORT void
+    zsock_set_signals (zsock_t *self, zsignal_t *signal_out, zsignal_t *signal_in);
+
 //  Compiler hints
 CZMQ_EXPORT int zsock_bind (zsock_t *self, const char *format, ...) CHECK_PRINTF (2);
 CZMQ_EXPORT int zsock_unbind (zsock_t *self, const char *format, ...) CHECK_PRINTF (2);
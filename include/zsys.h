@@ -53,6 +53,21 @@ CZMQ_EXPORT void *
 CZMQ_EXPORT int
     zsys_close (void *handle, const char *filename, size_t line_nbr);
 
+//  Tell CZMQ that a ZMQ socket was created or closed, so that zsock_resolve
+//  forgets what it knows about handles at that address. zsys_socket,
+//  zsys_close and the zsocket class do this for you; call it after you
+//  create or close raw sockets with zmq_socket and zmq_close, if the process
+//  may also pass CZMQ objects or file descriptors from reused memory.
+CZMQ_EXPORT void
+    zsys_handle_closed (void);
+
+//  Return the number of times a ZMQ socket has been created or closed, as
+//  counted by zsys_handle_closed. Used by zsock_resolve to expire cached
+//  results.
+//  *** This is for CZMQ internal use only and may change arbitrarily ***
+CZMQ_EXPORT uint
+    zsys_handle_generation (void);
+
 //  Return ZMQ socket name for socket type
 //  *** This is for CZMQ internal use only and may change arbitrarily ***
 CZMQ_EXPORT char *
@@ -246,6 +261,73 @@ CZMQ_EXPORT void
 CZMQ_EXPORT size_t
     zsys_pipehwm (void);
 
+//  Configure the number of threads that run pooled actors. The default is
+//  zero, meaning one thread per CPU core. If the environment variable
+//  ZSYS_POOL_THREADS is defined, that provides the default. Note that this
+//  method is valid only before any pooled actor is created.
+CZMQ_EXPORT void
+    zsys_set_pool_threads (size_t pool_threads);
+
+//  Return the number of threads that run pooled actors, where zero means
+//  one thread per CPU core.
+CZMQ_EXPORT size_t
+    zsys_pool_threads (void);
+
+//  Configure the stack size, in bytes, for new zactor threads. The default
+//  is zero, meaning the operating system default. If the environment
+//  variable ZSYS_THREAD_STACK_SIZE is defined, that provides the default.
+CZMQ_EXPORT void
+    zsys_set_thread_stack_size (size_t stack_size);
+
+//  Return the stack size for new zactor threads, where zero means the
+//  operating system default.
+CZMQ_EXPORT size_t
+    zsys_thread_stack_size (void);
+
+//  Configure the CPUs that ZeroMQ's I/O threads may run on, as a list like
+//  "0-3,8"; NULL means any CPU. CPUs that this process may not use are
+//  ignored. If the environment variable ZSYS_IO_THREAD_CPUS is defined,
+//  that provides the default. Returns 0 if OK, -1 if the list is not valid
+//  or the platform cannot pin threads. Note that this method is valid only
+//  before any socket is created.
+CZMQ_EXPORT int
+    zsys_set_io_thread_cpus (const char *cpus);
+
+//  Configure the scheduling policy and priority of ZeroMQ's I/O threads,
+//  as for zsys_thread_set_sched. The default for each is -1, meaning the
+//  operating system default. libzmq aborts if it cannot apply these, so
+//  use a real-time policy only where the process has the privileges. Note
+//  that this method is valid only before any socket is created.
+CZMQ_EXPORT void
+    zsys_set_io_thread_sched (int policy, int priority);
+
+//  Pin the calling thread to a list of CPUs, like "0-3,8". CPUs that this
+//  process may not use are ignored. Actors call this at startup, before
+//  zsock_signal, or zactor_new_with calls it for them. Returns 0 if OK, -1
+//  if the list is not valid, or the platform cannot pin threads.
+CZMQ_EXPORT int
+    zsys_thread_set_cpus (const char *cpus);
+
+//  Pin the calling thread to the CPUs of a NUMA node. Memory is placed on
+//  the node of the thread that first touches it, so an actor that pins
+//  itself before it allocates will mostly use local memory. Returns 0 if
+//  OK, -1 if there is no such node, or the platform cannot pin threads.
+CZMQ_EXPORT int
+    zsys_thread_set_numa_node (int node);
+
+//  Name the calling thread, so that it shows up in debuggers and tools
+//  like top. Linux keeps only the first 15 characters. Returns 0 if OK,
+//  -1 if the platform cannot name threads.
+CZMQ_EXPORT int
+    zsys_thread_set_name (const char *name);
+
+//  Set the scheduling policy and priority of the calling thread. On UNIX,
+//  the policy is SCHED_OTHER, SCHED_FIFO, or SCHED_RR; real-time policies
+//  need privileges. On Windows, the policy is ignored and the priority is
+//  passed to SetThreadPriority. Returns 0 if OK, -1 if not allowed.
+CZMQ_EXPORT int
+    zsys_thread_set_sched (int policy, int priority);
+
 //  Configure use of IPv6 for new zsock instances. By default sockets accept
 //  and make only IPv4 connections. When you enable IPv6, sockets will accept
 //  and connect to both IPv4 and IPv6 peers. You can override the setting on
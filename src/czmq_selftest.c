@@ -28,6 +28,9 @@
 */
 
 #include "../include/czmq.h"
+#include "zslab.h"
+#include "zpollset.h"
+#include "zscheduler.h"
 
 int
 main (int argc, char *argv [])
@@ -53,6 +56,7 @@ main (int argc, char *argv [])
     zstr_test (verbose);
     zmsg_test (verbose);
     zfile_test (verbose);
+    zslab_test (verbose);
     zhash_test (verbose);
     zlist_test (verbose);
     zring_test (verbose);
@@ -61,6 +65,10 @@ main (int argc, char *argv [])
     zsock_test (verbose);
     zsock_option_test (verbose);
     zactor_test (verbose);
+    zsignal_test (verbose);
+    zqueue_test (verbose);
+    zpollset_test (verbose);
+    zscheduler_test (verbose);
     zpoller_test (verbose);
     zloop_test (verbose);
     zproxy_test (verbose);
@@ -28,32 +28,207 @@
 
     An actor function MUST call zsock_signal (pipe) when initialized
     and MUST listen to pipe and exit on $TERM command.
+
+    A pooled actor, created with zactor_new_pooled, does not get a thread
+    of its own. Instead it has a handler that CZMQ calls, from a shared pool
+    of threads, each time the pipe has a message. This lets a process run
+    many thousands of actors, most of them idle, with a handful of threads.
+    The handler MUST receive one message per call, MUST NOT block, and MUST
+    return -1 on $TERM. A pooled actor looks like any other actor to its
+    caller.
 @discuss
+    To pin an actor's thread to CPUs or a NUMA node, name it, or set its
+    stack size or scheduling policy, create the actor with zactor_new_with
+    and a zactor_options_t. The thread applies the options before it calls
+    the actor function, so this works for any actor, including CZMQ's own,
+    like zproxy and zbeacon. An actor can also call the zsys_thread_set
+    methods itself, before it calls zsock_signal.
+
+    With zactor_options_set_signals, and where the platform supports it,
+    signals from the actor to its parent (zsock_signal on the actor's pipe,
+    and zsock_wait on the zactor_t) go through a zsignal_t rather than the
+    pipe. This makes actor startup, shutdown, and synchronous commands
+    cheaper. The catch is that these signals do not wake a poller that is
+    watching the actor, and zmsg_signal does not see them; use zsock_wait
+    to collect them. Signals from the parent to the actor always go through
+    the pipe.
+
+    The pool has one thread per CPU core, unless you set it with
+    zsys_set_pool_threads. It needs epoll, so on platforms without it, each
+    pooled actor gets its own thread, which calls the handler in a loop.
 @end
 */
 
+//  We need GNU extensions for thread names
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
 #include "../include/czmq.h"
+#include "zscheduler.h"
 
 //  zactor_t instances always have this tag as the first 4 octets of
 //  their data, which lets us do runtime object typing & validation.
 #define ZACTOR_TAG          0x0005cafe
 
-//  Structure of our class
+//  Options for an actor's thread
 
-struct _zactor_t {
-    uint32_t tag;               //  Object tag for runtime detection
-    zsock_t *pipe;              //  Front-end pipe through to actor
+struct _zactor_options_t {
+    char *cpus;                 //  CPU list, or NULL for any
+    int numa_node;              //  NUMA node, or -1 for any
+    char *name;                 //  Thread name, or NULL
+    size_t stack_size;          //  Stack size, or 0 for default
+    int policy;                 //  Scheduling policy, or -1 for default
+    int priority;               //  Scheduling priority
+    bool signals;               //  Signal parent through a zsignal_t?
 };
 
-
-//  This shims the OS thread APIs
+//  This shims the OS thread APIs; it's shared by the actor and its thread,
+//  and the last one to let go of it destroys it
 
 typedef struct {
     zactor_fn *handler;
+    zactor_handler_fn *event_handler;   //  Handler for pooled actor
     zsock_t *pipe;              //  Pipe back to parent
     void *args;                 //  Application arguments
+    zsignal_t *signal;          //  Signals from actor to parent, if any
+    zactor_options_t *options;  //  Thread options, if any
+    long refs;                  //  Actor and thread both hold a reference
 } shim_t;
 
+//  Structure of our class
+
+struct _zactor_t {
+    uint32_t tag;               //  Object tag for runtime detection
+    zsock_t *pipe;              //  Front-end pipe through to actor
+    shim_t *shim;               //  Shim shared with actor thread
+};
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Copy a set of thread options. Returns NULL if there was not enough
+//  memory.
+
+static zactor_options_t *
+s_options_dup (zactor_options_t *options)
+{
+    zactor_options_t *copy = (zactor_options_t *) zmalloc (sizeof (zactor_options_t));
+    if (!copy)
+        return NULL;
+    *copy = *options;
+    copy->cpus = options->cpus? strdup (options->cpus): NULL;
+    copy->name = options->name? strdup (options->name): NULL;
+    if ((options->cpus && !copy->cpus)
+    ||  (options->name && !copy->name))
+        zactor_options_destroy (&copy);
+    return copy;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Drop a reference to the shim, and destroy it with the last reference.
+
+static void
+s_shim_release (shim_t **shim_p)
+{
+    shim_t *shim = *shim_p;
+    if (shim) {
+#if defined (__WINDOWS__)
+        long refs = InterlockedDecrement ((volatile LONG *) &shim->refs);
+#else
+        long refs = __sync_sub_and_fetch (&shim->refs, 1);
+#endif
+        if (refs == 0) {
+            zsignal_destroy (&shim->signal);
+            zactor_options_destroy (&shim->options);
+            free (shim);
+        }
+        *shim_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Send the actor's exit signal, and let go of the actor's end of things.
+
+static void
+s_shim_end (shim_t *shim)
+{
+    //  Do not block, if the other end of the pipe is already deleted
+    zsock_set_sndtimeo (shim->pipe, 0);
+    zsock_signal (shim->pipe, 0);
+    zsock_destroy (&shim->pipe);
+    s_shim_release (&shim);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Apply the actor's thread options to the calling thread. We log what we
+//  cannot apply, and run the actor anyhow.
+
+static void
+s_shim_apply_options (shim_t *shim)
+{
+    zactor_options_t *options = shim->options;
+    if (options->cpus && zsys_thread_set_cpus (options->cpus))
+        zsys_warning ("zactor: cannot pin thread to CPUs %s", options->cpus);
+    if (options->numa_node != -1
+    &&  zsys_thread_set_numa_node (options->numa_node))
+        zsys_warning ("zactor: cannot pin thread to NUMA node %d",
+                      options->numa_node);
+    if (options->name && zsys_thread_set_name (options->name))
+        zsys_warning ("zactor: cannot name thread %s", options->name);
+    if (options->policy != -1
+    &&  zsys_thread_set_sched (options->policy, options->priority))
+        zsys_warning ("zactor: cannot set thread policy %d priority %d",
+                      options->policy, options->priority);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Run the actor in its own thread. A pooled actor that did not get into
+//  the pool runs its handler in a loop, until the handler ends it.
+
+static void
+s_shim_run (shim_t *shim)
+{
+    if (shim->options)
+        s_shim_apply_options (shim);
+    if (shim->event_handler)
+        while (shim->event_handler (shim->pipe, shim->args) == 0) ;
+    else
+        shim->handler (shim->pipe, shim->args);
+    s_shim_end (shim);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Scheduler task for a pooled actor, called when the pipe has input.
+
+static int
+s_pooled_handler (zsock_t *pipe, void *args)
+{
+    shim_t *shim = (shim_t *) args;
+    if (shim->event_handler (pipe, shim->args) == 0)
+        return 0;
+    s_shim_end (shim);
+    return -1;
+}
+
+//  Scheduler drops a pooled actor that did not end before the scheduler
+//  was destroyed
+
+static void
+s_pooled_drop (zsock_t *pipe, void *args)
+{
+    s_shim_end ((shim_t *) args);
+}
+
 
 //  --------------------------------------------------------------------------
 //  Thread creation code, wrapping POSIX and Win32 thread APIs
@@ -65,12 +240,7 @@ s_thread_shim (void *args)
 {
     assert (args);
     shim_t *shim = (shim_t *) args;
-    shim->handler (shim->pipe, shim->args);
-    //  Do not block, if the other end of the pipe is already deleted
-    zsock_set_sndtimeo (shim->pipe, 0);
-    zsock_signal (shim->pipe, 0);
-    zsock_destroy (&shim->pipe);
-    free (shim);
+    s_shim_run (shim);
     return NULL;
 }
 
@@ -82,12 +252,7 @@ s_thread_shim (void *args)
 {
     assert (args);
     shim_t *shim = (shim_t *) args;
-    shim->handler (shim->pipe, shim->args);
-    //  Do not block, if the other end of the pipe is already deleted
-    zsock_set_sndtimeo (shim->pipe, 0);
-    zsock_signal (shim->pipe, 0);
-    zsock_destroy (&shim->pipe);
-    free (shim);
+    s_shim_run (shim);
     _endthreadex (0);           //  Terminates thread
     return 0;
 }
@@ -95,10 +260,13 @@ s_thread_shim (void *args)
 
 
 //  --------------------------------------------------------------------------
-//  Create a new actor.
+//  Local helper function
+//  Create the actor and its pipe, and start either a thread or a pooled
+//  task for it. Returns NULL if there was not enough memory.
 
-zactor_t *
-zactor_new (zactor_fn *actor, void *args)
+static zactor_t *
+s_actor_new (zactor_fn *actor, zactor_handler_fn *handler, void *args,
+             zactor_options_t *options)
 {
     zactor_t *self = (zactor_t *) zmalloc (sizeof (zactor_t));
     if (!self)
@@ -107,9 +275,11 @@ zactor_new (zactor_fn *actor, void *args)
 
     shim_t *shim = (shim_t *) zmalloc (sizeof (shim_t));
     if (!shim) {
-        zactor_destroy (&self);
+        free (self);
         return NULL;
     }
+    shim->refs = 2;
+    self->shim = shim;
 
     //  Create front-to-back pipe pair
     self->pipe = zsock_new (ZMQ_PAIR);
@@ -135,17 +305,48 @@ zactor_new (zactor_fn *actor, void *args)
     assert (rc != -1);
 
     shim->handler = actor;
+    shim->event_handler = handler;
     shim->args = args;
+    if (options) {
+        shim->options = s_options_dup (options);
+        assert (shim->options);
+    }
+    size_t stack_size = options && options->stack_size?
+        options->stack_size: zsys_thread_stack_size ();
+
+    //  If asked, signals from the actor, including the handshakes, skip
+    //  the pipe where the platform lets us. Signals to the actor use the
+    //  pipe, so the actor can wait for them in its poller.
+    if (options && options->signals)
+        shim->signal = zsignal_new ();
+    if (shim->signal) {
+        zsock_set_signals (shim->pipe, shim->signal, NULL);
+        zsock_set_signals (self->pipe, NULL, shim->signal);
+    }
 
+    //  Pooled actors go to the scheduler if there is one; any that can't
+    //  get a thread of their own
+    if (handler) {
+        zscheduler_t *scheduler = zsys_scheduler ();
+        if (scheduler
+        &&  zscheduler_add (scheduler, shim->pipe, s_pooled_handler,
+                            s_pooled_drop, shim) == 0)
+            return self;
+    }
 #if defined (__UNIX__)
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    if (stack_size)
+        pthread_attr_setstacksize (&attr, stack_size);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
     pthread_t thread;
-    pthread_create (&thread, NULL, s_thread_shim, shim);
-    pthread_detach (thread);
+    pthread_create (&thread, &attr, s_thread_shim, shim);
+    pthread_attr_destroy (&attr);
 
 #elif defined (__WINDOWS__)
     HANDLE handle = (HANDLE) _beginthreadex (
         NULL,                   //  Handle is private to this process
-        0,                      //  Use a default stack size for new thread
+        (unsigned) stack_size,  //  Zero means default
         &s_thread_shim,         //  Start real thread function via this shim
         shim,                   //  Which gets arguments shim
         CREATE_SUSPENDED,       //  Set thread priority before starting it
@@ -161,14 +362,55 @@ zactor_new (zactor_fn *actor, void *args)
     CloseHandle (handle);
 #endif
 
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new actor.
+
+zactor_t *
+zactor_new (zactor_fn *actor, void *args)
+{
+    return zactor_new_with (actor, args, NULL);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new actor, as zactor_new, and set up its thread with the given
+//  options before the actor function runs. The options are copied, so the
+//  caller may destroy them straight away. If options is NULL, this is the
+//  same as zactor_new.
+
+zactor_t *
+zactor_new_with (zactor_fn *actor, void *args, zactor_options_t *options)
+{
+    assert (actor);
+    zactor_t *self = s_actor_new (actor, NULL, args, options);
     //  Mandatory handshake for new actor so that constructor returns only
     //  when actor has also initialized. This eliminates timing issues at
     //  application start up.
-    zsock_wait (self->pipe);
+    if (self)
+        zsock_wait (self->pipe);
     return self;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Create a new pooled actor, passing arbitrary arguments reference. The
+//  handler is called from a shared thread pool each time the actor's pipe
+//  has input, and must receive one message. It returns 0 to carry on, or
+//  -1 to end the actor, which it must do on $TERM. A pooled actor is ready
+//  as soon as it's created, so there is no startup handshake.
+
+zactor_t *
+zactor_new_pooled (zactor_handler_fn *handler, void *args)
+{
+    assert (handler);
+    return s_actor_new (NULL, handler, args, NULL);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Destroy the actor.
 
@@ -188,6 +430,7 @@ zactor_destroy (zactor_t **self_p)
         if (zstr_send (self->pipe, "$TERM") == 0)
             zsock_wait (self->pipe);
         zsock_destroy (&self->pipe);
+        s_shim_release (&self->shim);
         self->tag = 0xDeadBeef;
         free (self);
         *self_p = NULL;
@@ -245,6 +488,135 @@ zactor_resolve (void *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Return the actor's zsock handle. Use this when you absolutely need to
+//  work with the zsock instance rather than the actor.
+
+zsock_t *
+zactor_sock (zactor_t *self)
+{
+    assert (self);
+    return self->pipe;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new set of actor thread options. By default, the thread runs
+//  on any CPU, has no name, uses the zsys_thread_stack_size stack size, and
+//  has the operating system's default scheduling.
+
+zactor_options_t *
+zactor_options_new (void)
+{
+    zactor_options_t *self = (zactor_options_t *) zmalloc (sizeof (zactor_options_t));
+    if (self) {
+        self->numa_node = -1;
+        self->policy = -1;
+        self->priority = -1;
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a set of actor thread options.
+
+void
+zactor_options_destroy (zactor_options_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zactor_options_t *self = *self_p;
+        free (self->cpus);
+        free (self->name);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pin the actor thread to a list of CPUs, like "0-3,8", as for
+//  zsys_thread_set_cpus.
+
+void
+zactor_options_set_cpus (zactor_options_t *self, const char *cpus)
+{
+    assert (self);
+    assert (cpus);
+    free (self->cpus);
+    self->cpus = strdup (cpus);
+    self->numa_node = -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pin the actor thread to the CPUs of a NUMA node, as for
+//  zsys_thread_set_numa_node. This replaces any CPU list.
+
+void
+zactor_options_set_numa_node (zactor_options_t *self, int node)
+{
+    assert (self);
+    free (self->cpus);
+    self->cpus = NULL;
+    self->numa_node = node;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Name the actor thread, as for zsys_thread_set_name.
+
+void
+zactor_options_set_name (zactor_options_t *self, const char *name)
+{
+    assert (self);
+    assert (name);
+    free (self->name);
+    self->name = strdup (name);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the stack size, in bytes, of the actor thread. Zero means the
+//  zsys_thread_stack_size default.
+
+void
+zactor_options_set_stack_size (zactor_options_t *self, size_t stack_size)
+{
+    assert (self);
+    self->stack_size = stack_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the scheduling policy and priority of the actor thread, as for
+//  zsys_thread_set_sched.
+
+void
+zactor_options_set_sched (zactor_options_t *self, int policy, int priority)
+{
+    assert (self);
+    self->policy = policy;
+    self->priority = priority;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send signals from the actor to its parent through a zsignal_t, rather
+//  than the pipe, where the platform supports it. This makes the actor's
+//  handshakes cheaper, but these signals do not wake a poller that watches
+//  the actor, and zmsg_signal does not see them; use zsock_wait to collect
+//  them. The default is false.
+
+void
+zactor_options_set_signals (zactor_options_t *self, bool signals)
+{
+    assert (self);
+    self->signals = signals;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Actor
 //  must call zsock_signal (pipe) when initialized
@@ -280,6 +652,62 @@ echo_actor (zsock_t *pipe, void *args)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Pooled actor
+//  must receive one message per call, and return -1 on $TERM
+
+static int
+echo_handler (zsock_t *pipe, void *args)
+{
+    zmsg_t *msg = zmsg_recv (pipe);
+    if (!msg)
+        return -1;              //  Interrupted
+    char *command = zmsg_popstr (msg);
+    int rc = 0;
+    //  All pooled actors must handle $TERM in this way
+    if (streq (command, "$TERM"))
+        rc = -1;
+    else
+    //  This is an example command for our test actor
+    if (streq (command, "ECHO"))
+        zmsg_send (&msg, pipe);
+    else {
+        puts ("E: invalid message to actor");
+        assert (false);
+    }
+    free (command);
+    zmsg_destroy (&msg);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Actor that reports its thread name, or signals
+
+static void
+named_actor (zsock_t *pipe, void *args)
+{
+    zsock_signal (pipe, 0);
+    while (true) {
+        char *command = zstr_recv (pipe);
+        if (!command || streq (command, "$TERM")) {
+            free (command);
+            break;
+        }
+        if (streq (command, "SIGNAL"))
+            zsock_signal (pipe, 7);
+        else {
+            char name [16] = "";
+#if defined (__UTYPE_LINUX)
+            pthread_getname_np (pthread_self (), name, sizeof (name));
+#endif
+            zstr_send (pipe, name);
+        }
+        free (command);
+    }
+}
+
+
 //  --------------------------------------------------------------------------
 //  Selftest
 
@@ -296,6 +724,55 @@ zactor_test (bool verbose)
     assert (streq (string, "This is a string"));
     free (string);
     zactor_destroy (&actor);
+
+    //  Pooled actors share a few threads, and work like any other actor
+#   define POOLED_ACTORS 100
+    zactor_t *actors [POOLED_ACTORS];
+    int index;
+    for (index = 0; index < POOLED_ACTORS; index++) {
+        actors [index] = zactor_new_pooled (echo_handler, NULL);
+        assert (actors [index]);
+    }
+    for (index = 0; index < POOLED_ACTORS; index++)
+        zstr_sendx (actors [index], "ECHO", "This is a string", NULL);
+    for (index = 0; index < POOLED_ACTORS; index++) {
+        string = zstr_recv (actors [index]);
+        assert (streq (string, "This is a string"));
+        free (string);
+    }
+    for (index = 0; index < POOLED_ACTORS; index++)
+        zactor_destroy (&actors [index]);
+
+    //  Signals from an actor wake a poller, like any message
+    actor = zactor_new (named_actor, NULL);
+    assert (actor);
+    zpoller_t *poller = zpoller_new (actor, NULL);
+    assert (poller);
+    zstr_send (actor, "SIGNAL");
+    assert (zpoller_wait (poller, -1) == actor);
+    assert (zsock_wait (actor) == 7);
+    zpoller_destroy (&poller);
+    zactor_destroy (&actor);
+
+    //  Any actor's thread can be set up from outside
+    zactor_options_t *options = zactor_options_new ();
+    assert (options);
+    zactor_options_set_cpus (options, "0-1023");
+    zactor_options_set_name (options, "zactor-test");
+    zactor_options_set_stack_size (options, 1024 * 1024);
+    zactor_options_set_signals (options, true);
+    actor = zactor_new_with (named_actor, NULL, options);
+    zactor_options_destroy (&options);
+    assert (actor);
+#if defined (__UTYPE_LINUX)
+    zstr_send (actor, "NAME");
+    string = zstr_recv (actor);
+    assert (streq (string, "zactor-test"));
+    free (string);
+#endif
+    zstr_send (actor, "SIGNAL");
+    assert (zsock_wait (actor) == 7);
+    zactor_destroy (&actor);
     //  @end
 
     printf ("OK\n");
@@ -42,6 +42,7 @@
 
 struct _zcertstore_t {
     char *location;             //  Directory location
+    zdir_t *dir;                //  Directory tree, if it exists
     //  This isn't sufficient; we should check the hash of all files
     //  or else use a trigger like inotify on Linux.
     time_t modified;            //  Modified time of directory
@@ -90,10 +91,11 @@ static void
 s_load_certs_from_disk (zcertstore_t *self)
 {
     zhash_purge (self->certs);
-    zdir_t *dir = zdir_new (self->location, NULL);
-    if (dir) {
+    if (!self->dir)
+        self->dir = zdir_new (self->location, NULL);
+    if (self->dir) {
         //  Load all certificates including those in subdirectories
-        zfile_t **filelist = zdir_flatten (dir);
+        zfile_t **filelist = zdir_flatten (self->dir);
         zrex_t *rex = zrex_new ("_secret$");
         assert (rex);
 
@@ -110,12 +112,10 @@ s_load_certs_from_disk (zcertstore_t *self)
             }
         }
         zdir_flatten_free (&filelist);
-        self->modified = zdir_modified (dir);
-        self->count = zdir_count (dir);
-        self->cursize = zdir_cursize (dir);
-
+        self->modified = zdir_modified (self->dir);
+        self->count = zdir_count (self->dir);
+        self->cursize = zdir_cursize (self->dir);
         zrex_destroy (&rex);
-        zdir_destroy (&dir);
     }
 }
 
@@ -133,6 +133,7 @@ zcertstore_destroy (zcertstore_t **self_p)
     if (*self_p) {
         zcertstore_t *self = *self_p;
         zhash_destroy (&self->certs);
+        zdir_destroy (&self->dir);
         free (self->location);
         free (self);
         *self_p = NULL;
@@ -147,16 +148,20 @@ zcertstore_destroy (zcertstore_t **self_p)
 zcert_t *
 zcertstore_lookup (zcertstore_t *self, const char *public_key)
 {
-    //  If directory has changed, reload all certificates
+    //  If directory has changed, reload all certificates. We keep the
+    //  directory tree between lookups, and refresh it, which only rereads
+    //  the parts that changed
     if (self->location) {
-        zdir_t *dir = zdir_new (self->location, NULL);
-        if (  dir
-           && (  self->modified != zdir_modified (dir)
-              || self->count != zdir_count (dir)
-              || self->cursize != zdir_cursize (dir))) {
+        if (self->dir && zdir_refresh (self->dir))
+            zdir_destroy (&self->dir);
+        if (!self->dir)
+            self->dir = zdir_new (self->location, NULL);
+        if (  self->dir
+           && (  self->modified != zdir_modified (self->dir)
+              || self->count != zdir_count (self->dir)
+              || self->cursize != zdir_cursize (self->dir))) {
             s_load_certs_from_disk (self);
         }
-        zdir_destroy (&dir);
     }
     return (zcert_t *) zhash_lookup (self->certs, public_key);
 }
@@ -21,6 +21,9 @@
 */
 
 #include "../include/czmq.h"
+#if defined (__UNIX__)
+#   include <sys/mman.h>
+#endif
 
 //  zchunk_t instances always have this tag as the first 4 octets of
 //  their data, which lets us do runtime object typing & validation.
@@ -34,9 +37,30 @@ struct _zchunk_t {
     size_t max_size;            //  Maximum allocated size
     size_t consumed;            //  Amount already consumed
     byte *data;                 //  Data part follows here
+    void *mapping;              //  Mapped file pages, if any
+    size_t mapping_size;        //  Size of mapped pages
 };
 
 
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Release the chunk data, if it does not follow the chunk header
+
+static void
+s_release_data (zchunk_t *self)
+{
+#if defined (__UNIX__)
+    if (self->mapping) {
+        munmap (self->mapping, self->mapping_size);
+        self->mapping = NULL;
+    }
+    else
+#endif
+    if (self->data != (byte *) self + sizeof (zchunk_t))
+        free (self->data);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Create a new chunk of the specified size. If you specify the data, it
 //  is copied into the chunk. If you do not specify the data, the chunk is
@@ -52,6 +76,8 @@ zchunk_new (const void *data, size_t size)
         self->max_size = size;
         self->consumed = 0;
         self->data = (byte *) self + sizeof (zchunk_t);
+        self->mapping = NULL;
+        self->mapping_size = 0;
         if (data) {
             self->size = size;
             memcpy (self->data, data, size);
@@ -71,9 +97,7 @@ zchunk_destroy (zchunk_t **self_p)
     if (*self_p) {
         zchunk_t *self = *self_p;
         assert (zchunk_is (self));
-        //  If data was reallocated independently, free it independently
-        if (self->data != (byte *) self + sizeof (zchunk_t))
-            free (self->data);
+        s_release_data (self);
         self->tag = 0xDeadBeef;
         free (self);
         *self_p = NULL;
@@ -90,10 +114,7 @@ zchunk_resize (zchunk_t *self, size_t size)
     assert (self);
     assert (zchunk_is (self));
 
-    //  If data was reallocated independently, free it independently
-    if (self->data != (byte *) self + sizeof (zchunk_t))
-        free (self->data);
-
+    s_release_data (self);
     self->data = (byte *) zmalloc (size);
     self->max_size = size;
     self->size = 0;
@@ -145,6 +166,7 @@ zchunk_set (zchunk_t *self, const void *data, size_t size)
 {
     assert (self);
     assert (zchunk_is (self));
+    assert (!self->mapping);
 
     if (size > self->max_size)
         size = self->max_size;
@@ -165,6 +187,7 @@ zchunk_fill (zchunk_t *self, byte filler, size_t size)
 {
     assert (self);
     assert (zchunk_is (self));
+    assert (!self->mapping);
 
     if (size > self->max_size)
         size = self->max_size;
@@ -183,6 +206,7 @@ zchunk_append (zchunk_t *self, const void *data, size_t size)
 {
     assert (self);
     assert (zchunk_is (self));
+    assert (!self->mapping);
 
     if (self->size + size > self->max_size)
         size = self->max_size - self->size;
@@ -206,6 +230,7 @@ zchunk_consume (zchunk_t *self, zchunk_t *source)
     assert (zchunk_is (self));
     assert (source);
     assert (zchunk_is (source));
+    assert (!self->mapping);
 
     //  We can take at most this many bytes from source
     size_t size = source->size - source->consumed;
@@ -251,6 +276,66 @@ zchunk_read (FILE *handle, size_t bytes)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Map part of an open file into a chunk, without reading it. The chunk
+//  data points straight at the file's pages, which are read-only, and the
+//  kernel is told we will read them sequentially. Maps up to the specified
+//  number of bytes, starting at the offset, and stops at the end of file.
+//  You cannot modify a mapped chunk, and the file must not be truncated
+//  while it is mapped. Use zchunk_packx to send the chunk without copying
+//  it. On systems without mmap, reads the data instead. Returns a new
+//  chunk, or NULL if the file could not be mapped.
+
+zchunk_t *
+zchunk_map (FILE *handle, size_t bytes, off_t offset)
+{
+    assert (handle);
+#if defined (__UNIX__)
+    int fd = fileno (handle);
+    struct stat stat_buf;
+    if (fstat (fd, &stat_buf) == -1)
+        return NULL;
+
+    //  Calculate real number of bytes to map; mmap cannot map nothing
+    if (offset > stat_buf.st_size)
+        bytes = 0;
+    else
+    if (bytes > (size_t) (stat_buf.st_size - offset))
+        bytes = (size_t) (stat_buf.st_size - offset);
+    if (bytes == 0)
+        return zchunk_new (NULL, 0);
+
+    //  Mappings must start on a page boundary
+    off_t page_size = (off_t) sysconf (_SC_PAGESIZE);
+    off_t map_offset = offset - offset % page_size;
+    size_t map_size = bytes + (size_t) (offset - map_offset);
+    void *mapping = mmap (NULL, map_size, PROT_READ, MAP_SHARED, fd, map_offset);
+    if (mapping == MAP_FAILED)
+        return NULL;
+#   if defined (MADV_SEQUENTIAL)
+    madvise (mapping, map_size, MADV_SEQUENTIAL);
+    madvise (mapping, map_size, MADV_WILLNEED);
+#   endif
+
+    zchunk_t *self = zchunk_new (NULL, 0);
+    if (self) {
+        self->mapping = mapping;
+        self->mapping_size = map_size;
+        self->data = (byte *) mapping + (offset - map_offset);
+        self->size = bytes;
+        self->max_size = bytes;
+    }
+    else
+        munmap (mapping, map_size);
+    return self;
+#else
+    if (fseek (handle, (long) offset, SEEK_SET) == -1)
+        return NULL;
+    return zchunk_read (handle, bytes);
+#endif
+}
+
+
 //  --------------------------------------------------------------------------
 //  Write chunk to an open file descriptor
 
@@ -381,6 +466,41 @@ zchunk_pack (zchunk_t *self)
     return zframe_new (self->data, self->max_size);
 }
 
+//  --------------------------------------------------------------------------
+//  Transform zchunk into a zframe that can be sent in a message, without
+//  copying the chunk data. The frame takes ownership of the chunk, which
+//  is destroyed when libzmq has finished with the data. Nullifies the
+//  caller's reference to the chunk. Returns NULL, and leaves the chunk
+//  alone, if there was not enough memory.
+
+static void
+s_chunk_free (void *data, void *arg)
+{
+    zchunk_t *self = (zchunk_t *) arg;
+    zchunk_destroy (&self);
+}
+
+zframe_t *
+zchunk_packx (zchunk_t **self_p)
+{
+    assert (self_p);
+    zchunk_t *self = *self_p;
+    assert (self);
+    assert (zchunk_is (self));
+
+    zframe_t *frame;
+    if (self->size)
+        frame = zframe_new_zero_copy (self->data, self->size, s_chunk_free, self);
+    else
+        frame = zframe_new_empty ();
+    if (frame) {
+        if (!self->size)
+            zchunk_destroy (&self);
+        *self_p = NULL;
+    }
+    return frame;
+}
+
 //  --------------------------------------------------------------------------
 //  Create a zchunk from a zframe.
 
@@ -501,7 +621,17 @@ zchunk_test (bool verbose)
     zframe_destroy (&frame);
     zchunk_destroy (&chunk2);
 
+    //  Pack chunk into a frame without copying its data
     zchunk_t *copy = zchunk_dup (chunk);
+    byte *data = zchunk_data (copy);
+    frame = zchunk_packx (&copy);
+    assert (frame);
+    assert (copy == NULL);
+    assert (zframe_data (frame) == data);
+    assert (zframe_size (frame) == 10);
+    zframe_destroy (&frame);
+
+    copy = zchunk_dup (chunk);
     assert (copy);
     assert (memcmp (zchunk_data (copy), "1234567890", 10) == 0);
     assert (zchunk_size (copy) == 10);
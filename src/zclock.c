@@ -67,6 +67,24 @@ s_perfcounter_to_msec (const LARGE_INTEGER *count)
     return (int64_t) (count->QuadPart  * 1000) / freq;
 }
 
+//  --------------------------------------------------------------------------
+//  Convert PerformanceCounter count to usec
+
+static int64_t
+s_perfcounter_to_usec (const LARGE_INTEGER *count)
+{
+    // System frequency does not change at run-time, cache it
+    static int64_t freq = 0;
+    if (freq == 0)
+        freq = s_get_frequencey ();
+
+    //  Split the count into seconds and a remainder, as multiplying it by
+    //  a million would overflow after ten days or so at 10 MHz
+    int64_t seconds = count->QuadPart / freq;
+    int64_t remainder = count->QuadPart % freq;
+    return seconds * 1000000 + remainder * 1000000 / freq;
+}
+
 #endif
 
 
@@ -143,6 +161,33 @@ zclock_mono (void)
 #endif
 }
 
+
+//  --------------------------------------------------------------------------
+//  Return current monotonic clock in microseconds
+
+int64_t
+zclock_usecs (void)
+{
+#if defined (__UNIX__)
+#   if defined (__UTYPE_OSX)
+    clock_serv_t cclock;
+    mach_timespec_t mts;
+    host_get_clock_service (mach_host_self (), SYSTEM_CLOCK, &cclock);
+    clock_get_time (cclock, &mts);
+    mach_port_deallocate (mach_task_self (), cclock);
+    return (int64_t) ((int64_t) mts.tv_sec * 1000000 + (int64_t) mts.tv_nsec / 1000);
+#   else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (int64_t) ((int64_t) ts.tv_sec * 1000000 + (int64_t) ts.tv_nsec / 1000);
+#   endif
+#elif (defined (__WINDOWS__))
+    LARGE_INTEGER count;
+    QueryPerformanceCounter (&count);
+    return s_perfcounter_to_usec (&count);
+#endif
+}
+
 //  --------------------------------------------------------------------------
 //  Return formatted date/time as fresh string. Free using zstr_free().
 
@@ -194,6 +239,9 @@ zclock_test (bool verbose)
     start = zclock_mono ();
     zclock_sleep (10);
     assert ((zclock_mono () - start) >= 10);
+    start = zclock_usecs ();
+    zclock_sleep (10);
+    assert ((zclock_usecs () - start) >= 10000);
     char *timestr = zclock_timestr ();
     if (verbose)
         puts (timestr);
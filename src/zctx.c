@@ -292,6 +292,7 @@ zctx__socket_new (zctx_t *self, int type)
     void *zocket = zmq_socket (self->context, type);
     if (!zocket)
         return NULL;
+    zsys_handle_closed ();
 
 #if (ZMQ_VERSION_MAJOR == 2)
     //  For ZeroMQ/2.x we use sndhwm for both send and receive
@@ -336,6 +337,7 @@ zctx__socket_destroy (zctx_t *self, void *zocket)
     assert (zocket);
     zsocket_set_linger (zocket, self->linger);
     zmq_close (zocket);
+    zsys_handle_closed ();
 
     zmutex_lock (self->mutex);
     zlist_remove (self->sockets, zocket);
@@ -34,6 +34,9 @@
 */
 
 #include "../include/czmq.h"
+#if defined (__UTYPE_LINUX)
+#   include <sys/inotify.h>
+#endif
 
 //  Structure of our class
 
@@ -45,73 +48,22 @@ struct _zdir_t {
     off_t cursize;          //  Total file size including subdirs
     size_t count;           //  Total file count including subdirs
     bool trimmed;           //  Load only top level directory
+    time_t dir_modified;    //  Modified time of directory itself
+    time_t loaded;          //  When we last read the directory entries
+    size_t threads;         //  Number of threads to load tree with
 };
 
-#if (defined (WIN32))
-static void
-s_win32_populate_entry (zdir_t *self, WIN32_FIND_DATAA *entry)
-{
-    if (entry->cFileName [0] == '.')
-        ; //  Skip hidden files
-    else
-    //  If we have a subdirectory, go load that
-    if (entry->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-        if (!self->trimmed) {
-            zdir_t *subdir = zdir_new (entry->cFileName, self->path);
-            zlist_append (self->subdirs, subdir);
-        }
-    }
-    else {
-        //  Add file entry to directory list
-        zfile_t *file = zfile_new (self->path, entry->cFileName);
-        assert (file);
-        zlist_append (self->files, file);
-    }
-}
-
-#else
-static void
-s_posix_populate_entry (zdir_t *self, struct dirent *entry)
-{
-    //  Skip . and ..
-    if (  streq (entry->d_name, ".")
-       || streq (entry->d_name, ".."))
-        return;
-
-    char fullpath [1024 + 1];
-    snprintf (fullpath, 1024, "%s/%s", self->path, entry->d_name);
-    struct stat stat_buf;
-    if (stat (fullpath, &stat_buf))
-        return;
-
-    if (entry->d_name [0] == '.')
-        ; //  Skip hidden files
-    else
-    //  If we have a subdirectory, go load that
-    if (S_ISDIR (stat_buf.st_mode)) {
-        if (!self->trimmed) {
-            zdir_t *subdir = zdir_new (entry->d_name, self->path);
-            assert (subdir);
-            zlist_append (self->subdirs, subdir);
-        }
-    }
-    else {
-        //  Add file entry to directory list
-        zfile_t *file = zfile_new (self->path, entry->d_name);
-        assert (file);
-        zlist_append (self->files, file);
-    }
-}
-#endif
+static int s_dir_walk (zdir_t *self);
+static void s_dir_patch_tree (zdir_t *self, zdir_patch_op_t op,
+                              zlist_t *patches, const char *root);
 
 
 //  --------------------------------------------------------------------------
-//  Create a new directory item that loads in the full tree of the specified
-//  path, optionally located under some parent path. If parent is "-", then
-//  loads only the top-level directory (and does not use parent as a path).
+//  Local helper function
+//  Create an empty directory item, without loading anything from disk
 
-zdir_t *
-zdir_new (const char *path, const char *parent)
+static zdir_t *
+s_dir_new (const char *path, const char *parent)
 {
     zdir_t *self = (zdir_t *) zmalloc (sizeof (zdir_t));
     if (!self)
@@ -139,7 +91,6 @@ zdir_new (const char *path, const char *parent)
         zdir_destroy (&self);
         return NULL;
     }
-
 #if (defined (WIN32))
     //  On Windows, replace backslashes by normal slashes
     char *path_clean_ptr = self->path;
@@ -148,55 +99,225 @@ zdir_new (const char *path, const char *parent)
             *path_clean_ptr = '/';
         path_clean_ptr++;
     }
+#endif
     //  Remove any trailing slash
     if (self->path [strlen (self->path) - 1] == '/')
         self->path [strlen (self->path) - 1] = 0;
 
+    self->threads = 1;
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  If we are collecting patches, add a patch for a file that changed. The
+//  patches are relative to the root path of the tree.
+
+static void
+s_dir_patch (zfile_t *file, zdir_patch_op_t op, zlist_t *patches, const char *root)
+{
+    if (patches) {
+        zdir_patch_t *patch = zdir_patch_new (root, file, op, "/");
+        if (patch)
+            zlist_append (patches, patch);
+    }
+}
+
+static void
+s_dir_restat_file (zfile_t *file, zlist_t *patches, const char *root)
+{
+    time_t modified = zfile_modified (file);
+    off_t cursize = zfile_cursize (file);
+    zfile_restat (file);
+    if (  zfile_modified (file) != modified
+       || zfile_cursize (file) != cursize)
+        s_dir_patch (file, patch_create, patches, root);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Add one directory entry to the directory item. If we already knew the
+//  file or subdirectory, keeps the item we had, else creates a new one.
+//  New subdirectories are empty until they are loaded.
+
+static void
+s_dir_add_entry (zdir_t *self, const char *name, bool is_dir,
+                 zhash_t *old_files, zhash_t *old_subdirs,
+                 zlist_t *patches, const char *root)
+{
+    if (is_dir) {
+        if (self->trimmed)
+            return;
+        zdir_t *subdir = NULL;
+        if (old_subdirs && (subdir = (zdir_t *) zhash_lookup (old_subdirs, name)))
+            zhash_delete (old_subdirs, name);
+        else
+            subdir = s_dir_new (name, self->path);
+        if (subdir)
+            zlist_append (self->subdirs, subdir);
+    }
+    else {
+        zfile_t *file = NULL;
+        if (old_files && (file = (zfile_t *) zhash_lookup (old_files, name))) {
+            zhash_delete (old_files, name);
+            s_dir_restat_file (file, patches, root);
+        }
+        else
+        if ((file = zfile_new (self->path, name)))
+            s_dir_patch (file, patch_create, patches, root);
+        if (file)
+            zlist_append (self->files, file);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Read the directory entries, keeping any files and subdirectories that
+//  are still there, and dropping those that went away. Does not load the
+//  subdirectories. Returns 0 if OK, -1 if the directory could not be read,
+//  in which case it is left empty. If patches is not null, adds a patch
+//  for each file that was created, changed, or deleted.
+
+static int
+s_dir_load (zdir_t *self, zlist_t *patches, const char *root)
+{
+    //  Move what we had into tables, by name, so we can reuse it
+    zhash_t *old_files = zlist_size (self->files)? zhash_new (): NULL;
+    zfile_t *file;
+    while ((file = (zfile_t *) zlist_pop (self->files))) {
+        if (!old_files
+        ||  zhash_insert (old_files, zfile_filename (file, self->path), file))
+            zfile_destroy (&file);
+    }
+    zhash_t *old_subdirs = zlist_size (self->subdirs)? zhash_new (): NULL;
+    zdir_t *subdir;
+    while ((subdir = (zdir_t *) zlist_pop (self->subdirs))) {
+        if (!old_subdirs
+        ||  zhash_insert (old_subdirs, subdir->path + strlen (self->path) + 1, subdir))
+            zdir_destroy (&subdir);
+    }
+    int rc = 0;
+    self->loaded = time (NULL);
+    self->dir_modified = zsys_file_modified (self->path);
+
+#if (defined (WIN32))
     //  Win32 wants a wildcard at the end of the path
     char *wildcard = (char *) malloc (strlen (self->path) + 3);
-    if (!wildcard) {
-        zdir_destroy (&self);
-        return NULL;
-    }
-    sprintf (wildcard, "%s/*", self->path);
+    HANDLE handle = INVALID_HANDLE_VALUE;
     WIN32_FIND_DATAA entry;
-    HANDLE handle = FindFirstFileA (wildcard, &entry);
-    free (wildcard);
-
+    if (wildcard) {
+        sprintf (wildcard, "%s/*", self->path);
+        handle = FindFirstFileA (wildcard, &entry);
+        free (wildcard);
+    }
     if (handle != INVALID_HANDLE_VALUE) {
-        //  We have read an entry, so return those values
-        s_win32_populate_entry (self, &entry);
-        while (FindNextFileA (handle, &entry))
-            s_win32_populate_entry (self, &entry);
+        do {
+            if (entry.cFileName [0] != '.')     //  Skip hidden files
+                s_dir_add_entry (self, entry.cFileName,
+                    (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0,
+                    old_files, old_subdirs, patches, root);
+        } while (FindNextFileA (handle, &entry));
         FindClose (handle);
     }
+    else
+        rc = -1;
 #else
-    //  Remove any trailing slash
-    if (self->path [strlen (self->path) - 1] == '/')
-        self->path [strlen (self->path) - 1] = 0;
-
-    DIR *handle = opendir (self->path);
-    if (handle) {
-        //  Calculate system-specific size of dirent block
-        int dirent_size = offsetof (struct dirent, d_name)
-                          + pathconf (self->path, _PC_NAME_MAX) + 1;
-        struct dirent *entry = (struct dirent *) malloc (dirent_size);
-        struct dirent *result;
-
-        int rc = readdir_r (handle, entry, &result);
-        while (rc == 0 && result != NULL) {
-            s_posix_populate_entry (self, entry);
-            rc = readdir_r (handle, entry, &result);
+    //  Most filesystems give us the entry type, so we only stat entries
+    //  when it's unknown, and then relative to the open directory. Files
+    //  still stat themselves by full path, in zfile_new or zfile_restat
+    int handle = open (self->path, O_RDONLY);
+    DIR *dir = handle == -1? NULL: fdopendir (handle);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir (dir))) {
+            if (entry->d_name [0] == '.')
+                continue;           //  Skip hidden files, and . and ..
+            bool is_dir;
+#   if defined (DT_DIR)
+            if (entry->d_type == DT_DIR || entry->d_type == DT_REG)
+                is_dir = entry->d_type == DT_DIR;
+            else
+#   endif
+            {
+                struct stat stat_buf;
+                if (fstatat (handle, entry->d_name, &stat_buf, 0))
+                    continue;       //  E.g. a broken symbolic link
+                is_dir = S_ISDIR (stat_buf.st_mode) != 0;
+            }
+            s_dir_add_entry (self, entry->d_name, is_dir,
+                             old_files, old_subdirs, patches, root);
         }
-        free (entry);
-        closedir (handle);
+        closedir (dir);
     }
-#endif
     else {
-        zdir_destroy (&self);
-        return NULL;
+        if (handle != -1)
+            close (handle);
+        rc = -1;
     }
-    //  Update directory signatures
+#endif
+    //  Anything left over has gone away
+    if (old_files) {
+        file = (zfile_t *) zhash_first (old_files);
+        while (file) {
+            s_dir_patch (file, patch_delete, patches, root);
+            zfile_destroy (&file);
+            file = (zfile_t *) zhash_next (old_files);
+        }
+        zhash_destroy (&old_files);
+    }
+    if (old_subdirs) {
+        subdir = (zdir_t *) zhash_first (old_subdirs);
+        while (subdir) {
+            s_dir_patch_tree (subdir, patch_delete, patches, root);
+            zdir_destroy (&subdir);
+            subdir = (zdir_t *) zhash_next (old_subdirs);
+        }
+        zhash_destroy (&old_subdirs);
+    }
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Bring one directory item up to date with the disk, not including its
+//  subdirectories. If the directory itself has not changed since we read
+//  it, its entries are the same, and we only need to restat the files.
+//  Returns 0 if OK, -1 if the directory could not be read. If patches is
+//  not null, adds a patch for each file that changed.
+
+static int
+s_dir_refresh (zdir_t *self, zlist_t *patches, const char *root)
+{
+    //  We cannot trust a modified time in the same second we read the
+    //  directory, as it may have changed again after we read it
+    if (  self->loaded == 0
+       || self->dir_modified >= self->loaded
+       || self->dir_modified != zsys_file_modified (self->path))
+        return s_dir_load (self, patches, root);
+
+    zfile_t *file = (zfile_t *) zlist_first (self->files);
+    while (file) {
+        s_dir_restat_file (file, patches, root);
+        file = (zfile_t *) zlist_next (self->files);
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Update directory signatures from its files and subdirectories
+
+static void
+s_dir_sum (zdir_t *self)
+{
+    self->modified = 0;
+    self->cursize = 0;
+    self->count = 0;
     zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
     while (subdir) {
         if (self->modified < subdir->modified)
@@ -213,10 +334,206 @@ zdir_new (const char *path, const char *parent)
         self->count += 1;
         file = (zfile_t *) zlist_next (self->files);
     }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Refresh a whole tree in this thread, or just update its signatures
+//  after the tree was refreshed by worker threads
+
+static void
+s_dir_refresh_tree (zdir_t *self)
+{
+    s_dir_refresh (self, NULL, NULL);
+    zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
+    while (subdir) {
+        s_dir_refresh_tree (subdir);
+        subdir = (zdir_t *) zlist_next (self->subdirs);
+    }
+    s_dir_sum (self);
+}
+
+static void
+s_dir_sum_tree (zdir_t *self)
+{
+    zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
+    while (subdir) {
+        s_dir_sum_tree (subdir);
+        subdir = (zdir_t *) zlist_next (self->subdirs);
+    }
+    s_dir_sum (self);
+}
+
+//  Add a patch for every file in a tree
+
+static void
+s_dir_patch_tree (zdir_t *self, zdir_patch_op_t op, zlist_t *patches, const char *root)
+{
+    if (!patches)
+        return;
+    zfile_t *file = (zfile_t *) zlist_first (self->files);
+    while (file) {
+        s_dir_patch (file, op, patches, root);
+        file = (zfile_t *) zlist_next (self->files);
+    }
+    zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
+    while (subdir) {
+        s_dir_patch_tree (subdir, op, patches, root);
+        subdir = (zdir_t *) zlist_next (self->subdirs);
+    }
+}
+
+
+#if defined (__UNIX__)
+//  --------------------------------------------------------------------------
+//  Parallel tree walk. Worker threads take directories off a shared stack,
+//  refresh them, and push their subdirectories back onto the stack, until
+//  the stack is empty and no worker is busy. Each directory is refreshed
+//  by exactly one thread, and only that thread touches it until the walk
+//  is over.
+
+typedef struct {
+    pthread_mutex_t mutex;      //  Protects the rest of this structure
+    pthread_cond_t wakeup;      //  Signals new work, or end of walk
+    zlist_t *pending;           //  Directories waiting to be refreshed
+    size_t busy;                //  Workers refreshing a directory
+} s_walk_t;
+
+static void *
+s_walk_worker (void *args)
+{
+    s_walk_t *walk = (s_walk_t *) args;
+    pthread_mutex_lock (&walk->mutex);
+    while (true) {
+        zdir_t *dir = (zdir_t *) zlist_pop (walk->pending);
+        if (!dir) {
+            if (walk->busy == 0)
+                break;          //  Nothing left to do, anywhere
+            pthread_cond_wait (&walk->wakeup, &walk->mutex);
+            continue;
+        }
+        walk->busy++;
+        pthread_mutex_unlock (&walk->mutex);
+        s_dir_refresh (dir, NULL, NULL);
+        pthread_mutex_lock (&walk->mutex);
+        walk->busy--;
+        zdir_t *subdir = (zdir_t *) zlist_first (dir->subdirs);
+        while (subdir) {
+            int rc = zlist_push (walk->pending, subdir);
+            assert (rc == 0);
+            subdir = (zdir_t *) zlist_next (dir->subdirs);
+        }
+        pthread_cond_broadcast (&walk->wakeup);
+    }
+    pthread_mutex_unlock (&walk->mutex);
+    return NULL;
+}
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Refresh the whole tree from disk, using as many threads as the tree
+//  asks for. Returns 0 if OK, -1 if the top directory could not be read.
+
+static int
+s_dir_walk (zdir_t *self)
+{
+    int rc = s_dir_refresh (self, NULL, NULL);
+#if defined (__UNIX__)
+    if (self->threads > 1 && zlist_size (self->subdirs)) {
+        s_walk_t walk;
+        pthread_mutex_init (&walk.mutex, NULL);
+        pthread_cond_init (&walk.wakeup, NULL);
+        walk.pending = zlist_new ();
+        assert (walk.pending);
+        walk.busy = 0;
+        zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
+        while (subdir) {
+            zlist_append (walk.pending, subdir);
+            subdir = (zdir_t *) zlist_next (self->subdirs);
+        }
+        //  This thread works too, so we start one less than asked for
+        size_t workers = self->threads - 1;
+        pthread_t *threads = (pthread_t *) zmalloc (sizeof (pthread_t) * workers);
+        size_t started;
+        for (started = 0; threads && started < workers; started++)
+            if (pthread_create (&threads [started], NULL, s_walk_worker, &walk))
+                break;
+        s_walk_worker (&walk);
+        while (started)
+            pthread_join (threads [--started], NULL);
+        free (threads);
+
+        zlist_destroy (&walk.pending);
+        pthread_cond_destroy (&walk.wakeup);
+        pthread_mutex_destroy (&walk.mutex);
+        s_dir_sum_tree (self);
+        return rc;
+    }
+#endif
+    zdir_t *subdir = (zdir_t *) zlist_first (self->subdirs);
+    while (subdir) {
+        s_dir_refresh_tree (subdir);
+        subdir = (zdir_t *) zlist_next (self->subdirs);
+    }
+    s_dir_sum (self);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new directory item that loads in the full tree of the specified
+//  path, optionally located under some parent path. If parent is "-", then
+//  loads only the top-level directory (and does not use parent as a path).
+
+zdir_t *
+zdir_new (const char *path, const char *parent)
+{
+    return zdir_new_parallel (path, parent, 1);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new directory item like zdir_new, loading subdirectories in
+//  parallel over the specified number of threads. If threads is zero, uses
+//  one thread per CPU core. On platforms without POSIX threads, loads the
+//  tree in the calling thread.
+
+zdir_t *
+zdir_new_parallel (const char *path, const char *parent, size_t threads)
+{
+    zdir_t *self = s_dir_new (path, parent);
+    if (self) {
+#if defined (_SC_NPROCESSORS_ONLN)
+        if (threads == 0)
+            threads = (size_t) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+        self->threads = threads? threads: 1;
+        if (s_dir_walk (self))
+            zdir_destroy (&self);
+    }
     return self;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Bring a directory tree up to date with the disk, reusing what it already
+//  holds. Reads the entries only of directories that were modified since
+//  they were last read, and restats the files in all others, as files can
+//  change without changing their directory. Uses as many threads as the
+//  tree was created with. Returns 0 if OK, or -1 if the directory could no
+//  longer be read, in which case it is now empty.
+
+int
+zdir_refresh (zdir_t *self)
+{
+    assert (self);
+    return s_dir_walk (self);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Destroy a directory item
 
@@ -421,6 +738,22 @@ zdir_remove (zdir_t *self, bool force)
 
 zlist_t *
 zdir_diff (zdir_t *older, zdir_t *newer, const char *alias)
+{
+    return zdir_diff_digest (older, newer, alias, NULL);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Calculate differences between two versions of a directory tree, like
+//  zdir_diff, but do not report files that were touched or rewritten with
+//  the same contents. The digests table holds the SHA-1 digest of each file
+//  in the older tree, as returned by zdir_cache. When a file has the same
+//  size as before, but a new modification time, we calculate its digest,
+//  and compare that to the older digest. Files with no older digest are
+//  reported as by zdir_diff.
+
+zlist_t *
+zdir_diff_digest (zdir_t *older, zdir_t *newer, const char *alias, zhash_t *digests)
 {
     zlist_t *patches = zlist_new ();
     if (!patches)
@@ -473,11 +806,22 @@ zdir_diff (zdir_t *older, zdir_t *newer, const char *alias)
         else
         if (cmp == 0 && zfile_is_stable (new_file)) {
             if (zfile_is_stable (old_file)) {
-                //  Old file was modified or replaced
-                //  Since we don't check file contents, treat as created
-                //  Could better do SHA check on file here
-                if (  zfile_modified (new_file) != zfile_modified (old_file)
-                   || zfile_cursize (new_file) != zfile_cursize (old_file)) {
+                //  Old file was modified or replaced; unless we can tell
+                //  from its digest that its contents are the same, treat
+                //  it as created
+                bool changed =
+                       zfile_modified (new_file) != zfile_modified (old_file)
+                    || zfile_cursize (new_file) != zfile_cursize (old_file);
+                if (  changed
+                   && digests
+                   && zfile_cursize (new_file) == zfile_cursize (old_file)) {
+                    char *old_digest = (char *) zhash_lookup (digests,
+                        zfile_filename (old_file, older->path));
+                    char *new_digest = old_digest? zfile_digest (new_file): NULL;
+                    if (new_digest && streq (old_digest, new_digest))
+                        changed = false;
+                }
+                if (changed) {
                     int rc = zlist_append (patches, zdir_patch_new (newer->path, new_file, patch_create, alias));
                     if (rc != 0) {
                         zlist_destroy (&patches);
@@ -531,10 +875,80 @@ zdir_resync (zdir_t *self, const char *alias)
 }
 
 
+#if defined (__UNIX__)
+//  --------------------------------------------------------------------------
+//  Parallel digest pass. Worker threads take files off a shared array and
+//  calculate their digests; zfile_t caches the digest, so we collect the
+//  results once all workers are done.
+
+typedef struct {
+    pthread_mutex_t mutex;      //  Protects the next index
+    zfile_t **files;            //  Files to digest, null terminated
+    size_t next;                //  Next file to digest
+} s_digest_t;
+
+static void *
+s_digest_worker (void *args)
+{
+    s_digest_t *digest = (s_digest_t *) args;
+    while (true) {
+        pthread_mutex_lock (&digest->mutex);
+        zfile_t *file = digest->files [digest->next];
+        if (file)
+            digest->next++;
+        pthread_mutex_unlock (&digest->mutex);
+        if (!file)
+            break;
+        zfile_digest (file);
+    }
+    return NULL;
+}
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Calculate the digests for a null-terminated array of files, using as
+//  many threads as the tree asks for.
+
+static void
+s_dir_digest (zdir_t *self, zfile_t **files)
+{
+#if defined (__UNIX__)
+    if (self->threads > 1 && files [0] && files [1]) {
+        s_digest_t digest;
+        pthread_mutex_init (&digest.mutex, NULL);
+        digest.files = files;
+        digest.next = 0;
+
+        //  This thread works too, so we start one less than asked for
+        size_t workers = self->threads - 1;
+        pthread_t *threads = (pthread_t *) zmalloc (sizeof (pthread_t) * workers);
+        size_t started;
+        for (started = 0; threads && started < workers; started++)
+            if (pthread_create (&threads [started], NULL, s_digest_worker, &digest))
+                break;
+        s_digest_worker (&digest);
+        while (started)
+            pthread_join (threads [--started], NULL);
+        free (threads);
+        pthread_mutex_destroy (&digest.mutex);
+        return;
+    }
+#endif
+    uint index;
+    for (index = 0; files [index]; index++)
+        zfile_digest (files [index]);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Load directory cache; returns a hash table containing the SHA-1 digests
-//  of every file in the tree. The cache is saved between runs in .cache.
-//  The caller must destroy the hash table when done with it.
+//  of every file in the tree. The cache is saved between runs in .cache,
+//  along with the size and modification time of each file, and a digest
+//  is only recalculated when the file changed. Digests are calculated over
+//  as many threads as the tree was created with. The caller must destroy
+//  the hash table when done with it.
 
 zhash_t *
 zdir_cache (zdir_t *self)
@@ -542,40 +956,73 @@ zdir_cache (zdir_t *self)
     assert (self);
 
     //  Load any previous cache from disk
+    zhash_t *stored = zhash_new ();
     zhash_t *cache = zhash_new ();
-    if (!cache)
-        return NULL;
-    zhash_autofree (cache);
     char *cache_file = (char *) zmalloc (strlen (self->path) + strlen ("/.cache") + 1);
-    if (!cache_file) {
+    zfile_t **files = zdir_flatten (self);
+    zfile_t **stale = (zfile_t **) zmalloc (sizeof (zfile_t *) * (self->count + 1));
+    if (!stored || !cache || !cache_file || !files || !stale) {
+        zhash_destroy (&stored);
         zhash_destroy (&cache);
+        free (cache_file);
+        free (files);
+        free (stale);
         return NULL;
     }
+    zhash_autofree (cache);
     sprintf (cache_file, "%s/.cache", self->path);
-    zhash_load (cache, cache_file);
-
-    //  Recalculate digest for any new files
-    zfile_t **files = zdir_flatten (self);
+    time_t saved = zsys_file_modified (cache_file);
+    zhash_load (stored, cache_file);
+
+    //  Each entry holds the digest, file size, and modified time. Take the
+    //  digest for any file that has not changed; older caches that only
+    //  hold the digest never match, so we recalculate those. We cannot
+    //  trust a modified time at or after the cache was saved, as the file
+    //  may have changed again in the same second.
     uint index;
-    for (index = 0;; index++) {
+    uint stale_count = 0;
+    for (index = 0; files [index]; index++) {
         zfile_t *file = files [index];
-        if (!file)
-            break;
         char *filename = zfile_filename (file, self->path);
-        if (zhash_lookup (cache, zfile_filename (file, self->path)) == NULL) {
-            int rc = zhash_insert (cache, filename, zfile_digest (file));
-            if (rc != 0) {
-                zhash_destroy (&cache);
-                break;
-            }
+        char *entry = (char *) zhash_lookup (stored, filename);
+        char digest [41];
+        long long cursize, modified;
+        if (  entry
+           && sscanf (entry, "%40s %lld %lld", digest, &cursize, &modified) == 3
+           && cursize == (long long) zfile_cursize (file)
+           && modified == (long long) zfile_modified (file)
+           && modified < (long long) saved)
+            zhash_insert (cache, filename, digest);
+        else
+            stale [stale_count++] = file;
+    }
+    //  Recalculate digest for any new or changed files
+    s_dir_digest (self, stale);
+    for (index = 0; index < stale_count; index++) {
+        zfile_t *file = stale [index];
+        char *digest = zfile_digest (file);
+        if (digest)
+            zhash_insert (cache, zfile_filename (file, self->path), digest);
+    }
+    //  Save cache to disk for future reference, dropping deleted files
+    zhash_purge (stored);
+    for (index = 0; files [index]; index++) {
+        zfile_t *file = files [index];
+        char *filename = zfile_filename (file, self->path);
+        char *digest = (char *) zhash_lookup (cache, filename);
+        if (digest) {
+            char *entry = zsys_sprintf ("%s %lld %lld", digest,
+                (long long) zfile_cursize (file), (long long) zfile_modified (file));
+            if (entry)
+                zhash_update (stored, filename, entry);
+            zstr_free (&entry);
         }
     }
-    free (files);
-
-    //  Save cache to disk for future reference
-    if (cache)
-        zhash_save (cache, cache_file);
+    zhash_save (stored, cache_file);
+    zhash_destroy (&stored);
     free (cache_file);
+    free (files);
+    free (stale);
     return cache;
 }
 
@@ -610,9 +1057,376 @@ zdir_print (zdir_t *self, int indent)
 }
 
 
+//  --------------------------------------------------------------------------
+//  The zdir_watch actor keeps a directory tree in memory, and reports files
+//  that are created, changed, or deleted. On Linux it uses inotify, so it
+//  only looks at directories the kernel tells it changed. Elsewhere, or if
+//  inotify is not available, it refreshes the tree at regular intervals.
+
+#define WATCH_TIMEOUT   1000    //  Default polling interval, msecs
+
+typedef struct {
+    zsock_t *pipe;              //  Actor command pipe
+    zpoller_t *poller;          //  Polls pipe, and inotify if we use it
+    char *path;                 //  Directory we were asked to watch
+    zdir_t *dir;                //  Current tree, or NULL if absent
+    int timeout;                //  Polling interval, msecs
+    int inotify;                //  inotify handle, or -1 if polling
+    zhash_t *watches;           //  Directory path for each watch
+    bool terminated;            //  Did caller ask us to quit?
+    bool verbose;               //  Verbose logging enabled?
+} s_watch_t;
+
+static void
+s_watch_stop_inotify (s_watch_t *self)
+{
+    if (self->inotify != -1) {
+        zpoller_remove (self->poller, &self->inotify);
+        close (self->inotify);
+        self->inotify = -1;
+    }
+    zhash_purge (self->watches);
+}
+
+static void
+s_watch_destroy (s_watch_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        s_watch_t *self = *self_p;
+        if (self->poller)
+            s_watch_stop_inotify (self);
+        zpoller_destroy (&self->poller);
+        zhash_destroy (&self->watches);
+        zdir_destroy (&self->dir);
+        free (self->path);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+static int s_watch_refresh_tree (s_watch_t *self, zdir_t *dir, zlist_t *patches);
+
+static s_watch_t *
+s_watch_new (zsock_t *pipe, const char *path)
+{
+    s_watch_t *self = (s_watch_t *) zmalloc (sizeof (s_watch_t));
+    if (!self)
+        return NULL;
+
+    self->pipe = pipe;
+    self->timeout = WATCH_TIMEOUT;
+    self->inotify = -1;
+    self->path = strdup (path);
+    if (self->path)
+        self->watches = zhash_new ();
+    if (self->watches)
+        self->poller = zpoller_new (self->pipe, NULL);
+    if (!self->poller) {
+        s_watch_destroy (&self);
+        return NULL;
+    }
+    zhash_autofree (self->watches);
+#if defined (__UTYPE_LINUX)
+    self->inotify = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (self->inotify != -1)
+        zpoller_add (self->poller, &self->inotify);
+#endif
+    //  Load the tree as it is now; we report changes from here on
+    self->dir = s_dir_new (self->path, NULL);
+    if (self->dir && s_watch_refresh_tree (self, self->dir, NULL))
+        zdir_destroy (&self->dir);
+    if (self->dir)
+        s_dir_sum_tree (self->dir);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Start watching a directory that we have not read yet, so that we hear
+//  about any changes made while we read it. If we cannot, falls back to
+//  polling.
+
+static void
+s_watch_add (s_watch_t *self, zdir_t *dir)
+{
+#if defined (__UTYPE_LINUX)
+    if (self->inotify == -1)
+        return;
+    int wd = inotify_add_watch (self->inotify, dir->path,
+        IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_ATTRIB
+      | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR);
+    if (wd != -1) {
+        char key [16];
+        sprintf (key, "%d", wd);
+        zhash_update (self->watches, key, dir->path);
+    }
+    else
+    if (errno != ENOENT) {
+        //  Most likely we hit the system limit on watches
+        zsys_warning ("zdir_watch: cannot watch %s (%s), polling instead",
+                      dir->path, strerror (errno));
+        s_watch_stop_inotify (self);
+    }
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Refresh a tree, starting to watch any directory we have not read yet.
+//  Returns 0 if OK, -1 if the top directory could not be read.
+
+static int
+s_watch_refresh_tree (s_watch_t *self, zdir_t *dir, zlist_t *patches)
+{
+    const char *root = self->dir? self->dir->path: dir->path;
+    if (dir->loaded == 0)
+        s_watch_add (self, dir);
+    int rc = s_dir_refresh (dir, patches, root);
+    zdir_t *subdir = (zdir_t *) zlist_first (dir->subdirs);
+    while (subdir) {
+        s_watch_refresh_tree (self, subdir, patches);
+        subdir = (zdir_t *) zlist_next (dir->subdirs);
+    }
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send patches to the caller, one message per patch; the caller owns the
+//  patches and must destroy them
+
+static void
+s_watch_send (s_watch_t *self, zlist_t **patches_p)
+{
+    zlist_t *patches = *patches_p;
+    zdir_patch_t *patch;
+    while ((patch = (zdir_patch_t *) zlist_pop (patches))) {
+        if (self->verbose)
+            zsys_info ("zdir_watch: %s %s",
+                       zdir_patch_op (patch) == patch_create? "create": "delete",
+                       zdir_patch_vpath (patch));
+        if (zsock_send (self->pipe, "sp", "PATCH", patch))
+            zdir_patch_destroy (&patch);
+    }
+    zlist_destroy (patches_p);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Refresh the whole tree, reporting all changes. If the tree does not
+//  exist yet, loads it if it has appeared, and reports all its files as
+//  created. If the tree went away, reports all its files as deleted.
+
+static void
+s_watch_poll (s_watch_t *self)
+{
+    zlist_t *patches = zlist_new ();
+    if (!patches)
+        return;
+    if (!self->dir) {
+        self->dir = s_dir_new (self->path, NULL);
+        if (!self->dir) {
+            zlist_destroy (&patches);
+            return;
+        }
+    }
+    if (s_watch_refresh_tree (self, self->dir, patches))
+        zdir_destroy (&self->dir);
+    else
+        s_dir_sum_tree (self->dir);
+    s_watch_send (self, &patches);
+}
+
+
+#if defined (__UTYPE_LINUX)
+//  --------------------------------------------------------------------------
+//  Find the directory item with the specified path, or NULL
+
+static zdir_t *
+s_watch_find (zdir_t *dir, const char *path)
+{
+    while (dir && strneq (dir->path, path)) {
+        size_t length = 0;
+        zdir_t *subdir = (zdir_t *) zlist_first (dir->subdirs);
+        while (subdir) {
+            length = strlen (subdir->path);
+            if (  strncmp (subdir->path, path, length) == 0
+               && (path [length] == '/' || path [length] == 0))
+                break;
+            subdir = (zdir_t *) zlist_next (dir->subdirs);
+        }
+        dir = subdir;
+    }
+    return dir;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handle inotify events. We reread every directory the kernel tells us
+//  changed, and report what changed in them. If the kernel lost events,
+//  we refresh the whole tree instead.
+
+static void
+s_watch_handle_inotify (s_watch_t *self)
+{
+    zhash_t *dirty = zhash_new ();
+    if (!dirty)
+        return;
+    zhash_autofree (dirty);
+    bool overflow = false;
+
+    char buffer [4096]
+        __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    ssize_t size;
+    while ((size = read (self->inotify, buffer, sizeof (buffer))) > 0) {
+        char *event_ptr = buffer;
+        while (event_ptr < buffer + size) {
+            struct inotify_event *event = (struct inotify_event *) event_ptr;
+            event_ptr += sizeof (struct inotify_event) + event->len;
+            char key [16];
+            sprintf (key, "%d", event->wd);
+            if (event->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            else
+            if (event->mask & IN_IGNORED)
+                zhash_delete (self->watches, key);
+            else {
+                char *path = (char *) zhash_lookup (self->watches, key);
+                if (path)
+                    zhash_insert (dirty, path, path);
+            }
+        }
+    }
+    if (!self->dir || overflow)
+        s_watch_poll (self);
+    else {
+        zlist_t *patches = zlist_new ();
+        const char *path = (const char *) zhash_first (dirty);
+        while (path && patches && self->dir) {
+            zdir_t *dir = s_watch_find (self->dir, path);
+            if (dir) {
+                int rc = s_dir_load (dir, patches, self->dir->path);
+                if (rc && dir == self->dir)
+                    zdir_destroy (&self->dir);
+                else {
+                    //  Read and watch any new subdirectories
+                    zdir_t *subdir = (zdir_t *) zlist_first (dir->subdirs);
+                    while (subdir) {
+                        if (subdir->loaded == 0)
+                            s_watch_refresh_tree (self, subdir, patches);
+                        subdir = (zdir_t *) zlist_next (dir->subdirs);
+                    }
+                }
+            }
+            path = (const char *) zhash_next (dirty);
+        }
+        if (self->dir)
+            s_dir_sum_tree (self->dir);
+        if (patches)
+            s_watch_send (self, &patches);
+    }
+    zhash_destroy (&dirty);
+}
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Handle a command from calling application
+
+static int
+s_watch_handle_pipe (s_watch_t *self)
+{
+    //  Get the whole message off the pipe in one go
+    zmsg_t *request = zmsg_recv (self->pipe);
+    if (!request)
+        return -1;                  //  Interrupted
+
+    char *command = zmsg_popstr (request);
+    if (self->verbose)
+        zsys_info ("zdir_watch: API command=%s", command);
+
+    if (streq (command, "TIMEOUT")) {
+        char *timeout = zmsg_popstr (request);
+        if (timeout)
+            self->timeout = atoi (timeout);
+        zstr_free (&timeout);
+    }
+    else
+    if (streq (command, "POLL"))
+        s_watch_stop_inotify (self);
+    else
+    if (streq (command, "VERBOSE"))
+        self->verbose = true;
+    else
+    if (streq (command, "$TERM"))
+        self->terminated = true;
+    else {
+        zsys_error ("zdir_watch: - invalid command: %s", command);
+        assert (false);
+    }
+    zstr_free (&command);
+    zmsg_destroy (&request);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  zdir_watch() implements the zdir_watch actor interface
+
+void
+zdir_watch (zsock_t *pipe, void *args)
+{
+    assert (args);
+    s_watch_t *self = s_watch_new (pipe, (const char *) args);
+    assert (self);
+    //  Signal successful initialization
+    zsock_signal (pipe, 0);
+
+    while (!self->terminated) {
+        //  We poll the disk if we have no inotify, or nothing to watch yet
+        int timeout = self->inotify == -1 || !self->dir? self->timeout: -1;
+        int64_t expiry = zclock_mono () + timeout;
+        void *which = zpoller_wait (self->poller, timeout);
+        if (which == self->pipe)
+            s_watch_handle_pipe (self);
+        else
+#if defined (__UTYPE_LINUX)
+        if (which == &self->inotify)
+            s_watch_handle_inotify (self);
+        else
+#endif
+        if (zpoller_terminated (self->poller))
+            break;          //  Interrupted
+        if (timeout != -1 && zclock_mono () >= expiry)
+            s_watch_poll (self);
+    }
+    s_watch_destroy (&self);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Self test of this class
 
+static void
+s_assert_patch (zactor_t *watch, zdir_patch_op_t op, const char *vpath)
+{
+    //  One change may give several patches, e.g. on create then write
+    while (true) {
+        char *command;
+        zdir_patch_t *patch;
+        int rc = zsock_recv (watch, "sp", &command, &patch);
+        assert (rc == 0);
+        assert (streq (command, "PATCH"));
+        free (command);
+        bool matched = zdir_patch_op (patch) == op
+                    && streq (zdir_patch_vpath (patch), vpath);
+        zdir_patch_destroy (&patch);
+        if (matched)
+            break;
+    }
+}
+
 void
 zdir_test (bool verbose)
 {
@@ -639,6 +1453,211 @@ zdir_test (bool verbose)
 
     zdir_t *nosuch = zdir_new ("does-not-exist", NULL);
     assert (nosuch == NULL);
+
+    //  Create a small test tree, and let its modified times settle
+#   define TESTDIR ".test_zdir"
+    zsys_dir_create (TESTDIR "/alpha/beta");
+    zsys_dir_create (TESTDIR "/gamma");
+    FILE *handle = fopen (TESTDIR "/alpha/one", "w");
+    assert (handle);
+    fprintf (handle, "1");
+    fclose (handle);
+    handle = fopen (TESTDIR "/alpha/beta/two", "w");
+    assert (handle);
+    fprintf (handle, "22");
+    fclose (handle);
+    handle = fopen (TESTDIR "/gamma/three", "w");
+    assert (handle);
+    fprintf (handle, "333");
+    fclose (handle);
+    zclock_sleep (1100);
+
+    //  Loading in parallel gives the same tree as loading serially
+    int rc;
+    zdir_t *tree = zdir_new_parallel (TESTDIR, NULL, 4);
+    assert (tree);
+    assert (zdir_count (tree) == 3);
+    assert (zdir_cursize (tree) == 6);
+    zdir_t *serial = zdir_new (TESTDIR, NULL);
+    assert (serial);
+    assert (zdir_count (serial) == zdir_count (tree));
+    assert (zdir_cursize (serial) == zdir_cursize (tree));
+    assert (zdir_modified (serial) == zdir_modified (tree));
+    patches = zdir_diff (serial, tree, NULL);
+    assert (zlist_size (patches) == 0);
+    zlist_destroy (&patches);
+    zdir_destroy (&serial);
+
+    //  Digests are calculated in parallel, and cached on disk
+    zhash_t *cache = zdir_cache (tree);
+    assert (cache);
+    assert (zhash_size (cache) == 3);
+    zfile_t *file = zfile_new (TESTDIR "/alpha/beta", "two");
+    assert (file);
+    assert (streq ((char *) zhash_lookup (cache, "alpha/beta/two"), zfile_digest (file)));
+    char *old_digest = strdup (zfile_digest (file));
+    zfile_destroy (&file);
+    zhash_destroy (&cache);
+
+    //  Fake a digest in the cache file, to see that it is used as long
+    //  as the file does not change
+    zhash_t *stored = zhash_new ();
+    assert (stored);
+    rc = zhash_load (stored, TESTDIR "/.cache");
+    assert (rc == 0);
+    char *entry = (char *) zhash_lookup (stored, "alpha/one");
+    assert (entry);
+    memset (entry, '0', 40);
+    zhash_save (stored, TESTDIR "/.cache");
+    zhash_destroy (&stored);
+
+    //  Refreshing picks up files changed in place, as well as new and
+    //  deleted files and directories
+    handle = fopen (TESTDIR "/alpha/beta/two", "w");
+    assert (handle);
+    fprintf (handle, "2222");
+    fclose (handle);
+    zsys_file_delete (TESTDIR "/gamma/three");
+    zsys_dir_create (TESTDIR "/gamma/delta");
+    handle = fopen (TESTDIR "/gamma/delta/four", "w");
+    assert (handle);
+    fprintf (handle, "4444");
+    fclose (handle);
+    rc = zdir_refresh (tree);
+    assert (rc == 0);
+    assert (zdir_count (tree) == 3);
+    assert (zdir_cursize (tree) == 9);
+
+    //  The cache has digests for changed and new files only
+    cache = zdir_cache (tree);
+    assert (cache);
+    assert (zhash_size (cache) == 3);
+    assert (streq ((char *) zhash_lookup (cache, "alpha/one"),
+                   "0000000000000000000000000000000000000000"));
+    assert (strneq ((char *) zhash_lookup (cache, "alpha/beta/two"), old_digest));
+    assert (zhash_lookup (cache, "gamma/delta/four"));
+    free (old_digest);
+    zhash_destroy (&cache);
+    serial = zdir_new (TESTDIR, NULL);
+    assert (serial);
+    patches = zdir_diff (serial, tree, NULL);
+    assert (zlist_size (patches) == 0);
+    zlist_destroy (&patches);
+    zdir_destroy (&serial);
+
+    //  A cached digest is not used if the file's modified time is not
+    //  older than the cache, as the file may have changed unseen
+    struct utimbuf times;
+    times.actime = times.modtime = time (NULL) + 100;
+    rc = utime (TESTDIR "/gamma/delta/four", &times);
+    assert (rc == 0);
+    serial = zdir_new (TESTDIR, NULL);
+    assert (serial);
+    cache = zdir_cache (serial);
+    assert (cache);
+    zhash_destroy (&cache);
+    stored = zhash_new ();
+    assert (stored);
+    rc = zhash_load (stored, TESTDIR "/.cache");
+    assert (rc == 0);
+    entry = (char *) zhash_lookup (stored, "gamma/delta/four");
+    assert (entry);
+    memset (entry, '0', 40);
+    zhash_save (stored, TESTDIR "/.cache");
+    zhash_destroy (&stored);
+    cache = zdir_cache (serial);
+    assert (cache);
+    assert (strneq ((char *) zhash_lookup (cache, "gamma/delta/four"),
+                    "0000000000000000000000000000000000000000"));
+    zhash_destroy (&cache);
+    zdir_destroy (&serial);
+
+    //  A digest-aware diff ignores files that were touched, but whose
+    //  contents did not change
+    times.actime = times.modtime = time (NULL) - 100;
+    rc = utime (TESTDIR "/alpha/beta/two", &times);
+    assert (rc == 0);
+    older = zdir_new (TESTDIR, NULL);
+    assert (older);
+    cache = zdir_cache (older);
+    assert (cache);
+
+    times.actime = times.modtime = time (NULL) - 50;
+    rc = utime (TESTDIR "/alpha/beta/two", &times);
+    assert (rc == 0);
+    newer = zdir_new (TESTDIR, NULL);
+    assert (newer);
+    patches = zdir_diff (older, newer, "/");
+    assert (zlist_size (patches) == 1);
+    zdir_patch_t *patch = (zdir_patch_t *) zlist_pop (patches);
+    zdir_patch_destroy (&patch);
+    zlist_destroy (&patches);
+    patches = zdir_diff_digest (older, newer, "/", cache);
+    assert (zlist_size (patches) == 0);
+    zlist_destroy (&patches);
+    zdir_destroy (&newer);
+
+    //  Though it still reports files whose contents changed
+    handle = fopen (TESTDIR "/alpha/beta/two", "w");
+    assert (handle);
+    fprintf (handle, "2223");
+    fclose (handle);
+    rc = utime (TESTDIR "/alpha/beta/two", &times);
+    assert (rc == 0);
+    newer = zdir_new (TESTDIR, NULL);
+    assert (newer);
+    patches = zdir_diff_digest (older, newer, "/", cache);
+    assert (zlist_size (patches) == 1);
+    patch = (zdir_patch_t *) zlist_pop (patches);
+    assert (streq (zdir_patch_vpath (patch), "/alpha/beta/two"));
+    zdir_patch_destroy (&patch);
+    zlist_destroy (&patches);
+    zdir_destroy (&newer);
+    zdir_destroy (&older);
+    zhash_destroy (&cache);
+
+    //  Delete all test files
+    zsys_file_delete (TESTDIR "/.cache");
+    zdir_remove (tree, true);
+    zdir_destroy (&tree);
+    assert (!zsys_file_exists (TESTDIR));
+
+    //  Watch a directory, and get changes as they happen
+    zsys_dir_create (TESTDIR);
+    zactor_t *watch = zactor_new (zdir_watch, TESTDIR);
+    assert (watch);
+    if (verbose)
+        zstr_send (watch, "VERBOSE");
+    zsock_set_rcvtimeo (watch, 5000);
+
+    handle = fopen (TESTDIR "/new", "w");
+    assert (handle);
+    fprintf (handle, "new");
+    fclose (handle);
+    s_assert_patch (watch, patch_create, "/new");
+
+    zsys_dir_create (TESTDIR "/sub");
+    handle = fopen (TESTDIR "/sub/deep", "w");
+    assert (handle);
+    fclose (handle);
+    s_assert_patch (watch, patch_create, "/sub/deep");
+
+    zsys_file_delete (TESTDIR "/new");
+    s_assert_patch (watch, patch_delete, "/new");
+
+    //  Polling finds the same changes, only later
+    zstr_send (watch, "POLL");
+    zstr_sendx (watch, "TIMEOUT", "100", NULL);
+    handle = fopen (TESTDIR "/polled", "w");
+    assert (handle);
+    fclose (handle);
+    s_assert_patch (watch, patch_create, "/polled");
+    zactor_destroy (&watch);
+
+    tree = zdir_new (TESTDIR, NULL);
+    assert (tree);
+    zdir_remove (tree, true);
+    zdir_destroy (&tree);
     //  @end
 
     printf ("OK\n");
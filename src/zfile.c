@@ -41,6 +41,7 @@ struct _zfile_t {
     bool exists;            //  true if file exists
     bool stable;            //  true if file is stable
     bool eof;               //  true if at end of file
+    bool streaming;         //  true if reads bypass page cache
     FILE *handle;           //  Read/write handle
     zdigest_t *digest;      //  File digest, if known
 
@@ -137,6 +138,7 @@ zfile_dup (zfile_t *self)
             copy->cursize = self->cursize;
             copy->link = self->link ? strdup (self->link) : NULL;
             copy->mode = self->mode;
+            copy->streaming = self->streaming;
         }
         else
             zfile_destroy (&copy);
@@ -169,12 +171,14 @@ zfile_filename (zfile_t *self, const char *path)
 //  --------------------------------------------------------------------------
 //  Refresh file properties from disk; this is not done automatically
 //  on access methods, otherwise it is not possible to compare directory
-//  snapshots.
+//  snapshots. If the file changed, forgets any digest calculated for it.
 
 void
 zfile_restat (zfile_t *self)
 {
     assert (self);
+    time_t modified = self->modified;
+    off_t cursize = self->cursize;
     struct stat stat_buf;
     char *real_name = self->link ? self->link : self->fullname;
     if (stat (real_name, &stat_buf) == 0) {
@@ -189,6 +193,9 @@ zfile_restat (zfile_t *self)
         self->mode = 0;
         self->stable = false;
     }
+    //  Any digest we calculated is no longer valid if the file changed
+    if (self->modified != modified || self->cursize != cursize)
+        zdigest_destroy (&self->digest);
 }
 
 
@@ -329,6 +336,10 @@ zfile_input (zfile_t *self)
     char *real_name = self->link ? self->link : self->fullname;
     self->handle = fopen (real_name, "rb");
     if (self->handle) {
+#if defined (POSIX_FADV_SEQUENTIAL)
+        if (self->streaming)
+            posix_fadvise (fileno (self->handle), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
         struct stat stat_buf;
         if (stat (real_name, &stat_buf) == 0)
             self->cursize = stat_buf.st_size;
@@ -378,7 +389,11 @@ zfile_output (zfile_t *self)
 
 //  --------------------------------------------------------------------------
 //  Read chunk from file at specified position. If this was the last chunk,
-//  sets self->eof. Returns a null chunk in case of error.
+//  sets self->eof. Returns a null chunk in case of error. Reads and writes
+//  do not move a shared file position, so several threads can work on
+//  different ranges of one open file at the same time. The eof flag is
+//  then meaningless, as every read sets it; each thread knows it read the
+//  last chunk when the chunk is shorter than it asked for.
 
 zchunk_t *
 zfile_read (zfile_t *self, size_t bytes, off_t offset)
@@ -392,12 +407,63 @@ zfile_read (zfile_t *self, size_t bytes, off_t offset)
     if (bytes > (size_t) (self->cursize - offset))
         bytes = (size_t) (self->cursize - offset);
 
+#if defined (__UNIX__)
+    zchunk_t *chunk = zchunk_new (NULL, bytes);
+    if (!chunk)
+        return NULL;
+    int handle = fileno (self->handle);
+    size_t size = 0;
+    while (size < bytes) {
+        ssize_t rc = pread (handle, zchunk_data (chunk) + size,
+                            bytes - size, offset + (off_t) size);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1) {
+            zchunk_destroy (&chunk);
+            return NULL;
+        }
+        if (rc == 0)
+            break;              //  File got shorter since we looked
+        size += rc;
+    }
+    zchunk_set (chunk, NULL, size);
+#   if defined (POSIX_FADV_DONTNEED)
+    if (self->streaming && size)
+        posix_fadvise (handle, offset, (off_t) size, POSIX_FADV_DONTNEED);
+#   endif
+#else
     int rc = fseek (self->handle, (long) offset, SEEK_SET);
     if (rc == -1)
         return NULL;
+    zchunk_t *chunk = zchunk_read (self->handle, bytes);
+    if (!chunk)
+        return NULL;
+#endif
+    self->eof = zchunk_size (chunk) < bytes;
+    return chunk;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Map chunk from file at specified position, without reading it. Works
+//  like zfile_read, except the chunk is read-only and shares the file's
+//  pages; see zchunk_map. Send it with zchunk_packx to transmit file data
+//  without copying it. Returns a null chunk in case of error.
+
+zchunk_t *
+zfile_map (zfile_t *self, size_t bytes, off_t offset)
+{
+    assert (self);
+    assert (self->handle);
+    //  Calculate real number of bytes to map
+    if (offset > self->cursize)
+        bytes = 0;
+    else
+    if (bytes > (size_t) (self->cursize - offset))
+        bytes = (size_t) (self->cursize - offset);
 
     self->eof = false;
-    zchunk_t *chunk = zchunk_read (self->handle, bytes);
+    zchunk_t *chunk = zchunk_map (self->handle, bytes, offset);
     if (chunk)
         self->eof = zchunk_size (chunk) < bytes;
     return chunk;
@@ -413,10 +479,46 @@ zfile_write (zfile_t *self, zchunk_t *chunk, off_t offset)
 {
     assert (self);
     assert (self->handle);
+#if defined (__UNIX__)
+    int handle = fileno (self->handle);
+    byte *data = zchunk_data (chunk);
+    size_t size = zchunk_size (chunk);
+    while (size) {
+        ssize_t rc = pwrite (handle, data, size, offset);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1)
+            return -1;
+        data += rc;
+        size -= rc;
+        offset += rc;
+    }
+    return 0;
+#else
     int rc = fseek (self->handle, (long) offset, SEEK_SET);
     if (rc >= 0)
         rc = zchunk_write (chunk, self->handle);
     return rc;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set or clear streaming mode. In streaming mode, the file tells the
+//  kernel that it will be read sequentially, and drops each range it reads
+//  from the page cache afterwards, so reading a very large file once does
+//  not flush everything else out of memory. Off by default.
+
+void
+zfile_set_streaming (zfile_t *self, bool streaming)
+{
+    assert (self);
+    self->streaming = streaming;
+#if defined (POSIX_FADV_SEQUENTIAL)
+    if (self->handle)
+        posix_fadvise (fileno (self->handle), 0, 0,
+                       streaming? POSIX_FADV_SEQUENTIAL: POSIX_FADV_NORMAL);
+#endif
 }
 
 
@@ -457,22 +559,31 @@ zfile_digest (zfile_t *self)
         if (zfile_input (self) == -1)
             return NULL;            //  Problem reading file
 
-        //  Now calculate hash for file data, chunk by chunk
-        size_t blocksz = 65535;
+        //  Now calculate hash for file data, reading a block at a time. We
+        //  don't map the file, as another process may truncate it while we
+        //  hash, and touching mapped pages past the end would kill us. If
+        //  a read fails, we give up rather than hash part of the file.
+        size_t blocksz = 1024 * 1024;
         off_t offset = 0;
 
         self->digest = zdigest_new ();
         if (!self->digest)
             return NULL;
-        zchunk_t *chunk = zfile_read (self, blocksz, offset);
-        while (zchunk_size (chunk)) {
-            zdigest_update (self->digest,
-                            zchunk_data (chunk), zchunk_size (chunk));
+        while (true) {
+            zchunk_t *chunk = zfile_read (self, blocksz, offset);
+            if (!chunk) {
+                zdigest_destroy (&self->digest);
+                zfile_close (self);
+                return NULL;
+            }
+            size_t size = zchunk_size (chunk);
+            if (size)
+                zdigest_update (self->digest, zchunk_data (chunk), size);
             zchunk_destroy (&chunk);
-            offset += blocksz;
-            chunk = zfile_read (self, blocksz, offset);
+            if (size < blocksz)
+                break;
+            offset += size;
         }
-        zchunk_destroy (&chunk);
         zfile_close (self);
     }
     return zdigest_string (self->digest);
@@ -586,8 +697,58 @@ zfile_test (bool verbose)
     assert (chunk);
     assert (zchunk_size (chunk) == 13);
     zchunk_destroy (&chunk);
+
+    //  Check we can map the file, at any offset, and send it without
+    //  copying the mapped data
+    chunk = zfile_map (file, 1000100, 7);
+    assert (chunk);
+    assert (zchunk_size (chunk) == 6);
+    assert (memcmp (zchunk_data (chunk), "World\n", 6) == 0);
+    byte *data = zchunk_data (chunk);
+    zframe_t *frame = zchunk_packx (&chunk);
+    assert (frame);
+    assert (zframe_data (frame) == data);
+    assert (zframe_size (frame) == 6);
+    zframe_destroy (&frame);
+    chunk = zfile_map (file, 10, 13);
+    assert (chunk);
+    assert (zchunk_size (chunk) == 0);
+    zchunk_destroy (&chunk);
     zfile_close (file);
 
+    //  Check positional reads and writes, including beyond 4GB where
+    //  off_t allows it; the file is sparse so this costs no disk space
+    zfile_t *large = zfile_new ("./this/is/a/test", "frodo");
+    assert (large);
+    rc = zfile_output (large);
+    assert (rc == 0);
+    off_t far_offset = sizeof (off_t) > 4? (off_t) 1 << 32: 1000000;
+    chunk = zchunk_new ("far away", 8);
+    rc = zfile_write (large, chunk, far_offset);
+    assert (rc == 0);
+    zchunk_destroy (&chunk);
+    chunk = zchunk_new ("near", 4);
+    rc = zfile_write (large, chunk, 0);
+    assert (rc == 0);
+    zchunk_destroy (&chunk);
+    zfile_close (large);
+    assert (zfile_cursize (large) == far_offset + 8);
+
+    zfile_set_streaming (large, true);
+    rc = zfile_input (large);
+    assert (rc == 0);
+    chunk = zfile_read (large, 100, far_offset + 4);
+    assert (chunk);
+    assert (zchunk_size (chunk) == 4);
+    assert (memcmp (zchunk_data (chunk), "away", 4) == 0);
+    zchunk_destroy (&chunk);
+    chunk = zfile_read (large, 4, 0);
+    assert (chunk);
+    assert (memcmp (zchunk_data (chunk), "near", 4) == 0);
+    zchunk_destroy (&chunk);
+    zfile_remove (large);
+    zfile_destroy (&large);
+
     //  Try some fun with symbolic links
     zfile_t *link = zfile_new ("./this/is/a/test", "bilbo.ln");
     assert (link);
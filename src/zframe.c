@@ -22,6 +22,14 @@
     the same frame many times. Frames are binary, and this class has no
     special support for text data.
 @discuss
+    To send large buffers without copying them, use zframe_new_zero_copy,
+    which wraps a buffer you own, and tells you when libzmq has finished
+    with it. Such frames go through zmsg and zframe_send like any other.
+
+    To send the same data to many sockets, use zframe_share to make as
+    many frames as you need. They all refer to the same data, which is
+    released when the last of them has been sent, or destroyed. Shared
+    data must be treated as read-only.
 @end
 */
 
@@ -76,6 +84,36 @@ zframe_new_empty (void)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Constructor; creates a frame that refers to an existing buffer, without
+//  copying it. When the frame, or the message libzmq sent from it, is done
+//  with the buffer, calls free_fn with the data and arg, if free_fn is not
+//  null. The callback may run in a libzmq I/O thread. Until then, the
+//  caller must not change or release the buffer.
+
+zframe_t *
+zframe_new_zero_copy (void *data, size_t size, zframe_free_fn *free_fn, void *arg)
+{
+    zframe_t *self = (zframe_t *) zmalloc (sizeof (zframe_t));
+    if (self) {
+        self->tag = ZFRAME_TAG;
+        if (size) {
+            if (zmq_msg_init_data (&self->zmsg, data, size, free_fn, arg)) {
+                free (self);
+                self = NULL;
+            }
+        }
+        else {
+            zmq_msg_init (&self->zmsg);
+            //  libzmq holds no reference to an empty buffer
+            if (free_fn)
+                (free_fn) (data, arg);
+        }
+    }
+    return self;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Destructor
 
@@ -195,6 +233,32 @@ zframe_dup (zframe_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Create a new frame that shares the data of an existing frame, without
+//  copying it. The data is reference counted, and released when the last
+//  frame that shares it has been sent, or destroyed. Frames that share
+//  data must not modify it. If frame is null, or memory was exhausted,
+//  returns null.
+
+zframe_t *
+zframe_share (zframe_t *self)
+{
+    if (self) {
+        assert (zframe_is (self));
+        zframe_t *copy = zframe_new_empty ();
+        if (copy) {
+            if (zmq_msg_copy (&copy->zmsg, &self->zmsg))
+                zframe_destroy (&copy);
+            else
+                copy->more = self->more;
+        }
+        return copy;
+    }
+    else
+        return NULL;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return frame data encoded as printable hex string, useful for 0MQ UUIDs.
 //  Caller must free string when finished with it.
@@ -440,6 +504,13 @@ zframe_fprint (zframe_t *self, const char *prefix, FILE *file)
 //  --------------------------------------------------------------------------
 //  Selftest
 
+static void
+s_test_free (void *data, void *arg)
+{
+    free (data);
+    (*(int *) arg)++;
+}
+
 void
 zframe_test (bool verbose)
 {
@@ -512,6 +583,48 @@ zframe_test (bool verbose)
     }
     assert (frame_nbr == 10);
 
+    //  Send a buffer without copying it; libzmq tells us when it's done
+    byte *buffer = (byte *) malloc (1000);
+    assert (buffer);
+    memset (buffer, 'x', 1000);
+    int released = 0;
+    frame = zframe_new_zero_copy (buffer, 1000, s_test_free, &released);
+    assert (frame);
+    assert (zframe_data (frame) == buffer);
+    rc = zframe_send (&frame, output, 0);
+    assert (rc == 0);
+    frame = zframe_recv (input);
+    assert (frame);
+    assert (zframe_size (frame) == 1000);
+    assert (zframe_data (frame) [999] == 'x');
+    assert (released == 0);
+    zframe_destroy (&frame);
+    assert (released == 1);
+
+    //  Fan out one buffer to many sockets; it's released after the last
+    //  send is done with it
+    buffer = (byte *) malloc (1000);
+    assert (buffer);
+    released = 0;
+    frame = zframe_new_zero_copy (buffer, 1000, s_test_free, &released);
+    assert (frame);
+    for (frame_nbr = 0; frame_nbr < 3; frame_nbr++) {
+        zframe_t *shared = zframe_share (frame);
+        assert (shared);
+        assert (zframe_data (shared) == buffer);
+        rc = zframe_send (&shared, output, 0);
+        assert (rc == 0);
+    }
+    zframe_destroy (&frame);
+    assert (released == 0);
+    for (frame_nbr = 0; frame_nbr < 3; frame_nbr++) {
+        frame = zframe_recv (input);
+        assert (frame);
+        assert (zframe_data (frame) == buffer);
+        zframe_destroy (&frame);
+    }
+    assert (released == 1);
+
     zsock_destroy (&input);
     zsock_destroy (&output);
 
@@ -24,11 +24,29 @@
     size when 75% full. In case of hash collisions items are chained in a
     linked list. The hash table size is increased slightly (up to 5 times
     before roughly doubling the size) when an overly long chain (between 1
-    and 63 items depending on table size) is detected.
+    and 63 items depending on table size) is detected. Every item keeps
+    the full hash of its key, so lookups only compare keys whose hashes
+    match, and growing the table never hashes keys again.
+
+    Growing a large table in one go can take milliseconds. If you call
+    zhash_set_incremental, the table instead keeps its old and new bucket
+    arrays side by side while growing, and each following call moves a few
+    old buckets across, so the cost of a resize is spread evenly over many
+    calls. Lookups made between zhash_first and the end of an iteration do
+    not move buckets, so iteration still sees every item exactly once.
+
+    A table created with zhash_new_compact uses open addressing instead.
+    Items are stored inline in a power-of-two table and collisions are
+    resolved by Robin Hood linear probing. Each slot has a 32-bit hash
+    fingerprint kept in a separate array, so probes scan a dense array and
+    only compare keys when fingerprints match. Inserts and deletes do not
+    allocate memory per item, and the table doubles when 85% full. All the
+    zhash methods work the same way on both kinds of table.
 @end
 */
 
 #include "../include/czmq.h"
+#include "zslab.h"
 
 //  Hash table performance parameters
 
@@ -37,6 +55,12 @@
 #define LOAD_FACTOR     75    //  Percent loading before splitting
 #define INITIAL_CHAIN    1    //  Initial chaining limit
 #define CHAIN_GROWS      1    //  Increase after splitting (chaining limit)
+#define MIGRATE_BUCKETS  8    //  Old buckets moved per call, if incremental
+
+//  Open addressing performance parameters
+
+#define COMPACT_INITIAL 16    //  Initial size in slots (power of two)
+#define COMPACT_LOAD    85    //  Percent loading before doubling
 
 #include "zhash_primes.inc"
 
@@ -46,7 +70,7 @@
 typedef struct _item_t {
     void *value;                //  Opaque item value
     struct _item_t *next;       //  Next item in the hash slot
-    qbyte index;                //  Index of item in table
+    size_t hash;                //  Full hash of item's key
     const void *key;            //  Item's original key
     //  Supporting deprecated v2 functionality; we can't quite replace
     //  this with strdup/zstr_free as zhash_insert also uses autofree.
@@ -62,10 +86,20 @@ struct _zhash_t {
     uint prime_index;           //  Current prime number used as limit
     uint chain_limit;           //  Current limit on chain length
     item_t **items;             //  Array of items
-    size_t cached_index;        //  Avoids duplicate hash calculations
+    size_t cached_hash;         //  Avoids duplicate hash calculations
     size_t cursor_index;        //  For first/next iteration
     item_t *cursor_item;        //  For first/next iteration
     const void *cursor_key;     //  After first/next call, points to key
+    bool iterating;             //  Between zhash_first and end of table,
+                                //  or until a lookup moves the cursor
+    //  Incremental resizing; while old_items is set, buckets below
+    //  migrate_index have been moved to items, and the rest have not
+    bool incremental;           //  Resize incrementally?
+    item_t **old_items;         //  Array of items being migrated
+    size_t old_limit;           //  Size of old_items array
+    size_t migrate_index;       //  Next old bucket to migrate
+    zslab_t *pool;              //  Item pool, created on first use
+    size_t reserved;            //  Items to keep room for, set by reserve
     zlist_t *comments;          //  File comments, if any
     time_t modified;            //  Set during zhash_load
     char *filename;             //  Set during zhash_load
@@ -78,25 +112,73 @@ struct _zhash_t {
     czmq_comparator *key_comparator;
     //  Custom hash function
     zhash_hash_fn *hasher;
+    //  Open addressing engine; if slots is set, items is not used
+    uint32_t *fingerprints;     //  Mixed hash per slot, zero if empty
+    item_t *slots;              //  Items stored inline, in probe order
+    size_t slot_limit;          //  Number of slots, always a power of two
+    uint slot_shift;            //  Gives home slot from a fingerprint
 };
 
 //  Local helper functions
 static item_t *s_item_lookup (zhash_t *self, const void *key);
+static item_t **s_bucket (zhash_t *self, size_t key_hash);
 static item_t *s_item_insert (zhash_t *self, const void *key, void *value);
 static void s_item_destroy (zhash_t *self, item_t *item, bool hard);
+static item_t *s_item_from (zhash_t *self, size_t *index_p);
+static item_t *s_item_next (zhash_t *self, item_t *item, size_t *index_p);
+static int s_compact_resize (zhash_t *self, size_t new_limit);
+static void s_compact_remove (zhash_t *self, size_t index);
 
 
 //  --------------------------------------------------------------------------
-//  Modified Bernstein hashing function
+//  Default string hashing function. This follows the xxHash64 design for
+//  short inputs: we find the length first, then mix the key a 64-bit word
+//  at a time, finishing with any tail bytes and a final avalanche. It is
+//  much faster than a byte-at-a-time hash on 32-64 byte identity keys.
+
+#define HASH_PRIME1  PORTABLE_LLU (0x9E3779B185EBCA87)
+#define HASH_PRIME2  PORTABLE_LLU (0xC2B2AE3D27D4EB4F)
+#define HASH_PRIME3  PORTABLE_LLU (0x165667B19E3779F9)
+#define HASH_PRIME4  PORTABLE_LLU (0x85EBCA77C2B2AE63)
+#define HASH_PRIME5  PORTABLE_LLU (0x27D4EB2F165667C5)
+#define HASH_ROTATE(value,bits) (((value) << (bits)) | ((value) >> (64 - (bits))))
 
 static size_t
-s_bernstein_hash (const void *key)
+s_string_hash (const void *key)
 {
-    const char *pointer = (const char *) key;
-    size_t key_hash = 0;
-    while (*pointer)
-        key_hash = 33 * key_hash ^ *pointer++;
-    return key_hash;
+    const byte *data = (const byte *) key;
+    size_t length = strlen ((const char *) key);
+    uint64_t key_hash = HASH_PRIME5 + length;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy (&word, data, 8);
+        word *= HASH_PRIME2;
+        word = HASH_ROTATE (word, 31) * HASH_PRIME1;
+        key_hash ^= word;
+        key_hash = HASH_ROTATE (key_hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+        data += 8;
+        length -= 8;
+    }
+    if (length >= 4) {
+        uint32_t word;
+        memcpy (&word, data, 4);
+        key_hash ^= (uint64_t) word * HASH_PRIME1;
+        key_hash = HASH_ROTATE (key_hash, 23) * HASH_PRIME2 + HASH_PRIME3;
+        data += 4;
+        length -= 4;
+    }
+    while (length) {
+        key_hash ^= *data++ * HASH_PRIME5;
+        key_hash = HASH_ROTATE (key_hash, 11) * HASH_PRIME1;
+        length--;
+    }
+    key_hash ^= key_hash >> 33;
+    key_hash *= HASH_PRIME2;
+    key_hash ^= key_hash >> 29;
+    key_hash *= HASH_PRIME3;
+    key_hash ^= key_hash >> 32;
+    return (size_t) key_hash;
 }
 
 
@@ -113,7 +195,7 @@ zhash_new (void)
         size_t limit = primes [self->prime_index];
         self->items = (item_t **) zmalloc (sizeof (item_t *) * limit);
         if (self->items) {
-            self->hasher = s_bernstein_hash;
+            self->hasher = s_string_hash;
             self->key_destructor = (czmq_destructor *) zstr_free;
             self->key_duplicator = (czmq_duplicator *) strdup;
             self->key_comparator = (czmq_comparator *) strcmp;
@@ -125,25 +207,80 @@ zhash_new (void)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Create a new, empty hash container that uses open addressing rather
+//  than chained buckets. Items are stored inline, so inserts and deletes
+//  do not allocate memory per item. Apart from the constructor, you use
+//  the table exactly as one created with zhash_new.
+
+zhash_t *
+zhash_new_compact (void)
+{
+    zhash_t *self = (zhash_t *) zmalloc (sizeof (zhash_t));
+    if (self) {
+        if (s_compact_resize (self, COMPACT_INITIAL) == 0) {
+            self->hasher = s_string_hash;
+            self->key_destructor = (czmq_destructor *) zstr_free;
+            self->key_duplicator = (czmq_duplicator *) strdup;
+            self->key_comparator = (czmq_comparator *) strcmp;
+        }
+        else
+            zhash_destroy (&self);
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Call value and key destructors on an item that is leaving the table
+
+static void
+s_item_release (zhash_t *self, item_t *item)
+{
+    if (self->destructor)
+        (self->destructor)(&item->value);
+    else
+    if (item->free_fn)
+        (item->free_fn)(item->value);
+
+    //  If we're iterating past this item, carry on with the next one
+    if (self->cursor_item == item)
+        self->cursor_item = self->slots? NULL: item->next;
+    self->cursor_key = NULL;
+
+    if (self->key_destructor)
+        (self->key_destructor)((void **) &item->key);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Purge all items from a hash table
 
 static void
 s_purge (zhash_t *self)
 {
-    uint index;
-    size_t limit = primes [self->prime_index];
-
-    for (index = 0; index < limit; index++) {
-        //  Destroy all items in this hash bucket
-        item_t *cur_item = self->items [index];
-        while (cur_item) {
-            item_t *next_item = cur_item->next;
-            s_item_destroy (self, cur_item, true);
-            cur_item = next_item;
-        }
-        self->items [index] = NULL;
+    if (self->slots) {
+        size_t index;
+        for (index = 0; index < self->slot_limit; index++)
+            if (self->fingerprints [index])
+                s_item_release (self, &self->slots [index]);
+
+        memset (self->fingerprints, 0, sizeof (uint32_t) * self->slot_limit);
+        memset (self->slots, 0, sizeof (item_t) * self->slot_limit);
+        self->size = 0;
+        return;
     }
+    //  Destroy all items in both bucket arrays, if we're migrating
+    size_t index = 0;
+    item_t *item = s_item_from (self, &index);
+    while (item) {
+        item_t *next_item = s_item_next (self, item, &index);
+        s_item_destroy (self, item, true);
+        item = next_item;
+    }
+    free (self->old_items);
+    self->old_items = NULL;
 }
 
 //  --------------------------------------------------------------------------
@@ -155,11 +292,13 @@ zhash_destroy (zhash_t **self_p)
     assert (self_p);
     if (*self_p) {
         zhash_t *self = *self_p;
-        if (self->items) {
+        if (self->items || self->slots) {
             s_purge (self);
             free (self->items);
+            free (self->fingerprints);
+            free (self->slots);
         }
-
+        zslab_destroy (&self->pool);
         zlist_destroy (&self->comments);
         free (self->filename);
         free (self);
@@ -175,9 +314,16 @@ zhash_destroy (zhash_t **self_p)
 static void
 s_item_destroy (zhash_t *self, item_t *item, bool hard)
 {
+    if (self->slots) {
+        if (hard)
+            s_item_release (self, item);
+        s_compact_remove (self, (size_t) (item - self->slots));
+        self->size--;
+        return;
+    }
     //  Find previous item since it's a singly-linked list
-    item_t *cur_item = self->items [item->index];
-    item_t **prev_item = &(self->items [item->index]);
+    item_t **prev_item = s_bucket (self, item->hash);
+    item_t *cur_item = *prev_item;
     while (cur_item) {
         if (cur_item == item)
             break;
@@ -188,24 +334,285 @@ s_item_destroy (zhash_t *self, item_t *item, bool hard)
     *prev_item = item->next;
     self->size--;
     if (hard) {
-        if (self->destructor)
-            (self->destructor)(&item->value);
-        else
-        if (item->free_fn)
-            (item->free_fn)(item->value);
+        s_item_release (self, item);
+        zslab_free (self->pool, item);
+    }
+}
 
-        self->cursor_item = NULL;
-        self->cursor_key = NULL;
 
-        if (self->key_destructor)
-            (self->key_destructor)((void **) &item->key);
-        free (item);
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Mix a key hash into a non-zero 32-bit fingerprint for the open addressing
+//  engine. The top bits select the home slot, so keys whose hashes differ
+//  only in their high bits still spread over the table.
+
+static uint32_t
+s_fingerprint (size_t key_hash)
+{
+    uint64_t mixed = (uint64_t) key_hash;
+    mixed ^= mixed >> 32;
+    mixed *= PORTABLE_LLU (0x9E3779B97F4A7C15);
+    return (uint32_t) (mixed >> 32) | 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Look for key in open addressing table, returns item or NULL. Probing
+//  stops as soon as we reach an item closer to its home slot than the key
+//  would be, since Robin Hood insertion guarantees the key isn't further.
+
+static item_t *
+s_compact_lookup (zhash_t *self, const void *key, uint32_t fingerprint)
+{
+    size_t mask = self->slot_limit - 1;
+    size_t index = fingerprint >> self->slot_shift;
+    size_t distance = 0;
+    while (self->fingerprints [index]) {
+        uint32_t current = self->fingerprints [index];
+        if (((index - (current >> self->slot_shift)) & mask) < distance)
+            break;
+        if (current == fingerprint
+        &&  (self->key_comparator)(self->slots [index].key, key) == 0)
+            return &self->slots [index];
+        index = (index + 1) & mask;
+        distance++;
+    }
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Store item in open addressing table, taking slots from items that are
+//  closer to their home slot. Key must not already be present, and there
+//  must be at least one free slot. Returns the item's slot.
+
+static item_t *
+s_compact_place (zhash_t *self, uint32_t fingerprint, item_t item)
+{
+    size_t mask = self->slot_limit - 1;
+    size_t index = fingerprint >> self->slot_shift;
+    size_t distance = 0;
+    item_t *placed = NULL;
+    while (self->fingerprints [index]) {
+        uint32_t current = self->fingerprints [index];
+        size_t current_distance = (index - (current >> self->slot_shift)) & mask;
+        if (current_distance < distance) {
+            //  Swap with the richer item and carry that one forwards
+            item_t displaced = self->slots [index];
+            self->slots [index] = item;
+            self->fingerprints [index] = fingerprint;
+            if (!placed)
+                placed = &self->slots [index];
+            item = displaced;
+            fingerprint = current;
+            distance = current_distance;
+        }
+        index = (index + 1) & mask;
+        distance++;
     }
+    self->slots [index] = item;
+    self->fingerprints [index] = fingerprint;
+    return placed? placed: &self->slots [index];
 }
 
 
 //  --------------------------------------------------------------------------
-//  Rehash hash table with specified new prime index
+//  Local helper function
+//  Empty the specified slot and shift following items back towards their
+//  home slots, so that lookups never need tombstones.
+
+static void
+s_compact_remove (zhash_t *self, size_t index)
+{
+    size_t mask = self->slot_limit - 1;
+    size_t next = (index + 1) & mask;
+    while (self->fingerprints [next]
+    &&    (self->fingerprints [next] >> self->slot_shift) != next) {
+        self->fingerprints [index] = self->fingerprints [next];
+        self->slots [index] = self->slots [next];
+        index = next;
+        next = (next + 1) & mask;
+    }
+    self->fingerprints [index] = 0;
+    memset (&self->slots [index], 0, sizeof (item_t));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Resize open addressing table to new limit, which must be a power of two
+//  and large enough for all items. Items are moved using their stored
+//  fingerprints, so keys are neither hashed nor compared.
+//  Returns 0 on success, or -1 on failure (insufficient memory)
+
+static int
+s_compact_resize (zhash_t *self, size_t new_limit)
+{
+    assert (new_limit <= ((size_t) 1 << 31));
+    uint32_t *fingerprints = (uint32_t *) zmalloc (sizeof (uint32_t) * new_limit);
+    item_t *slots = (item_t *) zmalloc (sizeof (item_t) * new_limit);
+    if (!fingerprints || !slots) {
+        free (fingerprints);
+        free (slots);
+        return -1;
+    }
+    uint32_t *old_fingerprints = self->fingerprints;
+    item_t *old_slots = self->slots;
+    size_t old_limit = self->slot_limit;
+
+    self->fingerprints = fingerprints;
+    self->slots = slots;
+    self->slot_limit = new_limit;
+    self->slot_shift = 32;
+    while (new_limit > 1) {
+        self->slot_shift--;
+        new_limit >>= 1;
+    }
+    size_t index;
+    for (index = 0; index < old_limit; index++)
+        if (old_fingerprints [index])
+            s_compact_place (self, old_fingerprints [index], old_slots [index]);
+
+    free (old_fingerprints);
+    free (old_slots);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Insert new item into open addressing table, returns item. If item
+//  already existed, or memory ran out, returns NULL.
+
+static item_t *
+s_compact_insert (zhash_t *self, const void *key, void *value)
+{
+    size_t key_hash = self->hasher (key);
+    uint32_t fingerprint = s_fingerprint (key_hash);
+    if (s_compact_lookup (self, key, fingerprint))
+        return NULL;            //  Signal duplicate insertion
+
+    //  If we're exceeding the load factor, double the table
+    if ((self->size + 1) * 100 > self->slot_limit * COMPACT_LOAD
+    &&  s_compact_resize (self, self->slot_limit * 2))
+        return NULL;
+
+    item_t item;
+    memset (&item, 0, sizeof (item_t));
+    item.hash = key_hash;
+    //  If necessary, take duplicate of item key
+    if (self->key_duplicator)
+        item.key = (self->key_duplicator)((void *) key);
+    else
+        item.key = key;
+
+    //  If necessary, take duplicate of item value
+    if (self->duplicator)
+        item.value = (self->duplicator)(value);
+    else
+        item.value = value;
+
+    item_t *placed = s_compact_place (self, fingerprint, item);
+    self->size++;
+    self->cursor_key = placed->key;
+    return placed;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return first item in the bucket or slot at *index_p or beyond, updating
+//  *index_p, or NULL if there are no more items.
+
+static item_t *
+s_item_from (zhash_t *self, size_t *index_p)
+{
+    if (self->slots) {
+        for (; *index_p < self->slot_limit; (*index_p)++)
+            if (self->fingerprints [*index_p])
+                return &self->slots [*index_p];
+    }
+    else {
+        //  Old buckets, if any, follow on from the new ones
+        size_t limit = primes [self->prime_index];
+        for (; *index_p < limit; (*index_p)++)
+            if (self->items [*index_p])
+                return self->items [*index_p];
+        if (self->old_items)
+            for (; *index_p < limit + self->old_limit; (*index_p)++)
+                if (self->old_items [*index_p - limit])
+                    return self->old_items [*index_p - limit];
+    }
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return item following the specified one, or NULL if it was the last.
+//  Together with s_item_from this walks all items of either kind of table.
+
+static item_t *
+s_item_next (zhash_t *self, item_t *item, size_t *index_p)
+{
+    if (!self->slots && item->next)
+        return item->next;
+    (*index_p)++;
+    return s_item_from (self, index_p);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return the bucket that holds, or would hold, items with the specified
+//  hash. While the table is migrating, that is the old bucket until it has
+//  been moved across, and the new bucket after that.
+
+static item_t **
+s_bucket (zhash_t *self, size_t key_hash)
+{
+    if (self->old_items) {
+        size_t old_index = key_hash % self->old_limit;
+        if (old_index >= self->migrate_index)
+            return &self->old_items [old_index];
+    }
+    return &self->items [key_hash % primes [self->prime_index]];
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Move up to the specified number of old buckets into the new bucket
+//  array, and drop the old array once it is empty.
+
+static void
+s_zhash_migrate (zhash_t *self, size_t buckets)
+{
+    size_t limit = primes [self->prime_index];
+    while (self->old_items && buckets--) {
+        item_t *cur_item = self->old_items [self->migrate_index];
+        while (cur_item) {
+            item_t *next_item = cur_item->next;
+            size_t new_index = cur_item->hash % limit;
+            cur_item->next = self->items [new_index];
+            self->items [new_index] = cur_item;
+            cur_item = next_item;
+        }
+        self->old_items [self->migrate_index++] = NULL;
+        if (self->migrate_index == self->old_limit) {
+            free (self->old_items);
+            self->old_items = NULL;
+        }
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Rehash hash table with specified new prime index. If the table is
+//  incremental, this only sets up the new bucket array and later calls
+//  move the items across.
 //  Returns 0 on success, or -1 on failure (insufficient memory)
 
 static int
@@ -214,22 +621,31 @@ s_zhash_rehash (zhash_t *self, uint new_prime_index)
     assert (self);
     assert (new_prime_index < sizeof (primes));
 
+    //  Finish any migration in progress before starting a new one
+    s_zhash_migrate (self, SIZE_MAX);
+
     size_t limit = primes [self->prime_index];
     size_t new_limit = primes [new_prime_index];
     item_t **new_items = (item_t **) zmalloc (sizeof (item_t *) * new_limit);
     if (!new_items)
         return -1;
 
-    //  Move all items to the new hash table, rehashing to
-    //  take into account new hash table limit
+    if (self->incremental) {
+        self->old_items = self->items;
+        self->old_limit = limit;
+        self->migrate_index = 0;
+        self->items = new_items;
+        self->prime_index = new_prime_index;
+        return 0;
+    }
+    //  Move all items to the new hash table, using their stored
+    //  hashes to take into account new hash table limit
     size_t index;
     for (index = 0; index < limit; index++) {
         item_t *cur_item = self->items [index];
         while (cur_item) {
             item_t *next_item = cur_item->next;
-            size_t new_index = self->hasher (cur_item->key);
-            new_index %= new_limit;
-            cur_item->index = new_index;
+            size_t new_index = cur_item->hash % new_limit;
             cur_item->next = new_items [new_index];
             new_items [new_index] = cur_item;
             cur_item = next_item;
@@ -255,6 +671,10 @@ zhash_insert (zhash_t *self, const void *key, void *value)
     assert (self);
     assert (key);
 
+    self->iterating = false;
+    if (self->slots)
+        return s_compact_insert (self, key, value) ? 0 : -1;
+
     //  If we're exceeding the load factor of the hash table,
     //  resize it according to the growth factor
     size_t limit = primes [self->prime_index];
@@ -279,10 +699,12 @@ static item_t *
 s_item_insert (zhash_t *self, const void *key, void *value)
 {
     //  Check that item does not already exist in hash table
-    //  Leaves self->cached_index with calculated hash item
+    //  Leaves self->cached_hash with calculated hash of key
     item_t *item = s_item_lookup (self, key);
     if (item == NULL) {
-        item = (item_t *) zmalloc (sizeof (item_t));
+        if (!self->pool)
+            self->pool = zslab_new (sizeof (item_t));
+        item = self->pool ? (item_t *) zslab_alloc (self->pool) : NULL;
         if (!item)
             return NULL;
 
@@ -298,11 +720,12 @@ s_item_insert (zhash_t *self, const void *key, void *value)
         else
             item->value = value;
 
-        item->index = self->cached_index;
+        item->hash = self->cached_hash;
 
         //  Insert into start of bucket list
-        item->next = self->items [self->cached_index];
-        self->items [self->cached_index] = item;
+        item_t **bucket = s_bucket (self, item->hash);
+        item->next = *bucket;
+        *bucket = item;
         self->size++;
         self->cursor_item = item;
         self->cursor_key = item->key;
@@ -321,24 +744,33 @@ s_item_insert (zhash_t *self, const void *key, void *value)
 static item_t *
 s_item_lookup (zhash_t *self, const void *key)
 {
-    //  Look in bucket list for item by key
-    size_t limit = primes [self->prime_index];
-    self->cached_index = self->hasher (key) % limit;
-    item_t *item = self->items [self->cached_index];
+    if (self->slots)
+        return s_compact_lookup (self, key, s_fingerprint (self->hasher (key)));
+
+    //  Move a few buckets along if we're migrating, unless the caller is
+    //  iterating, as moving items would upset the iteration order
+    if (self->old_items && !self->iterating)
+        s_zhash_migrate (self, MIGRATE_BUCKETS);
+
+    //  Look in bucket list for item by key; we only compare keys when
+    //  their full hashes match. Items with the same full hash can never
+    //  be split by rehashing, so they don't count towards the chain limit.
+    self->cached_hash = self->hasher (key);
+    item_t *item = *s_bucket (self, self->cached_hash);
     uint len = 0;
     while (item) {
+        if (item->hash != self->cached_hash)
+            ++len;
+        else
         if ((self->key_comparator)(item->key, key) == 0)
             break;
         item = item->next;
-        ++len;
     }
-    if (len > self->chain_limit) {
+    if (len > self->chain_limit && !self->old_items && !self->iterating) {
         //  Create new hash table
         uint new_prime_index = self->prime_index + GROWTH_FACTOR;
         if (s_zhash_rehash (self, new_prime_index))
             return NULL;
-        limit = primes [self->prime_index];
-        self->cached_index = self->hasher (key) % limit;
     }
     return item;
 }
@@ -357,6 +789,7 @@ zhash_update (zhash_t *self, const void *key, void *value)
     assert (self);
     assert (key);
 
+    self->iterating = false;
     item_t *item = s_item_lookup (self, key);
     if (item) {
         if (self->destructor)
@@ -386,31 +819,73 @@ zhash_delete (zhash_t *self, const void *key)
     assert (self);
     assert (key);
 
+    //  Deleting the item we just visited is safe while iterating, so long
+    //  as the lookup does not move any other items
     item_t *item = s_item_lookup (self, key);
     if (item)
         s_item_destroy (self, item, true);
 }
 
 
+//  --------------------------------------------------------------------------
+//  Local helpers for sizing tables. Return the number of slots, starting
+//  from limit, that a compact table needs to hold size items; or grow the
+//  bucket array in the same steps that inserts would, until it holds size
+//  items without splitting.
+
+static size_t
+s_compact_limit (size_t limit, size_t size)
+{
+    while (size * 100 > limit * COMPACT_LOAD)
+        limit *= 2;
+    return limit;
+}
+
+static void
+s_chained_limit (size_t size, uint *prime_index, uint *chain_limit)
+{
+    uint prime_limit = sizeof (primes) / sizeof (primes [0]) - GROWTH_FACTOR;
+    while (*prime_index < prime_limit
+    &&     size > primes [*prime_index] * LOAD_FACTOR / 100) {
+        *prime_index += GROWTH_FACTOR;
+        *chain_limit += CHAIN_GROWS;
+    }
+}
+
+
 //  --------------------------------------------------------------------------
 //  Delete all items from the hash table. If the key destructor is
 //  set, calls it on every key. If the item destructor is set, calls
-//  it on every item.
+//  it on every item. The table shrinks back to its initial size, or to
+//  the size asked for by zhash_reserve.
 void
 zhash_purge (zhash_t *self)
 {
     assert (self);
+    self->iterating = false;
     s_purge (self);
-
-    if (self->prime_index > INITIAL_PRIME) {
+    if (self->pool)
+        zslab_trim (self->pool);
+
+    if (self->slots) {
+        //  Table is empty, so this can only fail for lack of memory
+        size_t limit = s_compact_limit (COMPACT_INITIAL, self->reserved);
+        if (self->slot_limit > limit)
+            s_compact_resize (self, limit);
+        return;
+    }
+    uint prime_index = INITIAL_PRIME;
+    uint chain_limit = INITIAL_CHAIN;
+    s_chained_limit (self->reserved, &prime_index, &chain_limit);
+    if (self->prime_index > prime_index) {
         // Try to shrink hash table
-        size_t limit = primes [INITIAL_PRIME];
+        size_t limit = primes [prime_index];
         item_t **items =
             (item_t **) zmalloc (sizeof (item_t *) * limit);
         if (items) {
             free (self->items);
-            self->prime_index = INITIAL_PRIME;
-            self->chain_limit = INITIAL_CHAIN;
+            self->prime_index = prime_index;
+            self->chain_limit = chain_limit;
             self->items = items;
         }
     }
@@ -427,6 +902,8 @@ zhash_lookup (zhash_t *self, const void *key)
     assert (self);
     assert (key);
 
+    //  A lookup moves the cursor, which ends any iteration
+    self->iterating = false;
     item_t *item = s_item_lookup (self, key);
     if (item) {
         self->cursor_item = item;
@@ -446,8 +923,28 @@ zhash_lookup (zhash_t *self, const void *key)
 int
 zhash_rename (zhash_t *self, const void *old_key, const void *new_key)
 {
+    self->iterating = false;
     item_t *old_item = s_item_lookup (self, old_key);
     item_t *new_item = s_item_lookup (self, new_key);
+    if (old_item && !new_item && self->slots) {
+        //  Take item out of its slot, and place it again under new key
+        item_t item = *old_item;
+        s_item_destroy (self, old_item, false);
+        if (self->key_destructor)
+            (self->key_destructor)((void **) &item.key);
+
+        if (self->key_duplicator)
+            item.key = (self->key_duplicator)(new_key);
+        else
+            item.key = new_key;
+
+        item.hash = self->hasher (item.key);
+        new_item = s_compact_place (self, s_fingerprint (item.hash), item);
+        self->size++;
+        self->cursor_key = new_item->key;
+        return 0;
+    }
+    else
     if (old_item && !new_item) {
         s_item_destroy (self, old_item, false);
         if (self->key_destructor)
@@ -458,9 +955,10 @@ zhash_rename (zhash_t *self, const void *old_key, const void *new_key)
         else
             old_item->key = new_key;
 
-        old_item->index = self->cached_index;
-        old_item->next = self->items [self->cached_index];
-        self->items [self->cached_index] = old_item;
+        old_item->hash = self->cached_hash;
+        item_t **bucket = s_bucket (self, old_item->hash);
+        old_item->next = *bucket;
+        *bucket = old_item;
         self->size++;
         self->cursor_item = old_item;
         self->cursor_key = old_item->key;
@@ -505,6 +1003,83 @@ zhash_size (zhash_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Size the slot or bucket array and the item pool for the specified
+//  number of items. If keep is true, the pool keeps that space when the
+//  table is purged; otherwise purging may give it back to the heap.
+
+static int
+s_zhash_grow (zhash_t *self, size_t size, bool keep)
+{
+    if (self->slots) {
+        size_t limit = s_compact_limit (self->slot_limit, size);
+        if (limit > self->slot_limit)
+            return s_compact_resize (self, limit);
+        else
+            return 0;
+    }
+    uint prime_index = self->prime_index;
+    uint chain_limit = self->chain_limit;
+    s_chained_limit (size, &prime_index, &chain_limit);
+    if (prime_index > self->prime_index) {
+        if (s_zhash_rehash (self, prime_index))
+            return -1;
+        self->chain_limit = chain_limit;
+    }
+    if (!self->pool)
+        self->pool = zslab_new (sizeof (item_t));
+    if (!self->pool)
+        return -1;
+    if (size > self->size)
+        return keep? zslab_reserve (self->pool, size - self->size)
+                   : zslab_grow (self->pool, size - self->size);
+    else
+        return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Make sure the table can grow to hold the specified number of items
+//  without allocating any more heap memory, so long as you don't copy
+//  keys and values. Sizes the bucket or slot array up front; in a chained
+//  table, items come from a pool that belongs to the table, and deleted
+//  items go back to the pool for reuse. The reserved space is kept until
+//  the table is destroyed, also when it is purged. Returns 0 if OK, -1 if
+//  the process ran out of heap memory.
+
+int
+zhash_reserve (zhash_t *self, size_t size)
+{
+    assert (self);
+    self->reserved = size;
+    return s_zhash_grow (self, size, true);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Report item pool statistics: the number of items the table has allocated
+//  from the heap, and how many of those are free for reuse. A table created
+//  with zhash_new_compact reports its slots instead. Either pointer may be
+//  NULL.
+
+void
+zhash_pool_stats (zhash_t *self, size_t *allocated, size_t *available)
+{
+    assert (self);
+    if (self->slots) {
+        if (allocated)
+            *allocated = self->slot_limit;
+        if (available)
+            *available = self->slot_limit - self->size;
+        return;
+    }
+    if (allocated)
+        *allocated = self->pool ? zslab_capacity (self->pool) : 0;
+    if (available)
+        *available = self->pool ? zslab_available (self->pool) : 0;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return a zlist_t containing the keys for the items in the
 //  table. Uses the key_duplicator to duplicate all keys and sets the
@@ -520,17 +1095,14 @@ zhash_keys (zhash_t *self)
     zlist_set_destructor (keys, self->key_destructor);
     zlist_set_duplicator (keys, self->key_duplicator);
 
-    uint index;
-    size_t limit = primes [self->prime_index];
-    for (index = 0; index < limit; index++) {
-        item_t *item = self->items [index];
-        while (item) {
-            if (zlist_append (keys, (void *) item->key)) {
-                zlist_destroy (&keys);
-                break;
-            }
-            item = item->next;
+    size_t index = 0;
+    item_t *item = s_item_from (self, &index);
+    while (item) {
+        if (zlist_append (keys, (void *) item->key)) {
+            zlist_destroy (&keys);
+            break;
         }
+        item = s_item_next (self, item, &index);
     }
     return keys;
 }
@@ -540,7 +1112,8 @@ zhash_keys (zhash_t *self)
 //  Simple iterator; returns first item in hash table, in no given order,
 //  or NULL if the table is empty. This method is simpler to use than the
 //  foreach() method, which is deprecated. NOTE: do NOT modify the table
-//  while iterating.
+//  while iterating, except that a table made with zhash_new lets you
+//  delete the item just returned.
 
 void *
 zhash_first (zhash_t *self)
@@ -548,7 +1121,9 @@ zhash_first (zhash_t *self)
     assert (self);
     //  Point to before or at first item
     self->cursor_index = 0;
-    self->cursor_item = self->items [self->cursor_index];
+    self->iterating = true;
+    if (!self->slots)
+        self->cursor_item = self->items [self->cursor_index];
     //  Now scan forwards to find it, leave cursor after item
     return zhash_next (self);
 }
@@ -559,22 +1134,33 @@ zhash_first (zhash_t *self)
 //  or NULL if the last item was already returned. Use this together with
 //  zhash_first() to process all items in a hash table. If you need the
 //  items in sorted order, use zhash_keys() and then zlist_sort(). NOTE:
-//  do NOT modify the table while iterating.
+//  do NOT modify the table while iterating, except that a table made with
+//  zhash_new lets you delete the item just returned.
 
 void *
 zhash_next (zhash_t *self)
 {
     assert (self);
-    //  Scan forward from cursor until we find an item
-    size_t limit = primes [self->prime_index];
+    if (self->slots) {
+        //  Cursor index is the next slot to look at
+        item_t *item = s_item_from (self, &self->cursor_index);
+        if (!item) {
+            self->iterating = false;
+            return NULL;        //  At end of table
+        }
+        self->cursor_index++;
+        self->cursor_key = item->key;
+        return item->value;
+    }
+    //  Scan forward from cursor until we find an item, going on into
+    //  the old bucket array if we're migrating
     while (self->cursor_item == NULL) {
-        if (self->cursor_index < limit - 1)
-            self->cursor_index++;
-        else
+        self->cursor_index++;
+        self->cursor_item = s_item_from (self, &self->cursor_index);
+        if (!self->cursor_item) {
+            self->iterating = false;
             return NULL;        //  At end of table
-
-        //  Get first item in next bucket
-        self->cursor_item = self->items [self->cursor_index];
+        }
     }
     //  We have an item, so return it, and bump past it
     assert (self->cursor_item);
@@ -650,14 +1236,11 @@ zhash_save (zhash_t *self, const char *filename)
         }
         fprintf (handle, "\n");
     }
-    uint index;
-    size_t limit = primes [self->prime_index];
-    for (index = 0; index < limit; index++) {
-        item_t *item = self->items [index];
-        while (item) {
-            fprintf (handle, "%s=%s\n", (char *) item->key, (char *) item->value);
-            item = item->next;
-        }
+    size_t index = 0;
+    item_t *item = s_item_from (self, &index);
+    while (item) {
+        fprintf (handle, "%s=%s\n", (char *) item->key, (char *) item->value);
+        item = s_item_next (self, item, &index);
     }
     fclose (handle);
     return 0;
@@ -723,18 +1306,8 @@ zhash_refresh (zhash_t *self)
     if (self->filename) {
         if (  zsys_file_modified (self->filename) > self->modified
            && zsys_file_stable (self->filename)) {
-            //  Empty the hash table; code is copied from zhash_destroy
-            uint index;
-            size_t limit = primes [self->prime_index];
-            for (index = 0; index < limit; index++) {
-                //  Destroy all items in this hash bucket
-                item_t *cur_item = self->items [index];
-                while (cur_item) {
-                    item_t *next_item = cur_item->next;
-                    s_item_destroy (self, cur_item, true);
-                    cur_item = next_item;
-                }
-            }
+            //  Empty the hash table and load it again
+            s_purge (self);
             zhash_load (self, self->filename);
         }
     }
@@ -771,17 +1344,14 @@ zhash_pack (zhash_t *self)
 
     //  First, calculate packed data size
     size_t frame_size = 4;      //  Dictionary size, number-4
-    uint index;
-    size_t limit = primes [self->prime_index];
-    for (index = 0; index < limit; index++) {
-        item_t *item = self->items [index];
-        while (item) {
-            //  We store key as short string
-            frame_size += 1 + strlen ((char *) item->key);
-            //  We store value as long string
-            frame_size += 4 + strlen ((char *) item->value);
-            item = item->next;
-        }
+    size_t index = 0;
+    item_t *item = s_item_from (self, &index);
+    while (item) {
+        //  We store key as short string
+        frame_size += 1 + strlen ((char *) item->key);
+        //  We store value as long string
+        frame_size += 4 + strlen ((char *) item->value);
+        item = s_item_next (self, item, &index);
     }
     //  Now serialize items into the frame
     zframe_t *frame = zframe_new (NULL, frame_size);
@@ -791,21 +1361,20 @@ zhash_pack (zhash_t *self)
     //  Store size as number-4
     *(uint32_t *) needle = htonl ((uint32_t) self->size);
     needle += 4;
-    for (index = 0; index < limit; index++) {
-        item_t *item = self->items [index];
-        while (item) {
-            //  Store key as string
-            *needle++ = (byte) strlen ((char *) item->key);
-            memcpy (needle, item->key, strlen ((char *) item->key));
-            needle += strlen ((char *) item->key);
-
-            //  Store value as longstr
-            *(uint32_t *) needle = htonl (strlen ((char *) item->value));
-            needle += 4;
-            memcpy (needle, (char *) item->value, strlen ((char *) item->value));
-            needle += strlen ((char *) item->value);
-            item = item->next;
-        }
+    index = 0;
+    item = s_item_from (self, &index);
+    while (item) {
+        //  Store key as string
+        *needle++ = (byte) strlen ((char *) item->key);
+        memcpy (needle, item->key, strlen ((char *) item->key));
+        needle += strlen ((char *) item->key);
+
+        //  Store value as longstr
+        *(uint32_t *) needle = htonl (strlen ((char *) item->value));
+        needle += 4;
+        memcpy (needle, (char *) item->value, strlen ((char *) item->value));
+        needle += strlen ((char *) item->value);
+        item = s_item_next (self, item, &index);
     }
     return frame;
 }
@@ -879,21 +1448,22 @@ zhash_dup (zhash_t *self)
     if (!self)
         return NULL;
 
-    zhash_t *copy = zhash_new ();
+    zhash_t *copy = self->slots? zhash_new_compact (): zhash_new ();
     if (copy) {
         copy->destructor = self->destructor;
         copy->duplicator = self->duplicator;
-        uint index;
-        size_t limit = primes [self->prime_index];
-        for (index = 0; index < limit; index++) {
-            item_t *item = self->items [index];
-            while (item) {
-                if (zhash_insert (copy, item->key, item->value)) {
-                    zhash_destroy (&copy);
-                    break;
-                }
-                item = item->next;
+        //  Pre-size the copy without keeping a reservation, so that
+        //  purging it gives the memory back
+        s_zhash_grow (copy, self->size, false);
+        copy->incremental = self->incremental;
+        size_t index = 0;
+        item_t *item = s_item_from (self, &index);
+        while (item) {
+            if (zhash_insert (copy, item->key, item->value)) {
+                zhash_destroy (&copy);
+                break;
             }
+            item = s_item_next (self, item, &index);
         }
     }
     return copy;
@@ -963,7 +1533,7 @@ zhash_set_key_comparator (zhash_t *self, czmq_comparator comparator)
 
 //  --------------------------------------------------------------------------
 //  Set a user-defined hash function for keys; by default keys are
-//  hashed by a modified Bernstein hashing function.
+//  hashed by a fast word-at-a-time string hashing function.
 
 void
 zhash_set_key_hasher (zhash_t *self, zhash_hash_fn hasher)
@@ -973,6 +1543,22 @@ zhash_set_key_hasher (zhash_t *self, zhash_hash_fn hasher)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Set the table to grow incrementally. When it needs more buckets, the
+//  old and new bucket arrays coexist and each following insert, lookup or
+//  delete moves a few buckets across, so no single call pays for the whole
+//  resize. Has no effect on tables created with zhash_new_compact.
+
+void
+zhash_set_incremental (zhash_t *self, bool incremental)
+{
+    assert (self);
+    if (!incremental)
+        s_zhash_migrate (self, SIZE_MAX);
+    self->incremental = incremental;
+}
+
+
 //  --------------------------------------------------------------------------
 //  DEPRECATED by zhash_dup
 //  Make copy of hash table; if supplied table is null, returns null.
@@ -986,20 +1572,17 @@ zhash_dup_v2 (zhash_t *self)
     if (!self)
         return NULL;
 
-    zhash_t *copy = zhash_new ();
+    zhash_t *copy = self->slots? zhash_new_compact (): zhash_new ();
     if (copy) {
         zhash_autofree (copy);
-        uint index;
-        size_t limit = primes [self->prime_index];
-        for (index = 0; index < limit; index++) {
-            item_t *item = self->items [index];
-            while (item) {
-                if (zhash_insert (copy, item->key, item->value)) {
-                    zhash_destroy (&copy);
-                    break;
-                }
-                item = item->next;
+        size_t index = 0;
+        item_t *item = s_item_from (self, &index);
+        while (item) {
+            if (zhash_insert (copy, item->key, item->value)) {
+                zhash_destroy (&copy);
+                break;
             }
+            item = s_item_next (self, item, &index);
         }
     }
     return copy;
@@ -1030,18 +1613,15 @@ zhash_foreach (zhash_t *self, zhash_foreach_fn *callback, void *argument)
 {
     assert (self);
 
-    uint index;
-    size_t limit = primes [self->prime_index];
-    for (index = 0; index < limit; index++) {
-        item_t *item = self->items [index];
-        while (item) {
-            //  Invoke callback, passing item properties and argument
-            item_t *next = item->next;
-            int rc = callback ((const char *) item->key, item->value, argument);
-            if (rc)
-                return rc;      //  End if non-zero return code
-            item = next;
-        }
+    size_t index = 0;
+    item_t *item = s_item_from (self, &index);
+    while (item) {
+        //  Invoke callback, passing item properties and argument
+        item_t *next = s_item_next (self, item, &index);
+        int rc = callback ((const char *) item->key, item->value, argument);
+        if (rc)
+            return rc;          //  End if non-zero return code
+        item = next;
     }
     return 0;
 }
@@ -1051,6 +1631,13 @@ zhash_foreach (zhash_t *self, zhash_foreach_fn *callback, void *argument)
 //  Runs selftest of class
 //
 
+static size_t
+s_test_collide_hash (const void *key)
+{
+    return 42;
+}
+
+
 void
 zhash_test (int verbose)
 {
@@ -1212,6 +1799,175 @@ zhash_test (int verbose)
     assert (streq ((char *) zhash_lookup (hash, "key1"), "This is a string"));
     assert (streq ((char *) zhash_lookup (hash, "key2"), "Ring a ding ding"));
     zhash_destroy (&hash);
+
+    //  Test open addressing table through the same API
+    hash = zhash_new_compact ();
+    assert (hash);
+    zhash_autofree (hash);
+    for (iteration = 0; iteration < 1000; iteration++) {
+        sprintf (value, "%04d", iteration);
+        rc = zhash_insert (hash, value, value);
+        assert (rc == 0);
+        assert (streq ((char *) zhash_cursor (hash), value));
+    }
+    assert (zhash_size (hash) == 1000);
+    rc = zhash_insert (hash, "0500", "foo");
+    assert (rc == -1);
+    assert (streq ((char *) zhash_lookup (hash, "0500"), "0500"));
+    zhash_update (hash, "0500", "five hundred");
+    assert (streq ((char *) zhash_lookup (hash, "0500"), "five hundred"));
+    rc = zhash_rename (hash, "0500", "D00D");
+    assert (rc == 0);
+    assert (zhash_lookup (hash, "0500") == NULL);
+    assert (streq ((char *) zhash_lookup (hash, "D00D"), "five hundred"));
+    rc = zhash_rename (hash, "D00D", "0501");
+    assert (rc == -1);
+    zhash_delete (hash, "D00D");
+    for (iteration = 0; iteration < 1000; iteration += 2) {
+        sprintf (value, "%04d", iteration);
+        zhash_delete (hash, value);
+    }
+    assert (zhash_size (hash) == 500);
+    for (iteration = 1; iteration < 1000; iteration += 2) {
+        sprintf (value, "%04d", iteration);
+        assert (streq ((char *) zhash_lookup (hash, value), value));
+    }
+    //  Iteration visits every item exactly once
+    int visits = 0;
+    item = (char *) zhash_first (hash);
+    while (item) {
+        assert (zhash_lookup (hash, zhash_cursor (hash)) == item);
+        visits++;
+        item = (char *) zhash_next (hash);
+    }
+    assert (visits == 500);
+
+    //  Packed data is the same for both kinds of table
+    frame = zhash_pack (hash);
+    copy = zhash_unpack (frame);
+    zframe_destroy (&frame);
+    assert (zhash_size (copy) == 500);
+    assert (streq ((char *) zhash_lookup (copy, "0999"), "0999"));
+    zhash_destroy (&copy);
+    copy = zhash_dup (hash);
+    assert (zhash_size (copy) == 500);
+    assert (streq ((char *) zhash_lookup (copy, "0001"), "0001"));
+    zhash_destroy (&copy);
+
+    zhash_purge (hash);
+    assert (zhash_size (hash) == 0);
+    assert (zhash_first (hash) == NULL);
+    zhash_destroy (&hash);
+
+    //  Incremental table gives same results while it is migrating
+    hash = zhash_new ();
+    assert (hash);
+    zhash_set_incremental (hash, true);
+    for (iteration = 0; iteration < 5000; iteration++) {
+        sprintf (value, "%04d", iteration);
+        rc = zhash_insert (hash, value, "incremental");
+        assert (rc == 0);
+        if (iteration % 250 == 0) {
+            //  Iteration covers old and new buckets
+            visits = 0;
+            item = (char *) zhash_first (hash);
+            while (item) {
+                visits++;
+                item = (char *) zhash_next (hash);
+            }
+            assert (visits == iteration + 1);
+        }
+    }
+    for (iteration = 0; iteration < 5000; iteration += 3) {
+        sprintf (value, "%04d", iteration);
+        assert (zhash_lookup (hash, value));
+        zhash_delete (hash, value);
+    }
+    assert (zhash_size (hash) == 3333);
+    keys = zhash_keys (hash);
+    assert (zlist_size (keys) == 3333);
+    zlist_destroy (&keys);
+
+    //  Deleting each item as we visit it does not move the others, even
+    //  while the table is migrating
+    for (iteration = 5000; iteration < 6000; iteration++) {
+        sprintf (value, "%04d", iteration);
+        zhash_insert (hash, value, "incremental");
+    }
+    visits = 0;
+    item = (char *) zhash_first (hash);
+    while (item) {
+        zhash_delete (hash, zhash_cursor (hash));
+        visits++;
+        item = (char *) zhash_next (hash);
+    }
+    assert (visits == 4333);
+    assert (zhash_size (hash) == 0);
+    zhash_insert (hash, "4999", "incremental");
+    zhash_set_incremental (hash, false);
+    assert (zhash_lookup (hash, "4999"));
+    zhash_destroy (&hash);
+
+    //  Keys with colliding hashes are still told apart, in both engines
+    int engine;
+    for (engine = 0; engine < 2; engine++) {
+        hash = engine? zhash_new_compact (): zhash_new ();
+        assert (hash);
+        zhash_set_key_hasher (hash, s_test_collide_hash);
+        for (iteration = 0; iteration < 100; iteration++) {
+            sprintf (value, "key-%d", iteration);
+            rc = zhash_insert (hash, value, "collide");
+            assert (rc == 0);
+        }
+        assert (zhash_size (hash) == 100);
+        assert (zhash_lookup (hash, "key-42"));
+        assert (zhash_lookup (hash, "key-100") == NULL);
+        zhash_delete (hash, "key-42");
+        assert (zhash_lookup (hash, "key-42") == NULL);
+        assert (zhash_lookup (hash, "key-43"));
+        zhash_destroy (&hash);
+    }
+
+    //  Churn on a reserved table does not allocate any more items
+    for (engine = 0; engine < 2; engine++) {
+        hash = engine? zhash_new_compact (): zhash_new ();
+        assert (hash);
+        size_t allocated, available;
+        zhash_pool_stats (hash, &allocated, &available);
+        assert (allocated == available);
+        rc = zhash_reserve (hash, 200);
+        assert (rc == 0);
+        zhash_pool_stats (hash, &allocated, &available);
+        assert (allocated >= 200 && available == allocated);
+        int cycle;
+        for (cycle = 0; cycle < 3; cycle++) {
+            for (iteration = 0; iteration < 200; iteration++) {
+                sprintf (value, "key-%d", iteration);
+                rc = zhash_insert (hash, value, "churn");
+                assert (rc == 0);
+            }
+            zhash_pool_stats (hash, NULL, &available);
+            assert (available == allocated - 200);
+            for (iteration = 0; iteration < 200; iteration += 2) {
+                sprintf (value, "key-%d", iteration);
+                zhash_delete (hash, value);
+            }
+            zhash_purge (hash);
+        }
+        zhash_pool_stats (hash, &available, NULL);
+        assert (available == allocated);
+
+        //  A copy is sized for its items, but doesn't keep that space
+        copy = zhash_dup (hash);
+        assert (copy);
+        zhash_pool_stats (copy, &allocated, NULL);
+        assert (allocated >= zhash_size (hash));
+        zhash_purge (copy);
+        zhash_pool_stats (copy, &allocated, NULL);
+        assert (allocated < 200);
+        zhash_destroy (&copy);
+        zhash_destroy (&hash);
+    }
     //  @end
 
     printf ("OK\n");
@@ -24,6 +24,7 @@
 */
 
 #include "../include/czmq.h"
+#include "zslab.h"
 
 //  List node, used internally only
 
@@ -42,12 +43,27 @@ struct _zlist_t {
     node_t *tail;               //  Last item in list, if any
     node_t *cursor;             //  Current cursors for iteration
     size_t size;                //  Number of items in list
+    zslab_t *pool;              //  Node pool, created on first use
     //  Function callbacks for duplicating and destroying items, if any
     czmq_duplicator *duplicator;
     czmq_destructor *destructor;
 };
 
 
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Take a new node from the list's node pool, creating the pool if needed.
+//  Returns NULL if the process ran out of heap memory.
+
+static node_t *
+s_node_new (zlist_t *self)
+{
+    if (!self->pool)
+        self->pool = zslab_new (sizeof (node_t));
+    return self->pool ? (node_t *) zslab_alloc (self->pool) : NULL;
+}
+
+
 //  --------------------------------------------------------------------------
 //  List constructor
 
@@ -69,6 +85,7 @@ zlist_destroy (zlist_t **self_p)
     if (*self_p) {
         zlist_t *self = *self_p;
         zlist_purge (self);
+        zslab_destroy (&self->pool);
         free (self);
         *self_p = NULL;
     }
@@ -177,7 +194,7 @@ zlist_append (zlist_t *self, void *item)
         return -1;
 
     node_t *node;
-    node = (node_t *) zmalloc (sizeof (node_t));
+    node = s_node_new (self);
     if (!node)
         return -1;
 
@@ -209,7 +226,7 @@ int
 zlist_push (zlist_t *self, void *item)
 {
     node_t *node;
-    node = (node_t *) zmalloc (sizeof (node_t));
+    node = s_node_new (self);
     if (!node)
         return -1;
 
@@ -242,7 +259,7 @@ zlist_pop (zlist_t *self)
         self->head = node->next;
         if (self->tail == node)
             self->tail = NULL;
-        free (node);
+        zslab_free (self->pool, node);
         self->size--;
     }
     self->cursor = NULL;
@@ -282,7 +299,7 @@ zlist_remove (zlist_t *self, void *item)
         if (node->free_fn)
             (node->free_fn)(node->item);
 
-        free (node);
+        zslab_free (self->pool, node);
         self->size--;
     }
 }
@@ -304,6 +321,11 @@ zlist_dup (zlist_t *self)
     if (copy) {
         copy->destructor = self->destructor;
         copy->duplicator = self->duplicator;
+        //  Pre-size the pool, but don't keep the source's size as a
+        //  reservation; that would survive purging the copy
+        copy->pool = zslab_new (sizeof (node_t));
+        if (copy->pool)
+            zslab_grow (copy->pool, self->size);
         node_t *node;
         for (node = self->head; node; node = node->next) {
             if (zlist_append (copy, node->item) == -1) {
@@ -332,13 +354,15 @@ zlist_purge (zlist_t *self)
         if (node->free_fn)
             (node->free_fn)(node->item);
 
-        free (node);
+        zslab_free (self->pool, node);
         node = next;
     }
     self->head = NULL;
     self->tail = NULL;
     self->cursor = NULL;
     self->size = 0;
+    if (self->pool)
+        zslab_trim (self->pool);
 }
 
 
@@ -352,6 +376,46 @@ zlist_size (zlist_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Make sure the list can grow to hold the specified number of items
+//  without allocating any more heap memory. List nodes come from a pool
+//  that belongs to the list; nodes freed by pop, remove, and purge go
+//  back to the pool and are reused. The list keeps the reserved space
+//  until it is destroyed; other free nodes stay in the pool until the
+//  list is purged. Returns 0 if OK, -1 if the process
+//  ran out of heap memory.
+
+int
+zlist_reserve (zlist_t *self, size_t size)
+{
+    assert (self);
+    if (!self->pool)
+        self->pool = zslab_new (sizeof (node_t));
+    if (!self->pool)
+        return -1;
+    if (size > self->size)
+        return zslab_reserve (self->pool, size - self->size);
+    else
+        return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Report node pool statistics: the number of nodes the list has allocated
+//  from the heap, and how many of those are free for reuse. Either pointer
+//  may be NULL.
+
+void
+zlist_pool_stats (zlist_t *self, size_t *allocated, size_t *available)
+{
+    assert (self);
+    if (allocated)
+        *allocated = self->pool ? zslab_capacity (self->pool) : 0;
+    if (available)
+        *available = self->pool ? zslab_available (self->pool) : 0;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Sort the list by ascending key value using a straight ASCII comparison.
 //  The sort is not stable, so may reorder items with the same keys.
@@ -569,6 +633,45 @@ zlist_test (int verbose)
     assert (zlist_freefn (list, sub_list, &s_zlist_free, false) == sub_list);
     assert (zlist_freefn (list, sub_list_2, &s_zlist_free, true) == sub_list_2);
 
+    //  Queue churn on a reserved list does not allocate any more nodes
+    zlist_t *queue = zlist_new ();
+    size_t allocated, available;
+    zlist_pool_stats (queue, &allocated, &available);
+    assert (allocated == 0 && available == 0);
+    int rc = zlist_reserve (queue, 100);
+    assert (rc == 0);
+    zlist_pool_stats (queue, &allocated, &available);
+    assert (allocated == 100 && available == 100);
+    int cycle;
+    for (cycle = 0; cycle < 1000; cycle++) {
+        zlist_append (queue, cheese);
+        if (cycle % 3 == 0)
+            zlist_push (queue, wine);
+        if (zlist_size (queue) >= 90) {
+            zlist_remove (queue, wine);
+            zlist_purge (queue);
+        }
+        else
+        if (cycle % 2)
+            zlist_pop (queue);
+    }
+    zlist_pool_stats (queue, &allocated, NULL);
+    assert (allocated == 100);
+    zlist_pool_stats (queue, NULL, &available);
+    assert (available == 100 - zlist_size (queue));
+
+    //  A copy is sized for its items, but doesn't keep that space
+    zlist_append (queue, cheese);
+    zlist_t *copy = zlist_dup (queue);
+    assert (copy);
+    zlist_pool_stats (copy, &allocated, &available);
+    assert (allocated == zlist_size (queue) && available == 0);
+    zlist_purge (copy);
+    zlist_pool_stats (copy, &allocated, NULL);
+    assert (allocated == 0);
+    zlist_destroy (&copy);
+    zlist_destroy (&queue);
+
     //  Destructor should be safe to call twice
     zlist_destroy (&list);
     zlist_destroy (&list);
@@ -19,21 +19,48 @@
     once-off or repeated timers. Its resolution is 1 msec. It uses a tickless
     timer to reduce CPU interrupts in inactive processes.
 @discuss
+    Timers are held in a binary heap ordered by expiry time, and indexed by
+    timer id, so registering and cancelling a timer cost O(log n), and
+    finding the next timer to expire is O(1). A reactor can hold many
+    thousands of timers without scanning them on each poll.
+
+    Ticket timers are cheaper still, for the common case of one expiry
+    timer per client that you reset on every message. All tickets share
+    the same delay, so they stay in expiry order in a simple list, and
+    creating, resetting, and deleting a ticket are O(1) operations.
+
+    By default the reactor rebuilds a zmq_poll set whenever you add or
+    remove a reader or poller, and each pass scans the whole set. For
+    reactors that watch thousands of sockets and file descriptors, call
+    zloop_set_epoll to switch to an epoll backend, where adding and
+    removing items costs O(1) and each pass only looks at the items that
+    are ready. This is only available on Linux.
+
+    Ready readers and pollers take turns: each pass starts after the item
+    that went first last time. A reader normally handles one message per
+    pass; use zloop_reader_set_budget to let a busy reader handle a batch
+    of messages each time, so it does not pay for a poll per message.
 @end
 */
 
 #include "../include/czmq.h"
+#include "zslab.h"
+#include "zpollset.h"
 
 typedef struct _s_reader_t s_reader_t;
 typedef struct _s_poller_t s_poller_t;
 typedef struct _s_timer_t s_timer_t;
+typedef struct _s_ticket_t s_ticket_t;
 
 //  Structure of our class
 
 struct _zloop_t {
     zlist_t *readers;           //  List of socket readers
     zlist_t *pollers;           //  List of poll items
-    zlist_t *timers;            //  List of timers
+    s_timer_t **timers;         //  Heap of timers, soonest first
+    size_t timers_size;         //  Number of timers in heap
+    size_t timers_limit;        //  Allocated size of heap
+    zhash_t *timer_index;       //  Timers, keyed by timer id
     int last_timer_id;          //  Most recent timer id
     size_t poll_size;           //  Size of poll set
     zmq_pollitem_t *pollset;    //  zmq_poll set
@@ -43,19 +70,33 @@ struct _zloop_t {
     bool verbose;               //  True if verbose tracing wanted
     bool terminated;            //  True when stopped running
     zlist_t *zombies;           //  List of timers to kill
+    s_ticket_t *tickets;        //  List of tickets, soonest first
+    s_ticket_t *tickets_tail;   //  Last ticket in list
+    s_ticket_t *dead_tickets;   //  Deleted tickets, to be freed
+    zslab_t *ticket_pool;       //  Pool that tickets come from
+    size_t ticket_delay;        //  Delay (ms) for all tickets
+    size_t poll_start;          //  Where next pass starts handling items
+    zpollset_t *epoll;          //  Epoll backend, if enabled
 };
 
 //  Reactor elements are held as structures of their own
 
+//  Readers and pollers are both tags in the epoll backend, so they start
+//  with a flag that tells them apart
+
 struct _s_reader_t {
+    bool is_reader;             //  Always true
     zsock_t *sock;              //  Socket to read from
     zloop_reader_fn *handler;   //  Function to execute
     void *arg;                  //  Application argument to poll item
     int errors;                 //  If too many errors, kill reader
     bool tolerant;              //  Unless configured as tolerant
+    size_t budget;              //  Most times to call handler per pass
+    size_t budget_usecs;        //  Most time to spend per pass, or 0
 };
 
 struct _s_poller_t {
+    bool is_reader;             //  Always false
     zmq_pollitem_t item;
     zloop_fn *handler;          //  Function to execute
     void *arg;                  //  Application argument to poll item
@@ -70,6 +111,18 @@ struct _s_timer_t {
     size_t times;               //  Number of times to repeat, 0 for forever
     void *arg;                  //  Application argument to timer
     int64_t when;               //  Clock time when alarm goes off
+    size_t heap_index;          //  Position in timer heap
+    s_timer_t *next;            //  Next timer expiring in this pass
+};
+
+struct _s_ticket_t {
+    s_ticket_t *prev;           //  Previous ticket in list
+    s_ticket_t *next;           //  Next ticket in list
+    int64_t when;               //  Clock time when alarm goes off
+    zloop_timer_fn *handler;    //  Function to execute
+    void *arg;                  //  Application argument to ticket
+    bool linked;                //  True while ticket is on ticket list
+    bool deleted;               //  True once ticket has been deleted
 };
 
 static int
@@ -83,14 +136,25 @@ s_reader_new (zsock_t *sock, zloop_reader_fn handler, void *arg)
 {
     s_reader_t *reader = (s_reader_t *) zmalloc (sizeof (s_reader_t));
     if (reader) {
+        reader->is_reader = true;
         reader->sock = sock;
         reader->handler = handler;
         reader->arg = arg;
         reader->tolerant = false;   //  By default, errors are bad
+        reader->budget = 1;         //  By default, one call per pass
     }
     return reader;
 }
 
+//  A reader may also be an object that starts with a file descriptor, like
+//  a zsignal_t or zqueue_t. Return the reader's type name, for logging.
+
+static const char *
+s_reader_type_str (zsock_t *sock)
+{
+    return zsock_resolve (sock)? zsock_type_str (sock): "FD";
+}
+
 static s_poller_t *
 s_poller_new (zmq_pollitem_t *item, zloop_fn handler, void *arg)
 {
@@ -114,24 +178,178 @@ s_timer_new (int timer_id, size_t delay, size_t times, zloop_timer_fn handler, v
         timer->times = times;
         timer->handler = handler;
         timer->arg = arg;
-        timer->when = -1;           //  Indicates a new timer
+        timer->when = zclock_mono () + delay;
     }
     return timer;
 }
 
+//  Timer ids are stored in the timer index as pointers, so we hash and
+//  compare them as integers
+
+static size_t
+s_timer_id_hash (const void *key)
+{
+    return (size_t) (uintptr_t) key;
+}
+
+static int
+s_timer_id_compare (const void *key1, const void *key2)
+{
+    return key1 != key2;
+}
+
+//  Return true if timer1 must expire before timer2; timers that expire at
+//  the same time run in the order they were registered
+
+static bool
+s_timer_before (s_timer_t *timer1, s_timer_t *timer2)
+{
+    return timer1->when < timer2->when
+       || (timer1->when == timer2->when && timer1->timer_id < timer2->timer_id);
+}
+
+//  Store timer at specified position in the heap
+
+static void
+s_timer_place (zloop_t *self, s_timer_t *timer, size_t index)
+{
+    self->timers [index] = timer;
+    timer->heap_index = index;
+}
+
+//  Move timer towards the top of the heap until its parent is due before it
+
+static void
+s_timer_sift_up (zloop_t *self, size_t index)
+{
+    s_timer_t *timer = self->timers [index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!s_timer_before (timer, self->timers [parent]))
+            break;
+        s_timer_place (self, self->timers [parent], index);
+        index = parent;
+    }
+    s_timer_place (self, timer, index);
+}
+
+//  Move timer towards the bottom of the heap until it's due before both
+//  its children
+
+static void
+s_timer_sift_down (zloop_t *self, size_t index)
+{
+    s_timer_t *timer = self->timers [index];
+    while (true) {
+        size_t child = index * 2 + 1;
+        if (child >= self->timers_size)
+            break;
+        if (child + 1 < self->timers_size
+        &&  s_timer_before (self->timers [child + 1], self->timers [child]))
+            child++;
+        if (!s_timer_before (self->timers [child], timer))
+            break;
+        s_timer_place (self, self->timers [child], index);
+        index = child;
+    }
+    s_timer_place (self, timer, index);
+}
+
+//  Add timer to heap, growing the heap if needed. Returns 0 if OK, -1 if
+//  the process ran out of heap memory.
+
+static int
+s_timer_push (zloop_t *self, s_timer_t *timer)
+{
+    if (self->timers_size == self->timers_limit) {
+        size_t limit = self->timers_limit ? self->timers_limit * 2 : 16;
+        s_timer_t **timers = (s_timer_t **) realloc (self->timers,
+                                                     limit * sizeof (s_timer_t *));
+        if (!timers)
+            return -1;
+        self->timers = timers;
+        self->timers_limit = limit;
+    }
+    s_timer_place (self, timer, self->timers_size++);
+    s_timer_sift_up (self, timer->heap_index);
+    return 0;
+}
+
+//  Take timer out of heap, wherever it is in the heap
+
+static void
+s_timer_detach (zloop_t *self, s_timer_t *timer)
+{
+    size_t index = timer->heap_index;
+    assert (self->timers [index] == timer);
+    s_timer_t *last = self->timers [--self->timers_size];
+    if (last != timer) {
+        s_timer_place (self, last, index);
+        if (index > 0 && s_timer_before (last, self->timers [(index - 1) / 2]))
+            s_timer_sift_up (self, index);
+        else
+            s_timer_sift_down (self, index);
+    }
+}
+
 //  Remove timer with specified id, if it exists
 
 static void
 s_timer_remove (zloop_t *self, int timer_id)
 {
-    s_timer_t *timer = (s_timer_t *) zlist_first (self->timers);
-    while (timer) {
-        if (timer->timer_id == timer_id) {
-            zlist_remove (self->timers, timer);
-            free (timer);
-            break;
-        }
-        timer = (s_timer_t *) zlist_next (self->timers);
+    void *key = (void *) (uintptr_t) timer_id;
+    s_timer_t *timer = (s_timer_t *) zhash_lookup (self->timer_index, key);
+    if (timer) {
+        zhash_delete (self->timer_index, key);
+        s_timer_detach (self, timer);
+        free (timer);
+    }
+}
+
+
+//  Append ticket to the end of the ticket list, setting its alarm. As all
+//  tickets have the same delay, this keeps the list in expiry order.
+
+static void
+s_ticket_link (zloop_t *self, s_ticket_t *ticket)
+{
+    ticket->when = zclock_mono () + self->ticket_delay;
+    ticket->prev = self->tickets_tail;
+    ticket->next = NULL;
+    if (self->tickets_tail)
+        self->tickets_tail->next = ticket;
+    else
+        self->tickets = ticket;
+    self->tickets_tail = ticket;
+    ticket->linked = true;
+}
+
+//  Take ticket off the ticket list
+
+static void
+s_ticket_unlink (zloop_t *self, s_ticket_t *ticket)
+{
+    if (ticket->prev)
+        ticket->prev->next = ticket->next;
+    else
+        self->tickets = ticket->next;
+    if (ticket->next)
+        ticket->next->prev = ticket->prev;
+    else
+        self->tickets_tail = ticket->prev;
+    ticket->linked = false;
+}
+
+//  Give deleted tickets back to the pool; there can be no more references
+//  to them from inside the reactor
+
+static void
+s_ticket_reap (zloop_t *self)
+{
+    while (self->dead_tickets) {
+        s_ticket_t *ticket = self->dead_tickets;
+        self->dead_tickets = ticket->next;
+        zslab_free (self->ticket_pool, ticket);
     }
 }
 
@@ -166,7 +384,10 @@ s_rebuild_pollset (zloop_t *self)
     s_reader_t *reader = (s_reader_t *) zlist_first (self->readers);
     uint item_nbr = 0;
     while (reader) {
-        zmq_pollitem_t poll_item = { zsock_resolve (reader->sock), 0, ZMQ_POLLIN };
+        void *socket = zsock_resolve (reader->sock);
+        zmq_pollitem_t poll_item = {
+            socket, socket? 0: *(SOCKET *) reader->sock, ZMQ_POLLIN
+        };
         self->pollset [item_nbr] = poll_item;
         self->readact [item_nbr] = *reader;
         item_nbr++;
@@ -188,15 +409,12 @@ s_tickless_timer (zloop_t *self)
 {
     //  Calculate tickless timer, up to 1 hour
     int64_t tickless = zclock_mono () + 1000 * 3600;
-    s_timer_t *timer = (s_timer_t *) zlist_first (self->timers);
-    while (timer) {
-        //  Find earliest timer
-        if (timer->when == -1)
-            timer->when = timer->delay + zclock_mono ();
-        if (tickless > timer->when)
-            tickless = timer->when;
-        timer = (s_timer_t *) zlist_next (self->timers);
-    }
+    //  Earliest timer is always at the top of the heap
+    if (self->timers_size && tickless > self->timers [0]->when)
+        tickless = self->timers [0]->when;
+    //  Earliest ticket is always at the head of the ticket list
+    if (self->tickets && tickless > self->tickets->when)
+        tickless = self->tickets->when;
     long timeout = (long) (tickless - zclock_mono ());
     if (timeout < 0)
         timeout = 0;
@@ -205,6 +423,104 @@ s_tickless_timer (zloop_t *self)
     return timeout;
 }
 
+//  Register a reader or poller with the epoll backend
+
+static int
+s_epoll_add_reader (zloop_t *self, s_reader_t *reader)
+{
+    if (zsock_resolve (reader->sock) == NULL)
+        return zpollset_add (self->epoll, NULL, *(SOCKET *) reader->sock,
+                             ZMQ_POLLIN, reader);
+    else
+        return zpollset_add (self->epoll, reader->sock, 0, ZMQ_POLLIN, reader);
+}
+
+static int
+s_epoll_add_poller (zloop_t *self, s_poller_t *poller)
+{
+    return zpollset_add (self->epoll, poller->item.socket, poller->item.fd,
+                         poller->item.events, poller);
+}
+
+//  Check a reader that polled ready, and kill it if it keeps failing.
+//  Returns the events the handler should see, or 0 if none. The reader
+//  may be a copy held in the poll set, or the registered reader itself,
+//  in which case it's gone if we killed it.
+
+static short
+s_reader_check (zloop_t *self, s_reader_t *reader, short revents)
+{
+    if ((revents & ZMQ_POLLERR) && !reader->tolerant) {
+        if (self->verbose)
+            zsys_warning ("zloop: can't read %s socket: %s",
+                          s_reader_type_str (reader->sock),
+                          zmq_strerror (zmq_errno ()));
+        //  Give handler one chance to handle error, then kill
+        //  reader because it'll disrupt the reactor otherwise.
+        if (reader->errors++) {
+            zloop_reader_end (self, reader->sock);
+            revents = 0;
+        }
+    }
+    else
+        reader->errors = 0;     //  A non-error happened
+
+    return revents;
+}
+
+//  Call a reader's handler, and keep calling it while the socket has more
+//  input, until the reader's budget is spent. Returns the handler's last
+//  return code.
+
+static int
+s_reader_call (zloop_t *self, s_reader_t *reader)
+{
+    int64_t deadline = reader->budget_usecs ?
+                       zclock_usecs () + reader->budget_usecs : 0;
+    size_t calls = 0;
+    while (true) {
+        if (self->verbose)
+            zsys_debug ("zloop: call %s socket handler",
+                        s_reader_type_str (reader->sock));
+        int rc = reader->handler (self, reader->sock, reader->arg);
+        //  Reader may be gone if the handler changed the reactor
+        if (rc == -1 || self->need_rebuild || ++calls >= reader->budget)
+            return rc;
+        if (deadline && zclock_usecs () >= deadline)
+            return rc;
+        //  We can only tell if a ZeroMQ socket has more input
+        if (!zsock_resolve (reader->sock)
+        ||  !(zsock_events (reader->sock) & ZMQ_POLLIN))
+            return rc;
+    }
+}
+
+//  Check a poller that polled ready, as for readers
+
+static short
+s_poller_check (zloop_t *self, s_poller_t *poller, short revents)
+{
+    if ((revents & ZMQ_POLLERR) && !poller->tolerant) {
+        if (self->verbose)
+            zsys_warning ("zloop: can't poll %s socket (%p, %d): %s",
+                          poller->item.socket ?
+                          zsocket_type_str (poller->item.socket) : "FD",
+                          poller->item.socket, poller->item.fd,
+                          zmq_strerror (zmq_errno ()));
+        //  Give handler one chance to handle error, then kill
+        //  poller because it'll disrupt the reactor otherwise.
+        if (poller->errors++) {
+            zmq_pollitem_t item = poller->item;
+            zloop_poller_end (self, &item);
+            revents = 0;
+        }
+    }
+    else
+        poller->errors = 0;     //  A non-error happened
+
+    return revents;
+}
+
 
 //  --------------------------------------------------------------------------
 //  Constructor
@@ -223,10 +539,17 @@ zloop_new (void)
     if (self->readers)
         self->pollers = zlist_new ();
     if (self->pollers)
-        self->timers = zlist_new ();
-    if (self->timers)
+        self->timer_index = zhash_new_compact ();
+    if (self->timer_index) {
+        zhash_set_key_hasher (self->timer_index, s_timer_id_hash);
+        zhash_set_key_comparator (self->timer_index, s_timer_id_compare);
+        zhash_set_key_duplicator (self->timer_index, NULL);
+        zhash_set_key_destructor (self->timer_index, NULL);
         self->zombies = zlist_new ();
+    }
     if (self->zombies)
+        self->ticket_pool = zslab_new (sizeof (s_ticket_t));
+    if (self->ticket_pool)
         self->last_timer_id = 0;
     else
         zloop_destroy (&self);
@@ -243,6 +566,7 @@ zloop_destroy (zloop_t **self_p)
     assert (self_p);
     if (*self_p) {
         zloop_t *self = *self_p;
+        zpollset_destroy (&self->epoll);
 
         //  Destroy list of readers
         while (zlist_size (self->readers))
@@ -254,16 +578,20 @@ zloop_destroy (zloop_t **self_p)
             free (zlist_pop (self->pollers));
         zlist_destroy (&self->pollers);
 
-        //  Destroy list of timers
-        while (zlist_size (self->timers))
-            free (zlist_pop (self->timers));
-        zlist_destroy (&self->timers);
+        //  Destroy heap of timers
+        while (self->timers_size)
+            free (self->timers [--self->timers_size]);
+        free (self->timers);
+        zhash_destroy (&self->timer_index);
 
         //  Destroy zombie timer list
         //  Which must always be empty here
         assert (zlist_size (self->zombies) == 0);
         zlist_destroy (&self->zombies);
 
+        //  Destroying the pool frees all tickets, live or deleted
+        zslab_destroy (&self->ticket_pool);
+
         free (self->pollset);
         free (self->readact);
         free (self->pollact);
@@ -277,7 +605,8 @@ zloop_destroy (zloop_t **self_p)
 //  Register socket reader with the reactor. When the reader has messages,
 //  the reactor will call the handler, passing the arg. Returns 0 if OK, -1
 //  if there was an error. If you register the same socket more than once,
-//  each instance will invoke its corresponding handler.
+//  each instance will invoke its corresponding handler. The socket may also
+//  be a zsignal_t or zqueue_t, cast to a zsock_t *.
 
 int
 zloop_reader (zloop_t *self, zsock_t *sock, zloop_reader_fn handler, void *arg)
@@ -287,12 +616,19 @@ zloop_reader (zloop_t *self, zsock_t *sock, zloop_reader_fn handler, void *arg)
 
     s_reader_t *reader = s_reader_new (sock, handler, arg);
     if (reader) {
-        if (zlist_append (self->readers, reader))
+        if (zlist_append (self->readers, reader)) {
+            free (reader);
+            return -1;
+        }
+        if (self->epoll && s_epoll_add_reader (self, reader)) {
+            zlist_remove (self->readers, reader);
+            free (reader);
             return -1;
+        }
 
         self->need_rebuild = true;
         if (self->verbose)
-            zsys_debug ("zloop: register %s reader", zsock_type_str (sock));
+            zsys_debug ("zloop: register %s reader", s_reader_type_str (sock));
         return 0;
     }
     else
@@ -314,13 +650,15 @@ zloop_reader_end (zloop_t *self, zsock_t *sock)
     while (reader) {
         if (reader->sock == sock) {
             zlist_remove (self->readers, reader);
+            if (self->epoll)
+                zpollset_remove (self->epoll, reader);
             free (reader);
             self->need_rebuild = true;
         }
         reader = (s_reader_t *) zlist_next (self->readers);
     }
     if (self->verbose)
-        zsys_debug ("zloop: cancel %s reader", zsock_type_str (sock));
+        zsys_debug ("zloop: cancel %s reader", s_reader_type_str (sock));
 }
 
 
@@ -343,6 +681,35 @@ zloop_reader_set_tolerant (zloop_t *self, zsock_t *sock)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Set the budget for a registered reader. When the reader has input, the
+//  reactor calls its handler up to this many times in a row, as long as
+//  the socket still has input, before moving on to other readers. If
+//  usecs is not zero, it also stops once it has spent that long. The
+//  handler should read one message per call. The default budget is one
+//  call. A budget lets a busy reader handle messages in batches, without
+//  the cost of polling between each one.
+
+void
+zloop_reader_set_budget (zloop_t *self, zsock_t *sock, size_t messages, size_t usecs)
+{
+    assert (self);
+    assert (sock);
+    assert (messages > 0);
+
+    s_reader_t *reader = (s_reader_t *) zlist_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock) {
+            reader->budget = messages;
+            reader->budget_usecs = usecs;
+        }
+        reader = (s_reader_t *) zlist_next (self->readers);
+    }
+    //  Poll set holds copies of readers, so must be rebuilt
+    self->need_rebuild = true;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Register low-level libzmq pollitem with the reactor. When the pollitem
 //  is ready, will call the handler, passing the arg. Returns 0 if OK, -1
@@ -361,8 +728,15 @@ zloop_poller (zloop_t *self, zmq_pollitem_t *item, zloop_fn handler, void *arg)
 
     s_poller_t *poller = s_poller_new (item, handler, arg);
     if (poller) {
-        if (zlist_append (self->pollers, poller))
+        if (zlist_append (self->pollers, poller)) {
+            free (poller);
+            return -1;
+        }
+        if (self->epoll && s_epoll_add_poller (self, poller)) {
+            zlist_remove (self->pollers, poller);
+            free (poller);
             return -1;
+        }
 
         self->need_rebuild = true;
         if (self->verbose)
@@ -399,6 +773,8 @@ zloop_poller_end (zloop_t *self, zmq_pollitem_t *item)
         }
         if (match) {
             zlist_remove (self->pollers, poller);
+            if (self->epoll)
+                zpollset_remove (self->epoll, poller);
             free (poller);
             //  Force rebuild to avoid reading from freed poller
             self->need_rebuild = true;
@@ -456,8 +832,15 @@ zloop_timer (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler,
     s_timer_t *timer = s_timer_new (timer_id, delay, times, handler, arg);
     if (!timer)
         return -1;
-    if (zlist_append (self->timers, timer))
+    if (zhash_insert (self->timer_index, (void *) (uintptr_t) timer_id, timer)) {
+        free (timer);
+        return -1;
+    }
+    if (s_timer_push (self, timer)) {
+        zhash_delete (self->timer_index, (void *) (uintptr_t) timer_id);
+        free (timer);
         return -1;
+    }
     if (self->verbose)
 #ifdef __WINDOWS__
         zsys_debug ("zloop: register timer id=%d delay=%u times=%u",
@@ -487,7 +870,7 @@ zloop_timer_end (zloop_t *self, int timer_id)
     //  from inside the poll loop. So, we hold the arg on the zombie
     //  list, and process that list when we're done executing timers.
     //  This hack lets us store an integer timer ID as a pointer
-    if (zlist_append (self->zombies, (byte *) NULL + timer_id))
+    if (zlist_append (self->zombies, (void *) (uintptr_t) timer_id))
         return -1;
 
     if (self->verbose)
@@ -497,6 +880,127 @@ zloop_timer_end (zloop_t *self, int timer_id)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Register a ticket timer. Ticket timers are very fast in the case where
+//  you use a lot of timers (thousands), and frequently remove and add them.
+//  The main use case is expiry timers for servers that handle many clients,
+//  and which reset the expiry timer for each message received from a client.
+//  All tickets share the delay set by zloop_set_ticket_delay, which you must
+//  call before creating a ticket. A ticket runs once, when it expires, and
+//  is then destroyed, unless its handler resets it. Returns a handle to the
+//  ticket that you use in zloop_ticket_reset and zloop_ticket_delete, or
+//  NULL if there was an error.
+
+void *
+zloop_ticket (zloop_t *self, zloop_timer_fn handler, void *arg)
+{
+    assert (self);
+    assert (self->ticket_delay > 0);
+    s_ticket_t *ticket = (s_ticket_t *) zslab_alloc (self->ticket_pool);
+    if (ticket) {
+        ticket->handler = handler;
+        ticket->arg = arg;
+        s_ticket_link (self, ticket);
+    }
+    return ticket;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Reset a ticket timer, which moves it to the end of the ticket list and
+//  resets its execution time. This is a very fast operation.
+
+void
+zloop_ticket_reset (zloop_t *self, void *handle)
+{
+    assert (self);
+    assert (handle);
+    s_ticket_t *ticket = (s_ticket_t *) handle;
+    if (!ticket->deleted) {
+        if (ticket->linked)
+            s_ticket_unlink (self, ticket);
+        s_ticket_link (self, ticket);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Delete a ticket timer. We do not free the ticket here, as other code may
+//  still refer to it; we take it off the ticket list, mark it as deleted,
+//  and free it later on, safely.
+
+void
+zloop_ticket_delete (zloop_t *self, void *handle)
+{
+    assert (self);
+    assert (handle);
+    s_ticket_t *ticket = (s_ticket_t *) handle;
+    if (!ticket->deleted) {
+        if (ticket->linked)
+            s_ticket_unlink (self, ticket);
+        ticket->deleted = true;
+        ticket->next = self->dead_tickets;
+        self->dead_tickets = ticket;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the ticket delay, which applies to all tickets. If you lower the
+//  delay and there are already tickets created, the results are undefined.
+
+void
+zloop_set_ticket_delay (zloop_t *self, size_t ticket_delay)
+{
+    assert (self);
+    self->ticket_delay = ticket_delay;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Switch the reactor to the epoll backend, or back to zmq_poll. The epoll
+//  backend suits reactors with many readers and pollers, as adding or
+//  removing one does not rebuild the poll set, and each pass only looks
+//  at the items that are ready. Handlers work exactly as before. Readers
+//  on raw libzmq sockets are checked on every pass, so use zsock_t instead.
+//  Returns 0 if OK, -1 if epoll is not available on this platform, or
+//  failed.
+
+int
+zloop_set_epoll (zloop_t *self, bool epoll)
+{
+    assert (self);
+    if (epoll && !self->epoll) {
+        self->epoll = zpollset_new ();
+        if (!self->epoll)
+            return -1;
+        s_reader_t *reader = (s_reader_t *) zlist_first (self->readers);
+        while (reader) {
+            if (s_epoll_add_reader (self, reader)) {
+                zpollset_destroy (&self->epoll);
+                return -1;
+            }
+            reader = (s_reader_t *) zlist_next (self->readers);
+        }
+        s_poller_t *poller = (s_poller_t *) zlist_first (self->pollers);
+        while (poller) {
+            if (s_epoll_add_poller (self, poller)) {
+                zpollset_destroy (&self->epoll);
+                return -1;
+            }
+            poller = (s_poller_t *) zlist_next (self->pollers);
+        }
+    }
+    else
+    if (!epoll && self->epoll)
+        zpollset_destroy (&self->epoll);
+
+    //  Stop handling the current pass, if any, as it came from the old set
+    self->need_rebuild = true;
+    return 0;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Set verbose tracing of reactor on/off
 
@@ -521,23 +1025,36 @@ zloop_start (zloop_t *self)
     assert (self);
     int rc = 0;
 
-    //  Recalculate all timers now
-    s_timer_t *timer = (s_timer_t *) zlist_first (self->timers);
-    while (timer) {
-        timer->when = timer->delay + zclock_mono ();
-        timer = (s_timer_t *) zlist_next (self->timers);
-    }
+    //  Recalculate all timers now, and rebuild the heap since their order
+    //  may have changed
+    int64_t now = zclock_mono ();
+    size_t index;
+    for (index = 0; index < self->timers_size; index++)
+        self->timers [index]->when = self->timers [index]->delay + now;
+    for (index = self->timers_size / 2; index > 0; index--)
+        s_timer_sift_down (self, index - 1);
+
     //  Main reactor loop
     while (!zsys_interrupted) {
-        if (self->need_rebuild) {
-            //  If s_rebuild_pollset() fails, break out of the loop and
-            //  return its error
-            rc = s_rebuild_pollset (self);
-            if (rc)
-                break;
+        bool use_epoll = self->epoll != NULL;
+        if (use_epoll) {
+            //  Anything that changes the epoll set sets need_rebuild, and
+            //  we check that before touching any item found ready
+            rc = zpollset_wait (self->epoll, (int) s_tickless_timer (self));
+            self->need_rebuild = false;
+        }
+        else {
+            if (self->need_rebuild) {
+                //  If s_rebuild_pollset() fails, break out of the loop and
+                //  return its error
+                rc = s_rebuild_pollset (self);
+                if (rc)
+                    break;
+            }
+            rc = zmq_poll (self->pollset, (int) self->poll_size,
+                           s_tickless_timer (self) * ZMQ_POLL_MSEC);
         }
-        rc = zmq_poll (self->pollset, (int) self->poll_size,
-                       s_tickless_timer (self) * ZMQ_POLL_MSEC);
+        size_t ready = rc > 0 ? (size_t) rc : 0;
         if (rc == -1 || zsys_interrupted) {
             if (self->verbose)
                 zsys_debug ("zloop: interrupted (%d) - %s", rc,
@@ -545,50 +1062,108 @@ zloop_start (zloop_t *self)
             rc = 0;
             break;              //  Context has been shut down
         }
-        //  Handle any timers that have now expired
-        timer = (s_timer_t *) zlist_first (self->timers);
-        while (timer) {
-            if (zclock_mono () >= timer->when && timer->when != -1) {
+        //  Take all timers that have now expired off the heap, so that
+        //  each one runs at most once per pass even if it's fallen behind
+        now = zclock_mono ();
+        s_timer_t *expired = NULL;
+        s_timer_t **expired_tail = &expired;
+        while (self->timers_size && self->timers [0]->when <= now) {
+            s_timer_t *timer = self->timers [0];
+            s_timer_detach (self, timer);
+            timer->next = NULL;
+            *expired_tail = timer;
+            expired_tail = &timer->next;
+        }
+        //  Handle expired timers, soonest first, and put back any that
+        //  must run again, or that we didn't get to
+        while (expired) {
+            s_timer_t *timer = expired;
+            expired = timer->next;
+            if (rc != -1) {
                 if (self->verbose)
                     zsys_debug ("zloop: call timer id=%d handler", timer->timer_id);
                 rc = timer->handler (self, timer->timer_id, timer->arg);
-                if (rc == -1)
-                    break;      //  Timer handler signaled break
-                if (timer->times && --timer->times == 0) {
-                    zlist_remove (self->timers, timer);
-                    free (timer);
-                }
-                else
+                if (rc != -1) {
+                    if (timer->times && --timer->times == 0) {
+                        zhash_delete (self->timer_index,
+                                      (void *) (uintptr_t) timer->timer_id);
+                        free (timer);
+                        continue;
+                    }
                     timer->when += timer->delay;
+                }
+            }
+            //  A handler may have added timers, so the heap may need to
+            //  grow; if we can't do that, the timer is lost
+            if (s_timer_push (self, timer)) {
+                zsys_error ("zloop: out of memory, dropping timer id=%d",
+                            timer->timer_id);
+                zhash_delete (self->timer_index,
+                              (void *) (uintptr_t) timer->timer_id);
+                free (timer);
             }
-            timer = (s_timer_t *) zlist_next (self->timers);
         }
-        //  Handle any readers and pollers that are ready
-        size_t item_nbr;
-        for (item_nbr = 0; item_nbr < self->poll_size && rc >= 0; item_nbr++) {
-            s_reader_t *reader = &self->readact [item_nbr];
-            if (reader->handler) {
-                if (  (self->pollset [item_nbr].revents & ZMQ_POLLERR)
-                   && !reader->tolerant) {
+        //  Handle any tickets that have now expired. A ticket runs once,
+        //  unless its handler resets it, which puts it back on the list.
+        while (rc != -1 && self->tickets && self->tickets->when <= now) {
+            s_ticket_t *ticket = self->tickets;
+            s_ticket_unlink (self, ticket);
+            if (self->verbose)
+                zsys_debug ("zloop: call ticket handler");
+            rc = ticket->handler (self, 0, ticket->arg);
+            if (!ticket->linked && !ticket->deleted)
+                zslab_free (self->ticket_pool, ticket);
+        }
+        //  Handle any readers and pollers that are ready, starting after
+        //  the one we started with last time, so they take turns
+        size_t index;
+        for (index = 0; index < ready && use_epoll && rc >= 0; index++) {
+            //  Items in the epoll set are the registered readers and
+            //  pollers, so we stop as soon as any of them may have gone.
+            //  Epoll does not keep items in order, so we rotate instead.
+            if (self->need_rebuild)
+                break;
+            size_t item_nbr = (self->poll_start + index) % ready;
+            void *tag = zpollset_tag (self->epoll, item_nbr);
+            short revents = zpollset_revents (self->epoll, item_nbr);
+            if (((s_reader_t *) tag)->is_reader) {
+                s_reader_t *reader = (s_reader_t *) tag;
+                if (s_reader_check (self, reader, revents))
+                    rc = s_reader_call (self, reader);
+            }
+            else {
+                s_poller_t *poller = (s_poller_t *) tag;
+                revents = s_poller_check (self, poller, revents);
+                if (revents) {
                     if (self->verbose)
-                        zsys_warning ("zloop: can't read %s socket: %s",
-                                      zsock_type_str (reader->sock),
-                                      zmq_strerror (zmq_errno ()));
-                    //  Give handler one chance to handle error, then kill
-                    //  reader because it'll disrupt the reactor otherwise.
-                    if (reader->errors++) {
-                        zloop_reader_end (self, reader->sock);
-                        self->pollset [item_nbr].revents = 0;
-                    }
+                        zsys_debug ("zloop: call %s socket handler (%p, %d)",
+                                    poller->item.socket ?
+                                    zsocket_type_str (poller->item.socket) : "FD",
+                                    poller->item.socket, poller->item.fd);
+                    zmq_pollitem_t item = poller->item;
+                    item.revents = revents;
+                    rc = poller->handler (self, &item, poller->arg);
                 }
-                else
-                    reader->errors = 0;     //  A non-error happened
+            }
+        }
+        if (use_epoll && ready)
+            self->poll_start++;
+
+        size_t start = self->poll_size ? self->poll_start % self->poll_size : 0;
+        bool first = true;
+        for (index = 0; index < self->poll_size && ready && !use_epoll && rc >= 0; index++) {
+            size_t item_nbr = (start + index) % self->poll_size;
+            s_reader_t *reader = &self->readact [item_nbr];
+            if (reader->handler) {
+                self->pollset [item_nbr].revents =
+                    s_reader_check (self, reader, self->pollset [item_nbr].revents);
 
                 if (self->pollset [item_nbr].revents) {
-                    if (self->verbose)
-                        zsys_debug ("zloop: call %s socket handler",
-                                    zsock_type_str (reader->sock));
-                    rc = reader->handler (self, reader->sock, reader->arg);
+                    if (first) {
+                        self->poll_start = item_nbr + 1;
+                        first = false;
+                    }
+                    rc = s_reader_call (self, reader);
                     if (rc == -1 || self->need_rebuild)
                         break;
                 }
@@ -596,26 +1171,14 @@ zloop_start (zloop_t *self)
             else {
                 s_poller_t *poller = &self->pollact [item_nbr];
                 assert (self->pollset [item_nbr].socket == poller->item.socket);
-
-                if (  (self->pollset [item_nbr].revents & ZMQ_POLLERR)
-                   && !poller->tolerant) {
-                    if (self->verbose)
-                        zsys_warning ("zloop: can't poll %s socket (%p, %d): %s",
-                                      poller->item.socket ?
-                                      zsocket_type_str (poller->item.socket) : "FD",
-                                      poller->item.socket, poller->item.fd,
-                                      zmq_strerror (zmq_errno ()));
-                    //  Give handler one chance to handle error, then kill
-                    //  poller because it'll disrupt the reactor otherwise.
-                    if (poller->errors++) {
-                        zloop_poller_end (self, &poller->item);
-                        self->pollset [item_nbr].revents = 0;
-                    }
-                }
-                else
-                    poller->errors = 0;     //  A non-error happened
+                self->pollset [item_nbr].revents =
+                    s_poller_check (self, poller, self->pollset [item_nbr].revents);
 
                 if (self->pollset [item_nbr].revents) {
+                    if (first) {
+                        self->poll_start = item_nbr + 1;
+                        first = false;
+                    }
                     if (self->verbose)
                         zsys_debug ("zloop: call %s socket handler (%p, %d)",
                                     poller->item.socket ?
@@ -628,13 +1191,12 @@ zloop_start (zloop_t *self)
             }
         }
         //  Now handle any timer zombies
-        //  This is going to be slow if we have many timers; we might use
-        //  a faster lookup on the timer list.
         while (zlist_size (self->zombies)) {
             //  Get timer_id back from pointer
-            int timer_id = (byte *) zlist_pop (self->zombies) - (byte *) NULL;
+            int timer_id = (int) (uintptr_t) zlist_pop (self->zombies);
             s_timer_remove (self, timer_id);
         }
+        s_ticket_reap (self);
         if (rc == -1)
             break;
     }
@@ -668,6 +1230,65 @@ s_socket_event (zloop_t *loop, zsock_t *handle, void *arg)
     return -1;
 }
 
+static int
+s_relay_event (zloop_t *loop, zsock_t *handle, void *output)
+{
+    //  Pass message on to output
+    char *string = zstr_recv (handle);
+    zstr_send (output, string);
+    zstr_free (&string);
+    return 0;
+}
+
+static int
+s_count_reader_event (zloop_t *loop, zsock_t *handle, void *arg)
+{
+    //  Read one message and count it
+    char *string = zstr_recv (handle);
+    zstr_free (&string);
+    (*(int *) arg)++;
+    return 0;
+}
+
+static int
+s_poller_end_event (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+    //  Just end the reactor
+    assert (item->revents & ZMQ_POLLIN);
+    return -1;
+}
+
+static int
+s_cancel_timers_event (zloop_t *loop, int timer_id, void *arg)
+{
+    //  Cancel every other timer in the array, which ends with zero
+    int *timer_ids = (int *) arg;
+    for (; *timer_ids; timer_ids += 2)
+        zloop_timer_end (loop, *timer_ids);
+    return 0;
+}
+
+static int
+s_count_timer_event (zloop_t *loop, int timer_id, void *arg)
+{
+    (*(int *) arg)++;
+    return 0;
+}
+
+static int
+s_end_timer_event (zloop_t *loop, int timer_id, void *arg)
+{
+    //  Just end the reactor
+    return -1;
+}
+
+static int
+s_reset_ticket_event (zloop_t *loop, int timer_id, void *handle)
+{
+    zloop_ticket_reset (loop, handle);
+    return 0;
+}
+
 void
 zloop_test (bool verbose)
 {
@@ -703,6 +1324,115 @@ zloop_test (bool verbose)
     zloop_destroy (&loop);
     assert (loop == NULL);
 
+    //  Run many timers, cancelling half of them while the reactor runs
+    loop = zloop_new ();
+    assert (loop);
+    zloop_set_verbose (loop, verbose);
+    int timer_ids [1001];
+    int fired = 0;
+    int index;
+    for (index = 0; index < 1000; index++) {
+        timer_ids [index] = zloop_timer (loop, 10 + index % 50, 1,
+                                         s_count_timer_event, &fired);
+        assert (timer_ids [index] > 0);
+    }
+    timer_ids [1000] = 0;
+    zloop_timer (loop, 1, 1, s_cancel_timers_event, timer_ids);
+    int repeats = 0;
+    zloop_timer (loop, 5, 3, s_count_timer_event, &repeats);
+    zloop_timer (loop, 100, 1, s_end_timer_event, NULL);
+    zloop_start (loop);
+    assert (fired == 500);
+    assert (repeats == 3);
+    zloop_destroy (&loop);
+
+    //  Tickets expire unless they are reset or deleted
+    loop = zloop_new ();
+    assert (loop);
+    zloop_set_verbose (loop, verbose);
+    zloop_set_ticket_delay (loop, 50);
+    void *tickets [100];
+    fired = 0;
+    for (index = 0; index < 100; index++) {
+        tickets [index] = zloop_ticket (loop, s_count_timer_event, &fired);
+        assert (tickets [index]);
+    }
+    for (index = 0; index < 100; index += 2)
+        zloop_ticket_delete (loop, tickets [index]);
+    int keepalive_fired = 0;
+    void *keepalive = zloop_ticket (loop, s_count_timer_event, &keepalive_fired);
+    assert (keepalive);
+    zloop_timer (loop, 10, 10, s_reset_ticket_event, keepalive);
+    zloop_timer (loop, 120, 1, s_end_timer_event, NULL);
+    zloop_start (loop);
+    assert (fired == 50);
+    assert (keepalive_fired == 0);
+    zloop_ticket_delete (loop, keepalive);
+    zloop_destroy (&loop);
+
+    //  A busy reader handles a batch of messages, then others get a turn
+    zsock_t *busy_in = zsock_new_pull ("inproc://zloop.busy");
+    assert (busy_in);
+    zsock_t *busy_out = zsock_new_push ("inproc://zloop.busy");
+    assert (busy_out);
+    for (index = 0; index < 100; index++)
+        zstr_send (busy_out, "BUSY");
+    zstr_send (output, "PING");
+    zclock_sleep (10);
+    loop = zloop_new ();
+    assert (loop);
+    zloop_set_verbose (loop, verbose);
+    int busy_count = 0;
+    rc = zloop_reader (loop, busy_in, s_count_reader_event, &busy_count);
+    assert (rc == 0);
+    zloop_reader_set_budget (loop, busy_in, 10, 0);
+    rc = zloop_reader (loop, input, s_socket_event, NULL);
+    assert (rc == 0);
+    zloop_start (loop);
+    assert (busy_count == 10);
+    zloop_destroy (&loop);
+    zsock_destroy (&busy_in);
+    zsock_destroy (&busy_out);
+
+    //  Readers and pollers work the same with the epoll backend
+    zsock_t *relay_in = zsock_new_pull ("inproc://zloop.relay");
+    assert (relay_in);
+    zsock_t *relay_out = zsock_new_push ("inproc://zloop.relay");
+    assert (relay_out);
+    zsock_t *sink = zsock_new_pull ("inproc://zloop.sink");
+    assert (sink);
+    zsock_t *source = zsock_new_push ("inproc://zloop.sink");
+    assert (source);
+    loop = zloop_new ();
+    assert (loop);
+    zloop_set_verbose (loop, verbose);
+    if (zloop_set_epoll (loop, true) == 0) {
+        //  A ping goes from the timer, via the reader, to the poller
+        zloop_timer (loop, 10, 1, s_timer_event, relay_out);
+        rc = zloop_reader (loop, relay_in, s_relay_event, source);
+        assert (rc == 0);
+        //  A reader we cancel again before starting
+        rc = zloop_reader (loop, output, s_socket_event, NULL);
+        assert (rc == 0);
+        zloop_reader_end (loop, output);
+        zmq_pollitem_t item = { zsock_resolve (sink), 0, ZMQ_POLLIN };
+        rc = zloop_poller (loop, &item, s_poller_end_event, NULL);
+        assert (rc == 0);
+        zloop_timer (loop, 1000, 1, s_end_timer_event, NULL);
+        int64_t start = zclock_mono ();
+        rc = zloop_start (loop);
+        assert (rc == -1);
+        assert (zclock_mono () - start < 1000);
+        char *string = zstr_recv (sink);
+        assert (streq (string, "PING"));
+        zstr_free (&string);
+    }
+    zloop_destroy (&loop);
+    zsock_destroy (&relay_in);
+    zsock_destroy (&relay_out);
+    zsock_destroy (&sink);
+    zsock_destroy (&source);
+
     zsock_destroy (&input);
     zsock_destroy (&output);
     //  @end
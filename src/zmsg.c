@@ -31,24 +31,117 @@
     with methods to work with the overall container. zmsg_t messages are
     composed of zero or more zframe_t frames.
 @discuss
+    A message holds its frames in a small array inside the message object
+    itself, so typical multipart messages need no allocation beyond the
+    message and its frames. Messages with many frames move the array onto
+    the heap, doubling it as needed. Pushing and popping frames at either
+    end costs O(1).
 @end
 */
 
 #include "../include/czmq.h"
+#include "zsys_mutex.h"
 
 //  zmsg_t instances always have this tag as the first 4 octets of
 //  their data, which lets us do runtime object typing & validation.
 #define ZMSG_TAG            0x0003cafe
 
+//  Frames we can hold without allocating a separate array
+#define ZMSG_INLINE_FRAMES  8
+
+//  Smallest frame that zmsg_decode_zero_copy does not copy
+#define ZMSG_SLICE_MIN      256
+
 //  Structure of our class
 
 struct _zmsg_t {
     uint32_t tag;               //  Object tag for runtime detection
-    zlist_t *frames;            //  List of frames
+    zframe_t **frames;          //  Ring of frames, inline or on heap
+    size_t head;                //  Ring index of first frame
+    size_t size;                //  Number of frames in message
+    size_t limit;               //  Number of frames ring can hold
+    size_t cursor;              //  1 + index of current frame, or 0
     size_t content_size;        //  Total content size
+    zframe_t *inline_frames [ZMSG_INLINE_FRAMES];
 };
 
 
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Return address of the frame at the specified index in the message
+
+static zframe_t **
+s_frame_at (zmsg_t *self, size_t index)
+{
+    return &self->frames [(self->head + index) % self->limit];
+}
+
+//  Make room for one more frame, moving the ring onto the heap if it is
+//  full. Returns 0 if OK, -1 if we ran out of memory.
+
+static int
+s_frames_grow (zmsg_t *self)
+{
+    if (self->size < self->limit)
+        return 0;
+    size_t limit = self->limit * 2;
+    zframe_t **frames = (zframe_t **) malloc (limit * sizeof (zframe_t *));
+    if (!frames)
+        return -1;
+    size_t index;
+    for (index = 0; index < self->size; index++)
+        frames [index] = *s_frame_at (self, index);
+    if (self->frames != self->inline_frames)
+        free (self->frames);
+    self->frames = frames;
+    self->head = 0;
+    self->limit = limit;
+    return 0;
+}
+
+//  Add frame at the front of the message
+
+static int
+s_frames_push (zmsg_t *self, zframe_t *frame)
+{
+    if (s_frames_grow (self))
+        return -1;
+    self->head = (self->head + self->limit - 1) % self->limit;
+    self->frames [self->head] = frame;
+    self->size++;
+    self->cursor = 0;
+    return 0;
+}
+
+//  Add frame at the end of the message
+
+static int
+s_frames_append (zmsg_t *self, zframe_t *frame)
+{
+    if (s_frames_grow (self))
+        return -1;
+    self->size++;
+    *s_frame_at (self, self->size - 1) = frame;
+    self->cursor = 0;
+    return 0;
+}
+
+//  Take first frame off the message, if any
+
+static zframe_t *
+s_frames_pop (zmsg_t *self)
+{
+    zframe_t *frame = NULL;
+    if (self->size) {
+        frame = self->frames [self->head];
+        self->head = (self->head + 1) % self->limit;
+        self->size--;
+    }
+    self->cursor = 0;
+    return frame;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Constructor
 
@@ -60,9 +153,8 @@ zmsg_new (void)
     self = (zmsg_t *) zmalloc (sizeof (zmsg_t));
     if (self) {
         self->tag = ZMSG_TAG;
-        self->frames = zlist_new ();
-        if (!self->frames)
-            zmsg_destroy (&self);
+        self->frames = self->inline_frames;
+        self->limit = ZMSG_INLINE_FRAMES;
     }
     return self;
 }
@@ -78,11 +170,12 @@ zmsg_destroy (zmsg_t **self_p)
     if (*self_p) {
         zmsg_t *self = *self_p;
         assert (zmsg_is (self));
-        while (zlist_size (self->frames) > 0) {
-            zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+        while (self->size) {
+            zframe_t *frame = s_frames_pop (self);
             zframe_destroy (&frame);
         }
-        zlist_destroy (&self->frames);
+        if (self->frames != self->inline_frames)
+            free (self->frames);
         self->tag = 0xDeadBeef;
         free (self);
         *self_p = NULL;
@@ -139,13 +232,12 @@ zmsg_send (zmsg_t **self_p, void *dest)
     void *handle = zsock_resolve (dest);
     if (self) {
         assert (zmsg_is (self));
-        zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+        zframe_t *frame = s_frames_pop (self);
         while (frame) {
-            rc = zframe_send (&frame, handle,
-                              zlist_size (self->frames) ? ZFRAME_MORE : 0);
+            rc = zframe_send (&frame, handle, self->size ? ZFRAME_MORE : 0);
             if (rc != 0)
                 break;
-            frame = (zframe_t *) zlist_pop (self->frames);
+            frame = s_frames_pop (self);
         }
         zmsg_destroy (self_p);
     }
@@ -162,7 +254,7 @@ zmsg_size (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    return zlist_size (self->frames);
+    return self->size;
 }
 
 
@@ -195,7 +287,7 @@ zmsg_prepend (zmsg_t *self, zframe_t **frame_p)
     zframe_t *frame = *frame_p;
     *frame_p = NULL;            //  We now own frame
     self->content_size += zframe_size (frame);
-    return zlist_push (self->frames, frame);
+    return s_frames_push (self, frame);
 }
 
 
@@ -214,7 +306,7 @@ zmsg_append (zmsg_t *self, zframe_t **frame_p)
     zframe_t *frame = *frame_p;
     *frame_p = NULL;            //  We now own frame
     self->content_size += zframe_size (frame);
-    return zlist_append (self->frames, frame);
+    return s_frames_append (self, frame);
 }
 
 
@@ -228,7 +320,7 @@ zmsg_pop (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+    zframe_t *frame = s_frames_pop (self);
     if (frame)
         self->content_size -= zframe_size (frame);
 
@@ -249,7 +341,7 @@ zmsg_pushmem (zmsg_t *self, const void *src, size_t size)
     zframe_t *frame = zframe_new (src, size);
     if (frame) {
         self->content_size += size;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -268,7 +360,7 @@ zmsg_addmem (zmsg_t *self, const void *src, size_t size)
     zframe_t *frame = zframe_new (src, size);
     if (frame) {
         self->content_size += size;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
@@ -290,7 +382,7 @@ zmsg_pushstr (zmsg_t *self, const char *string)
     zframe_t *frame = zframe_new (string, len);
     if (frame) {
         self->content_size += len;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -312,7 +404,7 @@ zmsg_addstr (zmsg_t *self, const char *string)
     zframe_t *frame = zframe_new (string, len);
     if (frame) {
         self->content_size += len;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
@@ -342,7 +434,7 @@ zmsg_pushstrf (zmsg_t *self, const char *format, ...)
     free (string);
     if (frame) {
         self->content_size += len;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -372,7 +464,7 @@ zmsg_addstrf (zmsg_t *self, const char *format, ...)
     free (string);
     if (frame) {
         self->content_size += len;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
@@ -389,7 +481,7 @@ zmsg_popstr (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+    zframe_t *frame = s_frames_pop (self);
     char *string = NULL;
     if (frame) {
         self->content_size -= zframe_size (frame);
@@ -410,7 +502,20 @@ zmsg_remove (zmsg_t *self, zframe_t *frame)
     assert (zmsg_is (self));
 
     self->content_size -= zframe_size (frame);
-    zlist_remove (self->frames, frame);
+    size_t index;
+    for (index = 0; index < self->size; index++)
+        if (*s_frame_at (self, index) == frame)
+            break;
+    if (index == self->size)
+        return;                 //  Frame is not in message
+
+    //  Keep the cursor on the same frame, or on the previous one if we
+    //  are removing the current frame, then close the gap
+    if (self->cursor > index)
+        self->cursor--;
+    for (; index + 1 < self->size; index++)
+        *s_frame_at (self, index) = *s_frame_at (self, index + 1);
+    self->size--;
 }
 
 
@@ -424,7 +529,8 @@ zmsg_first (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    return (zframe_t *) zlist_first (self->frames);
+    self->cursor = 0;
+    return zmsg_next (self);
 }
 
 
@@ -438,7 +544,13 @@ zmsg_next (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    return (zframe_t *) zlist_next (self->frames);
+    //  Like zlist, we go back to the first frame after running off the end
+    if (self->cursor < self->size) {
+        self->cursor++;
+        return *s_frame_at (self, self->cursor - 1);
+    }
+    self->cursor = 0;
+    return NULL;
 }
 
 
@@ -451,7 +563,8 @@ zmsg_last (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    return (zframe_t *) zlist_last (self->frames);
+    self->cursor = self->size;
+    return self->size ? *s_frame_at (self, self->size - 1) : NULL;
 }
 
 
@@ -543,44 +656,98 @@ zmsg_encode (zmsg_t *self, byte **buffer)
     assert (self);
     assert (zmsg_is (self));
 
-    //  Calculate real size of buffer
-    size_t buffer_size = 0;
-    zframe_t *frame = zmsg_first (self);
-    while (frame) {
+    size_t buffer_size = zmsg_encode_size (self);
+    *buffer = (byte *) malloc (buffer_size);
+    if (*buffer)
+        zmsg_encode_buffer (self, *buffer, buffer_size);
+    return buffer_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of bytes that zmsg_encode or zmsg_encode_buffer will
+//  produce for the message.
+
+size_t
+zmsg_encode_size (zmsg_t *self)
+{
+    assert (self);
+    assert (zmsg_is (self));
+
+    //  Every frame has a one-octet length, and large ones four more
+    size_t buffer_size = self->content_size + self->size;
+    size_t index;
+    for (index = 0; index < self->size; index++)
+        if (zframe_size (*s_frame_at (self, index)) >= 255)
+            buffer_size += 4;
+    return buffer_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Serialize multipart message into a buffer that the caller provides, in
+//  the same format as zmsg_encode, without allocating memory. Returns the
+//  number of bytes written, or 0 if the buffer was too small, in which
+//  case it writes nothing. Use zmsg_encode_size to size the buffer.
+
+size_t
+zmsg_encode_buffer (zmsg_t *self, byte *buffer, size_t buffer_size)
+{
+    assert (self);
+    assert (zmsg_is (self));
+    assert (buffer || buffer_size == 0);
+
+    size_t encode_size = zmsg_encode_size (self);
+    if (encode_size > buffer_size)
+        return 0;
+
+    byte *dest = buffer;
+    size_t index;
+    for (index = 0; index < self->size; index++) {
+        zframe_t *frame = *s_frame_at (self, index);
         size_t frame_size = zframe_size (frame);
         if (frame_size < 255)
-            buffer_size += frame_size + 1;
-        else
-            buffer_size += frame_size + 1 + 4;
-        frame = zmsg_next (self);
+            *dest++ = (byte) frame_size;
+        else {
+            *dest++ = 0xFF;
+            *dest++ = (frame_size >> 24) & 255;
+            *dest++ = (frame_size >> 16) & 255;
+            *dest++ = (frame_size >>  8) & 255;
+            *dest++ = frame_size        & 255;
+        }
+        memcpy (dest, zframe_data (frame), frame_size);
+        dest += frame_size;
     }
-    *buffer = (byte *) malloc (buffer_size);
+    assert ((size_t) (dest - buffer) == encode_size);
+    return encode_size;
+}
 
-    if (*buffer) {
-        //  Encode message now
-        byte *dest = *buffer;
-        frame = zmsg_first (self);
-        while (frame) {
-            size_t frame_size = zframe_size (frame);
-            if (frame_size < 255) {
-                *dest++ = (byte) frame_size;
-                memcpy (dest, zframe_data (frame), frame_size);
-                dest += frame_size;
-            }
-            else {
-                *dest++ = 0xFF;
-                *dest++ = (frame_size >> 24) & 255;
-                *dest++ = (frame_size >> 16) & 255;
-                *dest++ = (frame_size >>  8) & 255;
-                *dest++ = frame_size        & 255;
-                memcpy (dest, zframe_data (frame), frame_size);
-                dest += frame_size;
-            }
-            frame = zmsg_next (self);
-        }
-        assert ((dest - *buffer) == buffer_size);
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Get the size of the next frame in a serialized message buffer, and
+//  advance past its length field. Returns 0 if OK, or -1 if the buffer
+//  was badly formatted.
+
+static int
+s_decode_frame_size (byte **source_p, byte *limit, size_t *frame_size_p)
+{
+    byte *source = *source_p;
+    size_t frame_size = *source++;
+    if (frame_size == 255) {
+        if (source > limit - 4)
+            return -1;
+        frame_size = (source [0] << 24)
+                     + (source [1] << 16)
+                     + (source [2] << 8)
+                     +  source [3];
+        source += 4;
     }
-    return buffer_size;
+    if (source > limit - frame_size)
+        return -1;
+    *source_p = source;
+    *frame_size_p = frame_size;
+    return 0;
 }
 
 
@@ -599,19 +766,8 @@ zmsg_decode (byte *buffer, size_t buffer_size)
     byte *source = buffer;
     byte *limit = buffer + buffer_size;
     while (source < limit) {
-        size_t frame_size = *source++;
-        if (frame_size == 255) {
-            if (source > limit - 4) {
-                zmsg_destroy (&self);
-                break;
-            }
-            frame_size = (source [0] << 24)
-                         + (source [1] << 16)
-                         + (source [2] << 8)
-                         +  source [3];
-            source += 4;
-        }
-        if (source > limit - frame_size) {
+        size_t frame_size;
+        if (s_decode_frame_size (&source, limit, &frame_size)) {
             zmsg_destroy (&self);
             break;
         }
@@ -632,6 +788,102 @@ zmsg_decode (byte *buffer, size_t buffer_size)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  A buffer that zmsg_decode_zero_copy sliced into frames. Frames may be
+//  released from libzmq I/O threads, so the reference count is guarded.
+
+typedef struct {
+    zsys_mutex_t mutex;         //  Guards refs
+    size_t refs;                //  Frames still using buffer, plus decoder
+    bool abandoned;             //  Decoding failed, caller keeps buffer
+    byte *buffer;               //  Buffer that frames refer to
+    zframe_free_fn *free_fn;    //  Caller's callback for buffer
+    void *arg;                  //  Argument for callback
+} s_slices_t;
+
+static void
+s_slices_release (void *data, void *arg)
+{
+    s_slices_t *slices = (s_slices_t *) arg;
+    ZMUTEX_LOCK (slices->mutex);
+    size_t refs = --slices->refs;
+    ZMUTEX_UNLOCK (slices->mutex);
+    if (refs == 0) {
+        if (slices->free_fn && !slices->abandoned)
+            (slices->free_fn) (slices->buffer, slices->arg);
+        ZMUTEX_DESTROY (slices->mutex);
+        free (slices);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decodes a serialized message buffer created by zmsg_encode () without
+//  copying frame data. Frames of 256 bytes or more refer to their part of
+//  the buffer; smaller frames are copied, as that is cheaper. When the
+//  message and all frames taken from it, including frames sent to sockets,
+//  are done with the buffer, calls free_fn with the buffer and arg, if
+//  free_fn is not null. Until then, the caller must not change or release
+//  the buffer. Returns NULL if the buffer was badly formatted or there was
+//  insufficient memory to work, in which case it does not call free_fn,
+//  and the caller still owns the buffer.
+
+zmsg_t *
+zmsg_decode_zero_copy (byte *buffer, size_t buffer_size, zframe_free_fn *free_fn, void *arg)
+{
+    //  Check the whole buffer first, so we fail before making any frames
+    byte *source = buffer;
+    byte *limit = buffer + buffer_size;
+    while (source < limit) {
+        size_t frame_size;
+        if (s_decode_frame_size (&source, limit, &frame_size))
+            return NULL;
+        source += frame_size;
+    }
+    zmsg_t *self = zmsg_new ();
+    if (!self)
+        return NULL;
+    s_slices_t *slices = (s_slices_t *) zmalloc (sizeof (s_slices_t));
+    if (!slices) {
+        zmsg_destroy (&self);
+        return NULL;
+    }
+    ZMUTEX_INIT (slices->mutex);
+    slices->refs = 1;           //  Held by us until we're done
+    slices->buffer = buffer;
+    slices->free_fn = free_fn;
+    slices->arg = arg;
+
+    source = buffer;
+    while (source < limit) {
+        size_t frame_size;
+        s_decode_frame_size (&source, limit, &frame_size);
+        zframe_t *frame;
+        if (frame_size >= ZMSG_SLICE_MIN) {
+            ZMUTEX_LOCK (slices->mutex);
+            slices->refs++;
+            ZMUTEX_UNLOCK (slices->mutex);
+            frame = zframe_new_zero_copy (source, frame_size, s_slices_release, slices);
+            if (!frame)
+                s_slices_release (source, slices);
+        }
+        else
+            frame = zframe_new (source, frame_size);
+
+        if (!frame || zmsg_append (self, &frame)) {
+            zframe_destroy (&frame);
+            slices->abandoned = true;
+            zmsg_destroy (&self);
+            break;
+        }
+        source += frame_size;
+    }
+    s_slices_release (buffer, slices);
+    return self;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Create copy of message, as new message object. Returns a fresh zmsg_t
 //  object. If message is null, or memory was exhausted, returns null.
@@ -659,6 +911,38 @@ zmsg_dup (zmsg_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Create a new message whose frames share the data of this message's
+//  frames, without copying it. Use this to send the same message to many
+//  sockets: you can add frames, such as a routing id, to each copy, but
+//  must not modify the shared data. Returns a fresh zmsg_t object. If
+//  message is null, or memory was exhausted, returns null.
+
+zmsg_t *
+zmsg_share (zmsg_t *self)
+{
+    if (self) {
+        assert (zmsg_is (self));
+        zmsg_t *copy = zmsg_new ();
+        if (copy) {
+            zframe_t *frame = zmsg_first (self);
+            while (frame) {
+                zframe_t *shared = zframe_share (frame);
+                if (!shared || zmsg_append (copy, &shared)) {
+                    zframe_destroy (&shared);
+                    zmsg_destroy (&copy);
+                    break;      //  Abandon attempt to share message
+                }
+                frame = zmsg_next (self);
+            }
+        }
+        return copy;
+    }
+    else
+        return NULL;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Send message to zsys log sink (may be stdout, or system facility as
 //  configured by zsys_set_logstream).
@@ -769,7 +1053,7 @@ zmsg_push (zmsg_t *self, zframe_t *frame)
     assert (self);
     assert (frame);
     self->content_size += zframe_size (frame);
-    return zlist_push (self->frames, frame);
+    return s_frames_push (self, frame);
 }
 
 
@@ -785,7 +1069,7 @@ zmsg_add (zmsg_t *self, zframe_t *frame)
     assert (self);
     assert (frame);
     self->content_size += zframe_size (frame);
-    return zlist_append (self->frames, frame);
+    return s_frames_append (self, frame);
 }
 
 
@@ -818,6 +1102,13 @@ zmsg_fprint (zmsg_t *self, FILE *file)
 //  --------------------------------------------------------------------------
 //  Selftest
 
+static void
+s_test_free (void *data, void *arg)
+{
+    free (data);
+    (*(int *) arg)++;
+}
+
 void
 zmsg_test (bool verbose)
 {
@@ -983,6 +1274,138 @@ zmsg_test (bool verbose)
     free (buffer);
     zmsg_destroy (&msg);
 
+    //  Encode into our own buffer, and decode without copying
+    msg = zmsg_new ();
+    assert (msg);
+    byte *large = (byte *) zmalloc (70000);
+    assert (large);
+    zmsg_addstr (msg, "small");
+    zmsg_addmem (msg, large, 1000);
+    zmsg_addmem (msg, NULL, 0);
+    zmsg_addmem (msg, large, 70000);
+    free (large);
+    buffer_size = zmsg_encode_size (msg);
+    assert (buffer_size == 1 + 5 + 5 + 1000 + 1 + 5 + 70000);
+    buffer = (byte *) malloc (buffer_size);
+    assert (buffer);
+    assert (zmsg_encode_buffer (msg, buffer, buffer_size - 1) == 0);
+    assert (zmsg_encode_buffer (msg, buffer, buffer_size) == buffer_size);
+    zmsg_destroy (&msg);
+
+    int released = 0;
+    assert (zmsg_decode_zero_copy (buffer, 3, s_test_free, &released) == NULL);
+    msg = zmsg_decode_zero_copy (buffer, buffer_size, s_test_free, &released);
+    assert (msg);
+    assert (zmsg_size (msg) == 4);
+    assert (zmsg_content_size (msg) == 71005);
+    assert (zframe_streq (zmsg_first (msg), "small"));
+    frame = zmsg_next (msg);
+    assert (zframe_data (frame) == buffer + 1 + 5 + 5);
+    assert (zframe_size (zmsg_next (msg)) == 0);
+    assert (zframe_size (zmsg_next (msg)) == 70000);
+
+    //  Buffer is released when the last frame that uses it is done
+    zmsg_remove (msg, frame);
+    rc = zframe_send (&frame, output, 0);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    assert (released == 0);
+    frame = zframe_recv (input);
+    assert (frame);
+    assert (zframe_size (frame) == 1000);
+    zframe_destroy (&frame);
+    assert (released == 1);
+
+    //  Zero-copy frames go through a message without being copied
+    zchunk_t *chunk = zchunk_new ("Zero-copy", 9);
+    assert (chunk);
+    msg = zmsg_new ();
+    assert (msg);
+    frame = zchunk_packx (&chunk);
+    assert (frame);
+    byte *data = zframe_data (frame);
+    rc = zmsg_append (msg, &frame);
+    assert (rc == 0);
+    rc = zmsg_send (&msg, output);
+    assert (rc == 0);
+    msg = zmsg_recv (input);
+    assert (msg);
+    assert (zmsg_size (msg) == 1);
+    frame = zmsg_first (msg);
+    assert (zframe_data (frame) == data);
+    assert (zframe_streq (frame, "Zero-copy"));
+    zmsg_destroy (&msg);
+
+    //  Fan out a message to many peers, each with its own routing frame
+    byte payload [100];
+    memset (payload, 0, sizeof (payload));
+    msg = zmsg_new ();
+    assert (msg);
+    zmsg_addmem (msg, payload, sizeof (payload));
+    for (frame_nbr = 0; frame_nbr < 3; frame_nbr++) {
+        copy = zmsg_share (msg);
+        assert (copy);
+        zmsg_pushstrf (copy, "peer-%d", frame_nbr);
+        rc = zmsg_send (&copy, output);
+        assert (rc == 0);
+    }
+    for (frame_nbr = 0; frame_nbr < 3; frame_nbr++) {
+        copy = zmsg_recv (input);
+        assert (copy);
+        assert (zmsg_size (copy) == 2);
+        char *peer = zmsg_popstr (copy);
+        assert (memcmp (peer, "peer-", 5) == 0);
+        free (peer);
+        assert (zframe_data (zmsg_first (copy)) == zframe_data (zmsg_first (msg)));
+        zmsg_destroy (&copy);
+    }
+    zmsg_destroy (&msg);
+
+    //  Frames stay in order as they wrap around and outgrow the message
+    msg = zmsg_new ();
+    assert (msg);
+    for (frame_nbr = 0; frame_nbr < 6; frame_nbr++)
+        zmsg_addstrf (msg, "%d", frame_nbr);
+    for (frame_nbr = 0; frame_nbr < 3; frame_nbr++) {
+        frame = zmsg_pop (msg);
+        zframe_destroy (&frame);
+    }
+    zmsg_pushstr (msg, "b");
+    zmsg_pushstr (msg, "a");
+    for (frame_nbr = 6; frame_nbr < 20; frame_nbr++)
+        zmsg_addstrf (msg, "%d", frame_nbr);
+    assert (zmsg_size (msg) == 19);
+    assert (zframe_streq (zmsg_first (msg), "a"));
+    assert (zframe_streq (zmsg_next (msg), "b"));
+    for (frame_nbr = 3; frame_nbr < 20; frame_nbr++) {
+        char number [10];
+        sprintf (number, "%d", frame_nbr);
+        assert (zframe_streq (zmsg_next (msg), number));
+    }
+    assert (zmsg_next (msg) == NULL);
+    assert (zframe_streq (zmsg_last (msg), "19"));
+
+    //  Remove frames while iterating over the message
+    frame = zmsg_first (msg);
+    while (frame) {
+        if (zframe_size (frame) == 1 && zframe_data (frame) [0] == '4') {
+            zmsg_remove (msg, frame);
+            zframe_destroy (&frame);
+        }
+        else
+        if (zframe_streq (frame, "a") || zframe_streq (frame, "19")) {
+            zmsg_remove (msg, frame);
+            zframe_destroy (&frame);
+        }
+        frame = zmsg_next (msg);
+    }
+    assert (zmsg_size (msg) == 16);
+    assert (zframe_streq (zmsg_first (msg), "b"));
+    assert (zframe_streq (zmsg_next (msg), "3"));
+    assert (zframe_streq (zmsg_next (msg), "5"));
+    assert (zframe_streq (zmsg_last (msg), "18"));
+    zmsg_destroy (&msg);
+
     //  Now try methods on an empty message
     msg = zmsg_new ();
     assert (msg);
@@ -18,10 +18,23 @@
     It does not provide polling for output, nor polling on file handles.
     If you need either of these, use the zmq_poll API directly.
 @discuss
+    By default the poller rebuilds a zmq_poll set whenever you add or remove
+    a reader, and each wait scans the whole set. For pollers that watch
+    thousands of sockets, call zpoller_set_epoll to switch to an epoll
+    backend, where adding and removing readers costs O(1) and a wait only
+    looks at the readers that are ready. This is only available on Linux.
+
+    zpoller_wait returns one ready reader per call. To handle many inputs
+    efficiently, call zpoller_wait_all, which returns every reader that
+    was ready in one poll, and then walk them with zpoller_ready_first
+    and zpoller_ready_next. By default, readers are returned in the order
+    you added them, so busy readers added early can starve later ones.
+    Call zpoller_set_fair to rotate the starting point on each poll.
 @end
 */
 
 #include "../include/czmq.h"
+#include "zpollset.h"
 
 //  Structure of our class
 
@@ -33,9 +46,17 @@ struct _zpoller_t {
     bool need_rebuild;          //  Does pollset needs rebuilding?
     bool expired;               //  Did poll timer expire?
     bool terminated;            //  Did poll call end with EINTR?
+    zpollset_t *epoll;          //  Epoll backend, if enabled
+    void **ready;               //  Readers found ready by last poll
+    size_t ready_size;          //  Number of ready readers
+    size_t ready_limit;         //  Allocated size of ready array
+    size_t ready_cursor;        //  Iterator position in ready array
+    size_t poll_start;          //  Where a fair poll starts looking
+    bool fair;                  //  Rotate readers round-robin?
 };
 
 static int s_rebuild_poll_set (zpoller_t *self);
+static int s_epoll_add (zpoller_t *self, void *reader);
 
 
 //  --------------------------------------------------------------------------
@@ -77,7 +98,9 @@ zpoller_destroy (zpoller_t **self_p)
     assert (self_p);
     if (*self_p) {
         zpoller_t *self = *self_p;
+        zpollset_destroy (&self->epoll);
         zlist_destroy (&self->reader_list);
+        free (self->ready);
         free (self->poll_readers);
         free (self->poll_set);
         free (self);
@@ -96,8 +119,14 @@ zpoller_add (zpoller_t *self, void *reader)
     assert (self);
     assert (reader);
     int rc = zlist_append (self->reader_list, reader);
-    if (rc != -1)
+    if (rc != -1) {
         self->need_rebuild = true;
+        if (self->epoll) {
+            rc = s_epoll_add (self, reader);
+            if (rc == -1)
+                zlist_remove (self->reader_list, reader);
+        }
+    }
     return rc;
 }
 
@@ -114,45 +143,190 @@ zpoller_remove (zpoller_t *self, void *reader)
     assert (reader);
     zlist_remove (self->reader_list, reader);
     self->need_rebuild = true;
+    if (self->epoll)
+        zpollset_remove (self->epoll, reader);
     return 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Poll the registered readers for I/O, return first reader that has input.
-//  The reader will be a libzmq void * socket, or a zsock_t or zactor_t
-//  instance as specified in zpoller_new/zpoller_add. The order that
-//  sockets are defined in the poll list affects their priority. If you
-//  need a balanced poll, use the low level zmq_poll method directly. If
-//  the poll call was interrupted (SIGINT), or the ZMQ context was
-//  destroyed, or the timeout expired, returns NULL. You can test the
-//  actual exit condition by calling zpoller_expired () and
-//  zpoller_terminated (). The timeout is in msec.
+//  Switch the poller to the epoll backend, or back to zmq_poll. The epoll
+//  backend suits large sets of readers, as adding or removing a reader
+//  does not rebuild the poll set, and waiting only looks at readers that
+//  are ready. Raw libzmq sockets are checked on every wait, so use zsock_t
+//  instead. Returns 0 if OK, -1 if epoll is not available on this
+//  platform, or failed.
 
-void *
-zpoller_wait (zpoller_t *self, int timeout)
+int
+zpoller_set_epoll (zpoller_t *self, bool epoll)
+{
+    assert (self);
+    if (epoll && !self->epoll) {
+        self->epoll = zpollset_new ();
+        if (!self->epoll)
+            return -1;
+        void *reader = zlist_first (self->reader_list);
+        while (reader) {
+            if (s_epoll_add (self, reader)) {
+                zpollset_destroy (&self->epoll);
+                return -1;
+            }
+            reader = zlist_next (self->reader_list);
+        }
+    }
+    else
+    if (!epoll && self->epoll) {
+        zpollset_destroy (&self->epoll);
+        self->need_rebuild = true;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Poll the registered readers once, and collect the ones that have input
+//  into the ready array. If fair, starts looking after the reader that came
+//  first last time. Returns the number of ready readers.
+
+static size_t
+s_poll (zpoller_t *self, int timeout)
 {
     self->expired = false;
     self->terminated = false;
-    if (self->need_rebuild)
-        s_rebuild_poll_set (self);
+    self->ready_size = 0;
+    self->ready_cursor = 0;
+
+    //  Make sure the ready array can hold every reader
+    size_t limit = zlist_size (self->reader_list);
+    if (self->ready_limit < limit) {
+        void **ready = (void **) realloc (self->ready, limit * sizeof (void *));
+        if (!ready)
+            return 0;
+        self->ready = ready;
+        self->ready_limit = limit;
+    }
+    int rc;
+    if (self->epoll) {
+        rc = zpollset_wait (self->epoll, timeout);
+        if (rc > 0) {
+            //  Epoll does not keep readers in order, so rotating the ready
+            //  set on each poll is the best we can do for fairness
+            size_t start = self->fair ? self->poll_start++ % rc : 0;
+            size_t index;
+            for (index = 0; index < (size_t) rc; index++) {
+                size_t item_nbr = (start + index) % rc;
+                if (zpollset_revents (self->epoll, item_nbr) & ZMQ_POLLIN)
+                    self->ready [self->ready_size++] =
+                        zpollset_tag (self->epoll, item_nbr);
+            }
+        }
+    }
+    else {
+        if (self->need_rebuild)
+            s_rebuild_poll_set (self);
 
-    int rc = zmq_poll (self->poll_set, (int) self->poll_size,
+        rc = zmq_poll (self->poll_set, (int) self->poll_size,
                        timeout * ZMQ_POLL_MSEC);
-    if (rc > 0) {
-        uint reader = 0;
-        for (reader = 0; reader < self->poll_size; reader++)
-            if (self->poll_set [reader].revents & ZMQ_POLLIN)
-                return self->poll_readers [reader];
+        if (rc > 0) {
+            size_t start = self->fair ? self->poll_start % self->poll_size : 0;
+            size_t index;
+            for (index = 0; index < self->poll_size; index++) {
+                size_t reader = (start + index) % self->poll_size;
+                if (self->poll_set [reader].revents & ZMQ_POLLIN) {
+                    if (self->fair && self->ready_size == 0)
+                        self->poll_start = reader + 1;
+                    self->ready [self->ready_size++] = self->poll_readers [reader];
+                }
+            }
+        }
     }
-    else
     if (rc == 0)
         self->expired = true;
     else
     if (rc == -1 || zsys_interrupted)
         self->terminated = true;
 
-    return NULL;
+    return self->ready_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Poll the registered readers for I/O, return first reader that has input.
+//  The reader will be a libzmq void * socket, or a zsock_t or zactor_t
+//  instance as specified in zpoller_new/zpoller_add. The order that
+//  sockets are defined in the poll list affects their priority, unless
+//  you called zpoller_set_fair. If you need to handle all ready readers
+//  at once, use zpoller_wait_all. If the poll call was interrupted
+//  (SIGINT), or the ZMQ context was destroyed, or the timeout expired,
+//  returns NULL. You can test the actual exit condition by calling
+//  zpoller_expired () and zpoller_terminated (). The timeout is in msec.
+
+void *
+zpoller_wait (zpoller_t *self, int timeout)
+{
+    assert (self);
+    if (s_poll (self, timeout))
+        return self->ready [0];
+    else
+        return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Poll the registered readers for I/O once, and return the number of
+//  readers that have input, or zero if the poll call was interrupted, or
+//  the ZMQ context was destroyed, or the timeout expired. Use
+//  zpoller_ready_first and zpoller_ready_next to get the readers. The
+//  timeout is in msec.
+
+size_t
+zpoller_wait_all (zpoller_t *self, int timeout)
+{
+    assert (self);
+    return s_poll (self, timeout);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the first reader that had input in the last zpoller_wait_all
+//  call, or NULL if none did.
+
+void *
+zpoller_ready_first (zpoller_t *self)
+{
+    assert (self);
+    self->ready_cursor = 0;
+    return zpoller_ready_next (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the next reader that had input in the last zpoller_wait_all
+//  call, or NULL if there are no more.
+
+void *
+zpoller_ready_next (zpoller_t *self)
+{
+    assert (self);
+    if (self->ready_cursor < self->ready_size)
+        return self->ready [self->ready_cursor++];
+    else
+        return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set whether polling is fair. If true, each poll starts looking at the
+//  reader after the one that came first last time, so readers are served
+//  round-robin, and a busy reader cannot starve the others. Default is
+//  false, so readers added first have priority.
+
+void
+zpoller_set_fair (zpoller_t *self, bool fair)
+{
+    assert (self);
+    self->fair = fair;
 }
 
 
@@ -196,6 +370,23 @@ s_rebuild_poll_set (zpoller_t *self)
 }
 
 
+//  Register a reader with the epoll backend; the reader is its own tag
+
+static int
+s_epoll_add (zpoller_t *self, void *reader)
+{
+    void *socket = zsock_resolve (reader);
+    if (socket == NULL)
+#ifdef _WIN32
+        return zpollset_add (self->epoll, NULL, *(SOCKET *) reader, ZMQ_POLLIN, reader);
+#else
+        return zpollset_add (self->epoll, NULL, *(int *) reader, ZMQ_POLLIN, reader);
+#endif
+    else
+        return zpollset_add (self->epoll, reader, 0, ZMQ_POLLIN, reader);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return true if the last zpoller_wait () call ended because the timeout
 //  expired, without any error.
@@ -278,6 +469,105 @@ zpoller_test (bool verbose)
     //  Destroy poller and sockets
     zpoller_destroy (&poller);
 
+    //  Same again, using the epoll backend if we have it
+    zsock_t *puller = zsock_new_pull ("inproc://zpoller.epoll");
+    assert (puller);
+    zsock_t *pusher = zsock_new_push ("inproc://zpoller.epoll");
+    assert (pusher);
+    poller = zpoller_new (dish, NULL);
+    assert (poller);
+    if (zpoller_set_epoll (poller, true) == 0) {
+        rc = zpoller_add (poller, puller);
+        assert (rc == 0);
+        zstr_send (pusher, "Hello, epoll");
+        which = (zsock_t *) zpoller_wait (poller, 500);
+        assert (which == puller);
+        message = zstr_recv (which);
+        assert (streq (message, "Hello, epoll"));
+        zstr_free (&message);
+
+        //  Nothing more to read, so the wait times out
+        assert (zpoller_wait (poller, 50) == NULL);
+        assert (zpoller_expired (poller));
+
+        //  Readers come and go without rebuilding the poll set
+        rc = zpoller_remove (poller, puller);
+        assert (rc == 0);
+        zstr_send (pusher, "Hello again, epoll");
+        assert (zpoller_wait (poller, 50) == NULL);
+        rc = zpoller_add (poller, puller);
+        assert (rc == 0);
+        assert (zpoller_wait (poller, 500) == puller);
+
+        //  Back to zmq_poll, which sees the same state
+        rc = zpoller_set_epoll (poller, false);
+        assert (rc == 0);
+        assert (zpoller_wait (poller, 500) == puller);
+        message = zstr_recv (puller);
+        assert (streq (message, "Hello again, epoll"));
+        zstr_free (&message);
+    }
+    zpoller_destroy (&poller);
+    zsock_destroy (&pusher);
+    zsock_destroy (&puller);
+
+    //  Get all ready readers from one poll
+    zsock_t *inputs [3];
+    zsock_t *outputs [3];
+    int index;
+    for (index = 0; index < 3; index++) {
+        char endpoint [32];
+        sprintf (endpoint, "inproc://zpoller.fair.%d", index);
+        inputs [index] = zsock_new_pull (endpoint);
+        assert (inputs [index]);
+        outputs [index] = zsock_new_push (endpoint);
+        assert (outputs [index]);
+    }
+    poller = zpoller_new (inputs [0], inputs [1], inputs [2], NULL);
+    assert (poller);
+    for (index = 0; index < 3; index++) {
+        zstr_send (outputs [index], "Hello");
+        zstr_send (outputs [index], "World");
+    }
+    zclock_sleep (10);
+    size_t ready = zpoller_wait_all (poller, 500);
+    assert (ready == 3);
+    assert (zpoller_ready_first (poller) == inputs [0]);
+    assert (zpoller_ready_next (poller) == inputs [1]);
+    assert (zpoller_ready_next (poller) == inputs [2]);
+    assert (zpoller_ready_next (poller) == NULL);
+
+    //  By default the first reader always wins, unless polling is fair
+    assert (zpoller_wait (poller, 0) == inputs [0]);
+    assert (zpoller_wait (poller, 0) == inputs [0]);
+    zpoller_set_fair (poller, true);
+    assert (zpoller_wait (poller, 0) == inputs [0]);
+    assert (zpoller_wait (poller, 0) == inputs [1]);
+    assert (zpoller_wait (poller, 0) == inputs [2]);
+    assert (zpoller_wait (poller, 0) == inputs [0]);
+    ready = zpoller_wait_all (poller, 0);
+    assert (ready == 3);
+    assert (zpoller_ready_first (poller) == inputs [1]);
+
+    //  Drain everything, one poll at a time
+    int received = 0;
+    while (zpoller_wait_all (poller, 0)) {
+        zsock_t *reader = (zsock_t *) zpoller_ready_first (poller);
+        while (reader) {
+            message = zstr_recv (reader);
+            zstr_free (&message);
+            received++;
+            reader = (zsock_t *) zpoller_ready_next (poller);
+        }
+    }
+    assert (received == 6);
+    assert (zpoller_expired (poller));
+    zpoller_destroy (&poller);
+    for (index = 0; index < 3; index++) {
+        zsock_destroy (&inputs [index]);
+        zsock_destroy (&outputs [index]);
+    }
+
     zsock_destroy (&vent);
     zsock_destroy (&sink);
     zsock_destroy (&bowl);
@@ -0,0 +1,691 @@
+/*  =========================================================================
+    zpollset - incremental readiness-based poll set, used internally
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zpollset class is an alternative to zmq_poll for large poll sets,
+    used by zloop and zpoller when you ask for their epoll backend. Items
+    are added and removed one at a time, and each wait returns only the
+    items that are ready, so the cost of a wakeup does not grow with the
+    number of items. It is only available on Linux.
+@discuss
+    File descriptors are registered with epoll as they are. For a ZeroMQ
+    socket, we register its ZMQ_FD, edge-triggered. This only tells us that
+    the socket state may have changed, so we then check ZMQ_EVENTS. The
+    catch is that any operation on a socket can consume that signal. So we
+    recheck a socket before each wait if it was ready last time, or if it
+    has been used since: a zsock_t flags itself dirty when it is resolved,
+    which happens on every send and receive, and tells the poll sets that
+    watch it only when the flag goes up. A poll set clears the flag when it
+    rechecks the socket. Raw libzmq sockets cannot do that, so they stay on
+    the recheck list for good, and cost a ZMQ_EVENTS call on every wait;
+    use zsock_t or zactor_t instances for large poll sets.
+@end
+*/
+
+#include "../include/czmq.h"
+#include "zpollset.h"
+#if defined (__UTYPE_LINUX)
+#   include <sys/epoll.h>
+#endif
+
+#define MAX_EVENTS    256       //  Epoll events collected per call
+
+//  Poll set item, used internally only
+
+typedef struct _item_t {
+    void *tag;                  //  Caller's tag for this item
+    size_t refs;                //  Number of times item was added
+    void *socket;               //  libzmq socket, or NULL for a descriptor
+    zsock_t *sock;              //  CZMQ socket that tells us when it's used
+    SOCKET fd;                  //  Descriptor registered with epoll
+    bool own_fd;                //  True if we duplicated the descriptor
+    short events;               //  Events we are polling for
+    size_t ready_pass;          //  Last wait in which item was ready
+    size_t ready_index;         //  Position in ready array, in that wait
+    bool pending;               //  Recheck socket state before waiting?
+    struct _item_t *pending_prev;
+    struct _item_t *pending_next;
+    struct _item_t *sock_next;  //  Next item watching the same zsock
+} item_t;
+
+//  Ready item, as returned to the caller
+
+typedef struct {
+    void *tag;                  //  Caller's tag for the item
+    short revents;              //  Events found on the item
+} ready_t;
+
+
+//  ---------------------------------------------------------------------
+//  Structure of our class
+
+struct _zpollset_t {
+    int handle;                 //  Epoll descriptor
+    zhash_t *items;             //  Items, keyed by tag
+    zhash_t *socks;             //  First item for each zsock, keyed by zsock
+    item_t *pending;            //  Sockets to recheck before waiting
+    ready_t *ready;             //  Items found ready by last wait
+    size_t ready_size;          //  Number of items in ready array
+    size_t ready_limit;         //  Allocated size of ready array
+    size_t pass;                //  Counts calls to zpollset_wait
+#if defined (__UTYPE_LINUX)
+    struct epoll_event events [MAX_EVENTS];
+#endif
+};
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Our hash tables are keyed by pointer, which we hash and compare as is
+
+static size_t
+s_pointer_hash (const void *key)
+{
+    return (size_t) key;
+}
+
+static int
+s_pointer_compare (const void *key1, const void *key2)
+{
+    return key1 != key2;
+}
+
+static zhash_t *
+s_pointer_table_new (void)
+{
+    zhash_t *table = zhash_new_compact ();
+    if (table) {
+        zhash_set_key_hasher (table, s_pointer_hash);
+        zhash_set_key_comparator (table, s_pointer_compare);
+        zhash_set_key_duplicator (table, NULL);
+        zhash_set_key_destructor (table, NULL);
+    }
+    return table;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new, empty poll set. Returns NULL if the platform does not
+//  support epoll, or the process ran out of resources.
+
+zpollset_t *
+zpollset_new (void)
+{
+#if defined (__UTYPE_LINUX)
+    zpollset_t *self = (zpollset_t *) zmalloc (sizeof (zpollset_t));
+    if (self) {
+        self->handle = epoll_create1 (EPOLL_CLOEXEC);
+        if (self->handle != -1)
+            self->items = s_pointer_table_new ();
+        if (self->items)
+            self->socks = s_pointer_table_new ();
+        if (!self->socks)
+            zpollset_destroy (&self);
+    }
+    return self;
+#else
+    return NULL;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a poll set
+
+void
+zpollset_destroy (zpollset_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zpollset_t *self = *self_p;
+        if (self->socks) {
+            item_t *item = (item_t *) zhash_first (self->socks);
+            while (item) {
+                zsock_remove_watcher (item->sock, self);
+                item = (item_t *) zhash_next (self->socks);
+            }
+        }
+        if (self->items) {
+            item_t *item = (item_t *) zhash_first (self->items);
+            while (item) {
+                if (item->own_fd)
+                    close (item->fd);
+                free (item);
+                item = (item_t *) zhash_next (self->items);
+            }
+            zhash_destroy (&self->items);
+        }
+        zhash_destroy (&self->socks);
+        if (self->handle != -1)
+            close (self->handle);
+        free (self->ready);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Add socket item to, or remove it from, the list we recheck before waiting
+
+static void
+s_pending_link (zpollset_t *self, item_t *item)
+{
+    if (!item->pending) {
+        item->pending_prev = NULL;
+        item->pending_next = self->pending;
+        if (self->pending)
+            self->pending->pending_prev = item;
+        self->pending = item;
+        item->pending = true;
+    }
+}
+
+static void
+s_pending_unlink (zpollset_t *self, item_t *item)
+{
+    if (item->pending) {
+        if (item->pending_prev)
+            item->pending_prev->pending_next = item->pending_next;
+        else
+            self->pending = item->pending_next;
+        if (item->pending_next)
+            item->pending_next->pending_prev = item->pending_prev;
+        item->pending = false;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add an item to the poll set. The socket may be a zsock_t, a zactor_t, or
+//  a libzmq socket; if it is NULL, polls the file descriptor instead. The
+//  events are ZMQ_POLLIN and/or ZMQ_POLLOUT. The tag is returned when the
+//  item is ready, and must be unique; adding the same tag again just counts
+//  another reference to it. A raw libzmq socket is rechecked on every wait,
+//  as the poll set cannot tell when it is used. Returns 0 if OK, -1 on
+//  failure.
+
+int
+zpollset_add (zpollset_t *self, void *socket, SOCKET fd, short events, void *tag)
+{
+    assert (self);
+    assert (tag);
+#if defined (__UTYPE_LINUX)
+    item_t *item = (item_t *) zhash_lookup (self->items, tag);
+    if (item) {
+        item->refs++;
+        return 0;
+    }
+    //  Make sure the ready array can hold every item, so that waiting
+    //  never needs to allocate memory
+    if (self->ready_limit < zhash_size (self->items) + 1) {
+        size_t limit = self->ready_limit ? self->ready_limit * 2 : 16;
+        ready_t *ready = (ready_t *) realloc (self->ready, limit * sizeof (ready_t));
+        if (!ready)
+            return -1;
+        self->ready = ready;
+        self->ready_limit = limit;
+    }
+    item = (item_t *) zmalloc (sizeof (item_t));
+    if (!item)
+        return -1;
+    item->tag = tag;
+    item->refs = 1;
+    item->events = events;
+
+    struct epoll_event event = { 0 };
+    if (socket) {
+        //  Remember the zsock, if any, so it can tell us when it's used
+        if (zsock_is (socket))
+            item->sock = (zsock_t *) socket;
+        else
+        if (zactor_is (socket))
+            item->sock = zactor_sock ((zactor_t *) socket);
+        item->socket = zsock_resolve (socket);
+        size_t fd_size = sizeof (SOCKET);
+        if (!item->socket
+        ||  zmq_getsockopt (item->socket, ZMQ_FD, &item->fd, &fd_size)) {
+            free (item);
+            return -1;
+        }
+        //  ZMQ_FD signals changes, not state, so we watch for edges
+        event.events = EPOLLIN | EPOLLET;
+    }
+    else {
+        item->fd = fd;
+        event.events = ((events & ZMQ_POLLIN) ? EPOLLIN : 0)
+                     | ((events & ZMQ_POLLOUT) ? EPOLLOUT : 0);
+    }
+    event.data.ptr = item;
+    int rc = epoll_ctl (self->handle, EPOLL_CTL_ADD, item->fd, &event);
+    if (rc == -1 && errno == EEXIST) {
+        //  Epoll holds one registration per descriptor, so if another
+        //  item uses the same descriptor, we register a duplicate
+        item->fd = dup (item->fd);
+        item->own_fd = true;
+        if (item->fd != -1)
+            rc = epoll_ctl (self->handle, EPOLL_CTL_ADD, item->fd, &event);
+    }
+    if (rc == 0) {
+        rc = zhash_insert (self->items, tag, item);
+        if (rc == 0 && item->sock) {
+            //  The first item for a zsock makes us one of its watchers
+            item->sock_next = (item_t *) zhash_lookup (self->socks, item->sock);
+            if (!item->sock_next && zsock_add_watcher (item->sock, self)) {
+                zhash_delete (self->items, tag);
+                rc = -1;
+            }
+        }
+        if (rc)
+            epoll_ctl (self->handle, EPOLL_CTL_DEL, item->fd, NULL);
+    }
+    if (rc) {
+        if (item->own_fd && item->fd != -1)
+            close (item->fd);
+        free (item);
+        return -1;
+    }
+    if (item->sock)
+        zhash_update (self->socks, item->sock, item);
+    //  Socket may already be ready, and we'd never see an edge for that
+    if (item->socket)
+        s_pending_link (self, item);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Remove a reference to the item with the specified tag, and remove the
+//  item when it has no more references. Does nothing if there is no such
+//  item.
+
+void
+zpollset_remove (zpollset_t *self, void *tag)
+{
+    assert (self);
+    assert (tag);
+#if defined (__UTYPE_LINUX)
+    item_t *item = (item_t *) zhash_lookup (self->items, tag);
+    if (!item || --item->refs)
+        return;
+
+    zhash_delete (self->items, tag);
+    if (item->fd != -1)
+        epoll_ctl (self->handle, EPOLL_CTL_DEL, item->fd, NULL);
+    if (item->own_fd)
+        close (item->fd);
+    s_pending_unlink (self, item);
+    if (item->sock) {
+        item_t *first = (item_t *) zhash_lookup (self->socks, item->sock);
+        if (first == item) {
+            if (item->sock_next)
+                zhash_update (self->socks, item->sock, item->sock_next);
+            else {
+                zhash_delete (self->socks, item->sock);
+                zsock_remove_watcher (item->sock, self);
+            }
+        }
+        else {
+            while (first->sock_next != item)
+                first = first->sock_next;
+            first->sock_next = item->sock_next;
+        }
+    }
+    free (item);
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return the events the caller wants that a socket is ready for, or
+//  -1 if the context was terminated.
+
+static short
+s_socket_events (item_t *item)
+{
+    int events;
+    size_t events_size = sizeof (int);
+    if (zmq_getsockopt (item->socket, ZMQ_EVENTS, &events, &events_size) == -1)
+        return zmq_errno () == ETERM ? -1 : ZMQ_POLLERR;
+    return (short) (events & item->events);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Add item to the ready array, once per wait
+
+static void
+s_ready_add (zpollset_t *self, item_t *item, short revents)
+{
+    if (item->ready_pass == self->pass)
+        self->ready [item->ready_index].revents |= revents;
+    else {
+        assert (self->ready_size < self->ready_limit);
+        item->ready_pass = self->pass;
+        item->ready_index = self->ready_size++;
+        self->ready [item->ready_index].tag = item->tag;
+        self->ready [item->ready_index].revents = revents;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Wait for items to become ready, for up to timeout msecs, or forever if
+//  timeout is -1. Returns the number of ready items, 0 if the timeout
+//  expired, or -1 if the call was interrupted or the context terminated.
+
+int
+zpollset_wait (zpollset_t *self, int timeout)
+{
+    assert (self);
+#if defined (__UTYPE_LINUX)
+    self->pass++;
+    self->ready_size = 0;
+
+    //  Recheck sockets that may have changed state without a signal on
+    //  their ZMQ_FD. The ones that are not ready drop off the list until
+    //  their ZMQ_FD fires or they are used again, except for raw libzmq
+    //  sockets, which cannot tell us when they are used.
+    item_t *item = self->pending;
+    while (item) {
+        item_t *next = item->pending_next;
+        if (item->sock)
+            zsock_set_clean (item->sock);
+        short revents = s_socket_events (item);
+        if (revents == -1)
+            return -1;
+        if (revents)
+            s_ready_add (self, item, revents);
+        else
+        if (item->sock)
+            s_pending_unlink (self, item);
+        item = next;
+    }
+    int64_t deadline = zclock_mono () + timeout;
+    while (true) {
+        //  If we already have ready items, just collect any others
+        int wait = timeout;
+        if (self->ready_size)
+            wait = 0;
+        else
+        if (timeout > 0) {
+            int64_t remaining = deadline - zclock_mono ();
+            wait = remaining > 0 ? (int) remaining : 0;
+        }
+        int rc = epoll_wait (self->handle, self->events, MAX_EVENTS, wait);
+        if (rc == -1)
+            return -1;          //  Interrupted
+
+        int index;
+        for (index = 0; index < rc; index++) {
+            item = (item_t *) self->events [index].data.ptr;
+            uint32_t events = self->events [index].events;
+            if (item->socket) {
+                //  Socket state may have changed, so look at it
+                short revents = s_socket_events (item);
+                if (revents == -1)
+                    return -1;
+                if (revents) {
+                    s_ready_add (self, item, revents);
+                    s_pending_link (self, item);
+                }
+            }
+            else {
+                short revents = 0;
+                if (events & EPOLLIN)
+                    revents |= ZMQ_POLLIN;
+                if (events & EPOLLOUT)
+                    revents |= ZMQ_POLLOUT;
+                if (events & ~(EPOLLIN | EPOLLOUT))
+                    revents |= ZMQ_POLLERR;
+                s_ready_add (self, item, revents);
+            }
+        }
+        //  A socket signal may turn out to be nothing we want, in which
+        //  case we wait again, for whatever time is left
+        if (self->ready_size || wait == 0)
+            break;
+    }
+    return (int) self->ready_size;
+#else
+    return -1;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the tag of the ready item at the specified index, after a call
+//  to zpollset_wait.
+
+void *
+zpollset_tag (zpollset_t *self, size_t index)
+{
+    assert (self);
+    assert (index < self->ready_size);
+    return self->ready [index].tag;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the events found on the ready item at the specified index, after
+//  a call to zpollset_wait. This is ZMQ_POLLIN, ZMQ_POLLOUT, ZMQ_POLLERR,
+//  or a combination.
+
+short
+zpollset_revents (zpollset_t *self, size_t index)
+{
+    assert (self);
+    assert (index < self->ready_size);
+    return self->ready [index].revents;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Tell the poll set that a socket it watches was used, so its state may
+//  have changed without any signal on its ZMQ_FD. Called from zsock.
+
+void
+zpollset_touch (zpollset_t *self, zsock_t *sock)
+{
+    assert (self);
+    item_t *item = (item_t *) zhash_lookup (self->socks, sock);
+    while (item) {
+        s_pending_link (self, item);
+        item = item->sock_next;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Tell the poll set that a socket it watches is being destroyed. Called
+//  from zsock.
+
+void
+zpollset_forget (zpollset_t *self, zsock_t *sock)
+{
+    assert (self);
+#if defined (__UTYPE_LINUX)
+    //  Items stay in the poll set until they are removed, but we don't
+    //  look at the socket, or its descriptor, any more
+    item_t *item = (item_t *) zhash_lookup (self->socks, sock);
+    while (item) {
+        epoll_ctl (self->handle, EPOLL_CTL_DEL, item->fd, NULL);
+        if (item->own_fd)
+            close (item->fd);
+        item->own_fd = false;
+        item->fd = -1;
+        s_pending_unlink (self, item);
+        item->sock = NULL;
+        item->socket = NULL;
+        item = item->sock_next;
+    }
+    zhash_delete (self->socks, sock);
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+zpollset_test (bool verbose)
+{
+    printf (" * zpollset: ");
+
+    //  @selftest
+    zpollset_t *pollset = zpollset_new ();
+    if (!pollset) {
+        printf ("not available on this platform\n");
+        return;
+    }
+    zsock_t *sink = zsock_new_pair ("@inproc://zpollset.test");
+    assert (sink);
+    zsock_t *source = zsock_new_pair (">inproc://zpollset.test");
+    assert (source);
+
+    int rc = zpollset_add (pollset, sink, 0, ZMQ_POLLIN, sink);
+    assert (rc == 0);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+
+    //  Socket stays ready until we've read everything from it
+    zstr_send (source, "Hello");
+    zstr_send (source, "World");
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 1);
+    assert (zpollset_tag (pollset, 0) == sink);
+    assert (zpollset_revents (pollset, 0) == ZMQ_POLLIN);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 1);
+    char *string = zstr_recv (sink);
+    zstr_free (&string);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 1);
+    string = zstr_recv (sink);
+    zstr_free (&string);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+
+    //  Sending on the socket we're reading from swallows the ZMQ_FD signal
+    //  for incoming messages, but the socket tells us it was used
+    zstr_send (source, "Hello");
+    zclock_sleep (10);
+    zstr_send (sink, "Ping");
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 1);
+    string = zstr_recv (sink);
+    assert (streq (string, "Hello"));
+    zstr_free (&string);
+    string = zstr_recv (source);
+    zstr_free (&string);
+
+    //  Same socket registered twice, under different tags
+    rc = zpollset_add (pollset, sink, 0, ZMQ_POLLIN, source);
+    assert (rc == 0);
+    rc = zpollset_add (pollset, sink, 0, ZMQ_POLLIN, source);
+    assert (rc == 0);
+    zstr_send (source, "Hello");
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 2);
+    zpollset_remove (pollset, source);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 2);
+    zpollset_remove (pollset, source);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 1);
+    string = zstr_recv (sink);
+    zstr_free (&string);
+
+    //  Descriptors are polled as they are
+    int fds [2];
+    rc = pipe (fds);
+    assert (rc == 0);
+    rc = zpollset_add (pollset, NULL, fds [0], ZMQ_POLLIN, &fds [0]);
+    assert (rc == 0);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+    rc = write (fds [1], "x", 1);
+    assert (rc == 1);
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 1);
+    assert (zpollset_tag (pollset, 0) == &fds [0]);
+
+    //  Waiting times out when nothing is ready
+    zpollset_remove (pollset, &fds [0]);
+    int64_t start = zclock_mono ();
+    rc = zpollset_wait (pollset, 50);
+    assert (rc == 0);
+    assert (zclock_mono () - start >= 45);
+    close (fds [0]);
+    close (fds [1]);
+
+    //  A socket may be in several poll sets, and each of them hears when
+    //  it is used, or destroyed
+    zpollset_t *second = zpollset_new ();
+    assert (second);
+    rc = zpollset_add (second, sink, 0, ZMQ_POLLIN, sink);
+    assert (rc == 0);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+    rc = zpollset_wait (second, 0);
+    assert (rc == 0);
+    zstr_send (source, "Hello");
+    zclock_sleep (10);
+    zstr_send (sink, "Ping");
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 1);
+    rc = zpollset_wait (second, 1000);
+    assert (rc == 1);
+    string = zstr_recv (source);
+    zstr_free (&string);
+
+    //  Once a poll set has rechecked the socket, the next use reaches
+    //  both poll sets again
+    string = zstr_recv (sink);
+    zstr_free (&string);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+    rc = zpollset_wait (second, 0);
+    assert (rc == 0);
+    zstr_send (source, "Hello");
+    zclock_sleep (10);
+    zstr_send (sink, "Ping");
+    rc = zpollset_wait (second, 1000);
+    assert (rc == 1);
+    rc = zpollset_wait (pollset, 1000);
+    assert (rc == 1);
+    string = zstr_recv (source);
+    zstr_free (&string);
+    void *tag = sink;
+    zsock_destroy (&sink);
+    rc = zpollset_wait (pollset, 0);
+    assert (rc == 0);
+    rc = zpollset_wait (second, 0);
+    assert (rc == 0);
+    zpollset_remove (second, tag);
+    zpollset_destroy (&second);
+    zpollset_remove (pollset, tag);
+    zpollset_destroy (&pollset);
+    assert (pollset == NULL);
+    zsock_destroy (&source);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,95 @@
+/*  =========================================================================
+    zpollset - incremental readiness-based poll set, used internally
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZPOLLSET_H_INCLUDED__
+#define __ZPOLLSET_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Opaque class structure
+typedef struct _zpollset_t zpollset_t;
+
+//  @interface
+//  Create a new, empty poll set. Returns NULL if the platform does not
+//  support epoll, or the process ran out of resources.
+CZMQ_EXPORT zpollset_t *
+    zpollset_new (void);
+
+//  Destroy a poll set
+CZMQ_EXPORT void
+    zpollset_destroy (zpollset_t **self_p);
+
+//  Add an item to the poll set. The socket may be a zsock_t, a zactor_t, or
+//  a libzmq socket; if it is NULL, polls the file descriptor instead. The
+//  events are ZMQ_POLLIN and/or ZMQ_POLLOUT. The tag is returned when the
+//  item is ready, and must be unique; adding the same tag again just counts
+//  another reference to it. A raw libzmq socket is rechecked on every wait,
+//  as the poll set cannot tell when it is used. Returns 0 if OK, -1 on
+//  failure.
+CZMQ_EXPORT int
+    zpollset_add (zpollset_t *self, void *socket, SOCKET fd, short events, void *tag);
+
+//  Remove a reference to the item with the specified tag, and remove the
+//  item when it has no more references. Does nothing if there is no such
+//  item.
+CZMQ_EXPORT void
+    zpollset_remove (zpollset_t *self, void *tag);
+
+//  Wait for items to become ready, for up to timeout msecs, or forever if
+//  timeout is -1. Returns the number of ready items, 0 if the timeout
+//  expired, or -1 if the call was interrupted or the context terminated.
+CZMQ_EXPORT int
+    zpollset_wait (zpollset_t *self, int timeout);
+
+//  Return the tag of the ready item at the specified index, after a call
+//  to zpollset_wait.
+CZMQ_EXPORT void *
+    zpollset_tag (zpollset_t *self, size_t index);
+
+//  Return the events found on the ready item at the specified index, after
+//  a call to zpollset_wait. This is ZMQ_POLLIN, ZMQ_POLLOUT, ZMQ_POLLERR,
+//  or a combination.
+CZMQ_EXPORT short
+    zpollset_revents (zpollset_t *self, size_t index);
+
+//  Tell the poll set that a socket it watches was used, so its state may
+//  have changed without any signal on its ZMQ_FD. Called from zsock.
+CZMQ_EXPORT void
+    zpollset_touch (zpollset_t *self, zsock_t *sock);
+
+//  Tell the poll set that a socket it watches is being destroyed. Called
+//  from zsock.
+CZMQ_EXPORT void
+    zpollset_forget (zpollset_t *self, zsock_t *sock);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zpollset_test (bool verbose);
+//  @end
+
+//  Add or remove a poll set that watches a socket, or tell the socket that
+//  a poll set is rechecking it; implemented by zsock
+CZMQ_EXPORT int
+    zsock_add_watcher (zsock_t *self, zpollset_t *watcher);
+CZMQ_EXPORT void
+    zsock_remove_watcher (zsock_t *self, zpollset_t *watcher);
+CZMQ_EXPORT void
+    zsock_set_clean (zsock_t *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,455 @@
+/*  =========================================================================
+    zqueue - lock-free queue between threads
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zqueue class passes pointers, or zmsg_t messages, from one or more
+    threads to a single receiving thread, without going through a ZeroMQ
+    socket. It is a bounded ring buffer, and threads send and receive items
+    without taking any locks. A queue is also a file descriptor, readable
+    while the queue has items, so you can wait for it in a zpoller or zloop,
+    together with your sockets.
+@discuss
+    The ring is the bounded queue by Dmitry Vyukov: each cell carries a
+    sequence number that tells senders and the receiver whether the cell is
+    free or full. A sender only touches the descriptor when the queue was
+    empty, so a burst of items costs one system call to send, and one to
+    receive. zqueue uses a zsignal_t for its descriptor, and is available
+    wherever zsignal is.
+@end
+*/
+
+#include "../include/czmq.h"
+
+//  Senders and the receiver work at different ends of the ring, so we
+//  keep these on separate cache lines
+#define CACHE_LINE  64
+
+#if defined (__WINDOWS__)
+#   define s_cas(ptr,old,new) \
+        (InterlockedCompareExchangePointer ((PVOID volatile *) (ptr), \
+            (PVOID) (new), (PVOID) (old)) == (PVOID) (old))
+#   define s_barrier() MemoryBarrier ()
+#else
+#   define s_cas(ptr,old,new) __sync_bool_compare_and_swap (ptr, old, new)
+#   define s_barrier() __sync_synchronize ()
+#endif
+
+//  A cell in the ring
+
+typedef struct {
+    volatile size_t sequence;   //  Position the cell is ready for
+    void *item;                 //  Item, if cell is full
+} cell_t;
+
+//  Structure of our class
+
+struct _zqueue_t {
+    SOCKET fd;                  //  Readable end of signal, must come first
+    zsignal_t *signal;          //  Raised while queue has items
+    cell_t *cells;              //  Ring of cells
+    size_t mask;                //  Number of cells, less one
+    bool msgs;                  //  Queue carries zmsg_t items
+    volatile size_t signalled;  //  1 while signal is raised
+    byte pad1 [CACHE_LINE];
+    volatile size_t tail;       //  Next position senders write to
+    byte pad2 [CACHE_LINE];
+    volatile size_t head;       //  Next position receiver reads from
+    byte pad3 [CACHE_LINE];
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a new queue that holds up to limit items. The limit is rounded
+//  up to a power of two. Returns NULL if the platform does not support
+//  queues, or the process ran out of memory.
+
+zqueue_t *
+zqueue_new (size_t limit)
+{
+    zqueue_t *self = (zqueue_t *) zmalloc (sizeof (zqueue_t));
+    if (!self)
+        return NULL;
+
+    //  The ring needs at least two cells to tell full from empty
+    size_t size = 2;
+    while (size < limit)
+        size *= 2;
+    self->signal = zsignal_new ();
+    self->cells = (cell_t *) zmalloc (size * sizeof (cell_t));
+    if (!self->signal || !self->cells) {
+        zqueue_destroy (&self);
+        return NULL;
+    }
+    self->fd = zsignal_fd (self->signal);
+    self->mask = size - 1;
+    size_t index;
+    for (index = 0; index < size; index++)
+        self->cells [index].sequence = index;
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Add an item at the tail of the ring. Returns 0 if OK, -1 if the ring is
+//  full.
+
+static int
+s_ring_push (zqueue_t *self, void *item)
+{
+    size_t position = self->tail;
+    while (true) {
+        cell_t *cell = &self->cells [position & self->mask];
+        intptr_t lag = (intptr_t) cell->sequence - (intptr_t) position;
+        if (lag == 0) {
+            //  Cell is free; claim it, unless another sender got there
+            //  first
+            if (s_cas (&self->tail, position, position + 1)) {
+                cell->item = item;
+                s_barrier ();   //  Item must be visible before sequence
+                cell->sequence = position + 1;
+                return 0;
+            }
+        }
+        else
+        if (lag < 0)
+            return -1;          //  Receiver has not taken this cell yet
+        position = self->tail;
+    }
+}
+
+//  Take the item at the head of the ring. Returns NULL if the ring is empty,
+//  or the sender of the next item has not finished writing it.
+
+static void *
+s_ring_pop (zqueue_t *self)
+{
+    size_t position = self->head;
+    cell_t *cell = &self->cells [position & self->mask];
+    if (cell->sequence != position + 1)
+        return NULL;
+    s_barrier ();               //  Read item only after sequence
+    void *item = cell->item;
+    s_barrier ();               //  Free cell only after reading item
+    cell->sequence = position + self->mask + 1;
+    self->head = position + 1;
+    return item;
+}
+
+static bool
+s_ring_empty (zqueue_t *self)
+{
+    size_t position = self->head;
+    return self->cells [position & self->mask].sequence != position + 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a queue. Messages still in the queue are destroyed; other items
+//  are dropped, and remain the caller's problem.
+
+void
+zqueue_destroy (zqueue_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zqueue_t *self = *self_p;
+        if (self->cells && self->msgs) {
+            zmsg_t *msg;
+            while ((msg = (zmsg_t *) s_ring_pop (self)))
+                zmsg_destroy (&msg);
+        }
+        free (self->cells);
+        zsignal_destroy (&self->signal);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add an item, which may not be NULL, to the queue. Any thread may call
+//  this. Returns 0 if OK, -1 if the queue is full.
+
+int
+zqueue_send (zqueue_t *self, void *item)
+{
+    assert (self);
+    assert (item);
+    if (s_ring_push (self, item))
+        return -1;
+
+    //  Raise the signal unless it's already raised. The receiver lowers
+    //  it once it sees the ring empty, and then looks at the ring again,
+    //  so one of us will always see the other's change.
+    s_barrier ();
+    if (!self->signalled && s_cas (&self->signalled, 0, 1))
+        zsignal_send (self->signal, 0);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Lower the signal if the ring is empty, so that pollers stop waking up.
+//  If a sender added an item meanwhile, raise the signal again. A sender
+//  that was late raising the signal can leave it raised with the ring
+//  empty; we clear that the next time we get here.
+
+static void
+s_queue_settle (zqueue_t *self)
+{
+    if (s_ring_empty (self)) {
+        while (zsignal_wait (self->signal, 0) != -1)
+            ;                   //  Take all pending signals
+        self->signalled = 0;
+        s_barrier ();
+        if (!s_ring_empty (self) && s_cas (&self->signalled, 0, 1))
+            zsignal_send (self->signal, 0);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Take the oldest item from the queue, waiting for up to timeout msecs,
+//  or forever if timeout is -1. Only one thread may receive from a queue.
+//  Returns NULL if the timeout expired or the call was interrupted.
+
+void *
+zqueue_recv (zqueue_t *self, int timeout)
+{
+    assert (self);
+    int64_t deadline = zclock_mono () + timeout;
+    while (true) {
+        void *item = s_ring_pop (self);
+        s_queue_settle (self);
+        if (item || timeout == 0)
+            return item;
+
+        int64_t wait = timeout;
+        if (timeout > 0) {
+            wait = deadline - zclock_mono ();
+            if (wait <= 0)
+                return NULL;
+        }
+        zmq_pollitem_t pollitem = { NULL, self->fd, ZMQ_POLLIN, 0 };
+        if (zmq_poll (&pollitem, 1, (long) wait * ZMQ_POLL_MSEC) == -1)
+            return NULL;        //  Interrupted
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a message to the queue, and take ownership of it. A queue carries
+//  either messages or other items, not both. Returns 0 if OK, or -1 if the
+//  queue is full, and then the caller still owns the message.
+
+int
+zqueue_send_msg (zqueue_t *self, zmsg_t **msg_p)
+{
+    assert (self);
+    assert (msg_p);
+    assert (zmsg_is (*msg_p));
+    self->msgs = true;
+    if (zqueue_send (self, *msg_p))
+        return -1;
+    *msg_p = NULL;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Take the oldest message from the queue, as for zqueue_recv. The caller
+//  owns the message, and must destroy it when finished with it.
+
+zmsg_t *
+zqueue_recv_msg (zqueue_t *self, int timeout)
+{
+    zmsg_t *msg = (zmsg_t *) zqueue_recv (self, timeout);
+    assert (!msg || zmsg_is (msg));
+    return msg;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of items in the queue. While other threads are using
+//  the queue, this is only a hint.
+
+size_t
+zqueue_size (zqueue_t *self)
+{
+    assert (self);
+    size_t head = self->head;
+    size_t tail = self->tail;
+    return tail > head? tail - head: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the file descriptor that is readable while the queue has items.
+//  A zqueue_t also starts with this descriptor, so you can pass it as-is
+//  to zpoller_add, and to zloop_reader cast to a zsock_t *.
+
+SOCKET
+zqueue_fd (zqueue_t *self)
+{
+    assert (self);
+    return self->fd;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+#define ITEMS 10000             //  Items per sender
+
+typedef struct {
+    zqueue_t *queue;            //  Queue to send to
+    size_t id;                  //  Our sender number
+} sender_t;
+
+static void
+s_sender_actor (zsock_t *pipe, void *args)
+{
+    sender_t *sender = (sender_t *) args;
+    zsock_signal (pipe, 0);
+    size_t index;
+    for (index = 0; index < ITEMS; index++) {
+        void *item = (void *) (sender->id * ITEMS + index + 1);
+        while (zqueue_send (sender->queue, item))
+            zclock_sleep (1);   //  Queue is full
+    }
+    char *command = zstr_recv (pipe);
+    free (command);
+}
+
+static int
+s_queue_reader (zloop_t *loop, zsock_t *reader, void *args)
+{
+    size_t *count = (size_t *) args;
+    if (zqueue_recv ((zqueue_t *) reader, 0))
+        (*count)++;
+    return *count == 3? -1: 0;
+}
+
+void
+zqueue_test (bool verbose)
+{
+    printf (" * zqueue: ");
+
+    //  @selftest
+#if defined (__UNIX__)
+    zqueue_t *queue = zqueue_new (3);
+    assert (queue);
+    assert (zqueue_fd (queue) != INVALID_SOCKET);
+
+    //  Queue is first in, first out, and holds up to its limit
+    int rc;
+    char *items = "ABCDE";
+    for (rc = 0; rc < 4; rc++)
+        assert (zqueue_send (queue, items + rc) == 0);
+    assert (zqueue_send (queue, items + 4) == -1);
+    assert (zqueue_size (queue) == 4);
+    for (rc = 0; rc < 4; rc++)
+        assert (zqueue_recv (queue, 0) == items + rc);
+    assert (zqueue_size (queue) == 0);
+    assert (zqueue_recv (queue, 0) == NULL);
+
+    //  Receive times out if queue stays empty
+    int64_t start = zclock_mono ();
+    assert (zqueue_recv (queue, 20) == NULL);
+    assert (zclock_mono () - start >= 20);
+
+    //  Queue can be polled alongside sockets, while it has items
+    zpoller_t *poller = zpoller_new (queue, NULL);
+    assert (poller);
+    assert (zpoller_wait (poller, 0) == NULL);
+    zqueue_send (queue, items);
+    zqueue_send (queue, items + 1);
+    assert (zpoller_wait (poller, 0) == queue);
+    assert (zqueue_recv (queue, 0) == items);
+    assert (zpoller_wait (poller, 0) == queue);
+    assert (zqueue_recv (queue, 0) == items + 1);
+    assert (zpoller_wait (poller, 0) == NULL);
+    zpoller_destroy (&poller);
+
+    //  Queue can be a reader in a zloop, with either backend
+    size_t count;
+    int epoll;
+    for (epoll = 0; epoll < 2; epoll++) {
+        zloop_t *loop = zloop_new ();
+        assert (loop);
+        if (epoll && zloop_set_epoll (loop, true)) {
+            zloop_destroy (&loop);
+            break;              //  No epoll on this platform
+        }
+        count = 0;
+        rc = zloop_reader (loop, (zsock_t *) queue, s_queue_reader, &count);
+        assert (rc == 0);
+        for (rc = 0; rc < 3; rc++)
+            zqueue_send (queue, items + rc);
+        zloop_start (loop);
+        assert (count == 3);
+        zloop_destroy (&loop);
+    }
+    zqueue_destroy (&queue);
+
+    //  Many senders, one receiver; each sender's items arrive in order
+#   define SENDERS 4
+    queue = zqueue_new (256);
+    assert (queue);
+    sender_t senders [SENDERS];
+    zactor_t *actors [SENDERS];
+    size_t next [SENDERS];
+    size_t id;
+    for (id = 0; id < SENDERS; id++) {
+        senders [id].queue = queue;
+        senders [id].id = id;
+        next [id] = 0;
+        actors [id] = zactor_new (s_sender_actor, &senders [id]);
+        assert (actors [id]);
+    }
+    for (count = 0; count < SENDERS * ITEMS; count++) {
+        size_t item = (size_t) zqueue_recv (queue, -1);
+        assert (item);
+        item--;
+        id = item / ITEMS;
+        assert (id < SENDERS);
+        assert (item % ITEMS == next [id]);
+        next [id]++;
+    }
+    assert (zqueue_recv (queue, 0) == NULL);
+    for (id = 0; id < SENDERS; id++)
+        zactor_destroy (&actors [id]);
+
+    //  Queue can carry messages, and destroys any that are left
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "Hello");
+    rc = zqueue_send_msg (queue, &msg);
+    assert (rc == 0);
+    assert (msg == NULL);
+    msg = zqueue_recv_msg (queue, 0);
+    assert (msg);
+    char *string = zmsg_popstr (msg);
+    assert (streq (string, "Hello"));
+    free (string);
+    rc = zqueue_send_msg (queue, &msg);
+    assert (rc == 0);
+    zqueue_destroy (&queue);
+    assert (queue == NULL);
+#endif
+    //  @end
+
+    printf ("OK\n");
+}
@@ -27,6 +27,7 @@
 */
 
 #include "../include/czmq.h"
+#include "zslab.h"
 
 //  Ring node, used internally only
 
@@ -45,6 +46,7 @@ struct _zring_t {
     node_t *cursor;             //  Current node for iteration
     size_t size;                //  Number of items in ring
     zhash_t *hash;              //  Dictionary for keyed access
+    zslab_t *pool;              //  Pool that ring nodes come from
     //  Container-level handlers
     czmq_destructor *destructor;
     czmq_duplicator *duplicator;
@@ -54,9 +56,10 @@ struct _zring_t {
 
 //  --------------------------------------------------------------------------
 //  Destroy a ring node. The nodes item must already have been destroyed.
+//  The node goes back to the pool, for reuse.
 
 static void
-s_node_destroy (node_t **self_p)
+s_node_destroy (zslab_t *pool, node_t **self_p)
 {
     assert (self_p);
     node_t *self = *self_p;
@@ -64,20 +67,20 @@ s_node_destroy (node_t **self_p)
     // unlink node from ring
     self->prev->next = self->next;
     self->next->prev = self->prev;
-    // free memory
-    free (self);
-    self_p = NULL;
+    // give memory back to pool
+    zslab_free (pool, self);
+    *self_p = NULL;
 }
 
 //  --------------------------------------------------------------------------
 //  Initialize a ring node and attach to the prev and next nodes, or itself
-//  if these are specified as null. Returns new node, or NULL if process ran
-//  out of heap memory.
+//  if these are specified as null. Takes the node from the pool. Returns new
+//  node, or NULL if process ran out of heap memory.
 
 static node_t *
-s_node_new (node_t *prev, node_t *next, void *item)
+s_node_new (zslab_t *pool, node_t *prev, node_t *next, void *item)
 {
-    node_t *self = (node_t *) zmalloc (sizeof (node_t));
+    node_t *self = (node_t *) zslab_alloc (pool);
     if (self) {
         self->prev = prev ? prev : self;
         self->next = next ? next : self;
@@ -95,8 +98,13 @@ zring_new (void)
 {
     zring_t *self = (zring_t *) zmalloc (sizeof (zring_t));
     if (self) {
-        self->head = s_node_new (NULL, NULL, NULL);
-        self->cursor = self->head;
+        self->pool = zslab_new (sizeof (node_t));
+        if (self->pool)
+            self->head = s_node_new (self->pool, NULL, NULL, NULL);
+        if (self->head)
+            self->cursor = self->head;
+        else
+            zring_destroy (&self);
     }
     return self;
 }
@@ -111,10 +119,13 @@ zring_destroy (zring_t **self_p)
     assert (self_p);
     if (*self_p) {
         zring_t *self = *self_p;
-        zring_purge (self);
-        assert (!self->hash || zhash_size (self->hash) == 0);
+        if (self->head) {
+            zring_purge (self);
+            assert (!self->hash || zhash_size (self->hash) == 0);
+            s_node_destroy (self->pool, &self->head);
+        }
         zhash_destroy (&self->hash);
-        s_node_destroy (&self->head);
+        zslab_destroy (&self->pool);
         free (self);
         *self_p = NULL;
     }
@@ -134,7 +145,7 @@ zring_prepend (zring_t *self, void *item)
         if (!item)
             return -1;
     }
-    node_t *node = s_node_new (self->head, self->head->next, item);
+    node_t *node = s_node_new (self->pool, self->head, self->head->next, item);
     if (node) {
         self->head->next->prev = node;
         self->head->next = node;
@@ -160,7 +171,7 @@ zring_append (zring_t *self, void *item)
         if (!item)
             return -1;
     }
-    node_t *node = s_node_new (self->head->prev, self->head, item);
+    node_t *node = s_node_new (self->pool, self->head->prev, self->head, item);
     if (node) {
         self->head->prev->next = node;
         self->head->prev = node;
@@ -300,7 +311,7 @@ zring_detach (zring_t *self, void *item)
         if (found->key)
             zhash_delete (self->hash, found->key);
         found->item = NULL;
-        s_node_destroy (&found);
+        s_node_destroy (self->pool, &found);
         return item;
     }
     else
@@ -357,6 +368,7 @@ zring_purge (zring_t *self)
 {
     assert (self);
     while (zring_remove (self, zring_first (self)) == 0) ;
+    zslab_trim (self->pool);
 }
 
 
@@ -371,6 +383,45 @@ zring_size (zring_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Make sure the ring can grow to hold the specified number of items
+//  without allocating any more heap memory. Ring nodes come from a pool
+//  that belongs to the ring; nodes freed by detach, remove, and purge go
+//  back to the pool and are reused. The ring keeps the reserved space
+//  until it is destroyed; other free nodes stay in the pool until the
+//  ring is purged. If the ring has a dictionary, also
+//  reserves space in that. Returns 0 if OK, -1 if the process ran out of
+//  heap memory.
+
+int
+zring_reserve (zring_t *self, size_t size)
+{
+    assert (self);
+    if (self->hash && zhash_reserve (self->hash, size))
+        return -1;
+    if (size > self->size)
+        return zslab_reserve (self->pool, size - self->size);
+    else
+        return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Report node pool statistics: the number of nodes the ring has allocated
+//  from the heap, and how many of those are free for reuse. Either pointer
+//  may be NULL.
+
+void
+zring_pool_stats (zring_t *self, size_t *allocated, size_t *available)
+{
+    assert (self);
+    if (allocated)
+        *allocated = zslab_capacity (self->pool);
+    if (available)
+        *available = zslab_available (self->pool);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return the item at the head of ring. If the ring is empty, returns NULL.
 //  Leaves cursor pointing at the head item, or NULL if the ring is empty.
@@ -504,6 +555,9 @@ zring_dup (zring_t *self)
         copy->destructor = self->destructor;
         copy->duplicator = self->duplicator;
         copy->comparator = self->comparator;
+        //  Pre-size the pool, but don't keep the source's size as a
+        //  reservation; that would survive purging the copy
+        zslab_grow (copy->pool, self->size);
 
         node_t *node;
         for (node = self->head->next; node != self->head; node = node->next) {
@@ -669,6 +723,42 @@ zring_test (int verbose)
     assert (rc == -1);
     zring_purge (ring);
 
+    //  Queue churn on a reserved ring does not allocate any more nodes
+    zring_t *queue = zring_new ();
+    assert (queue);
+    size_t allocated, available;
+    rc = zring_reserve (queue, 50);
+    assert (rc == 0);
+    zring_pool_stats (queue, &allocated, &available);
+    assert (allocated == 51);       //  Including the ring head
+    assert (available == 50);
+    int cycle;
+    for (cycle = 0; cycle < 1000; cycle++) {
+        zring_append (queue, "dummy");
+        if (zring_size (queue) == 50)
+            zring_purge (queue);
+        else
+        if (cycle % 3 == 0)
+            zring_detach (queue, NULL);
+    }
+    zring_pool_stats (queue, &allocated, NULL);
+    assert (allocated == 51);
+    zring_pool_stats (queue, NULL, &available);
+    assert (available == 50 - zring_size (queue));
+
+    //  A copy is sized for its items, but doesn't keep that space
+    while (zring_size (queue) < 40)
+        zring_append (queue, "dummy");
+    zring_t *copy = zring_dup (queue);
+    assert (copy);
+    zring_pool_stats (copy, &allocated, NULL);
+    assert (allocated > 40);
+    zring_purge (copy);
+    zring_pool_stats (copy, &allocated, NULL);
+    assert (allocated < 40);
+    zring_destroy (&copy);
+    zring_destroy (&queue);
+
     //  Destructor should be safe to call twice
     zring_destroy (&ring);
     assert (ring == NULL);
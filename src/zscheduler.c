@@ -0,0 +1,651 @@
+/*  =========================================================================
+    zscheduler - run socket handlers on a pool of threads, used internally
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zscheduler class runs many event-driven tasks on a fixed pool of
+    threads. A task is a socket plus a handler that is called whenever the
+    socket has input. zactor uses this for pooled actors, so that an idle
+    actor costs two sockets and no thread.
+@discuss
+    One dispatcher thread waits on all idle sockets, using a zpollset. When
+    a socket has input, the dispatcher takes it out of the poll set, and
+    deals the task to one of the worker threads. A ZeroMQ socket must only
+    be used by one thread at a time, so the dispatcher does not touch it
+    again until the worker hands it back. Each worker has its own deque of
+    tasks. It takes the newest task from its own deque, and when that is
+    empty, steals the oldest task from another worker.
+
+    A worker calls the handler while the socket has input, up to a budget,
+    and then moves on so that one busy task cannot hog the thread. The
+    scheduler needs epoll, so for now it is only available on Linux.
+@end
+*/
+
+#include "../include/czmq.h"
+#include "zpollset.h"
+#include "zscheduler.h"
+
+//  Scheduler performance parameters
+
+#define TASK_BUDGET     32      //  Messages per task, before it yields
+#define DEQUE_INITIAL   16      //  Initial size of a worker's deque
+
+//  A task, used internally only
+
+typedef struct _task_t {
+    zsock_t *sock;              //  Socket we wait on
+    zscheduler_fn *handler;     //  Called when socket has input
+    zscheduler_drop_fn *drop;   //  Called if we drop the task, or NULL
+    void *args;                 //  Application arguments
+    struct _task_t *next;       //  Next task handed back to dispatcher
+    struct _task_t *prev_waiting;   //  Tasks in the poll set, known only
+    struct _task_t *next_waiting;   //  to the dispatcher
+} task_t;
+
+#if defined (__UNIX__)
+//  Double-ended queue of tasks; owner works at the tail, thieves at head
+
+typedef struct {
+    pthread_mutex_t mutex;      //  Guards this deque
+    task_t **tasks;             //  Circular buffer of tasks
+    size_t limit;               //  Allocated size, a power of two
+    size_t head;                //  Index of oldest task
+    size_t size;                //  Number of tasks in deque
+} deque_t;
+
+//  A worker thread
+
+typedef struct {
+    zscheduler_t *scheduler;    //  Scheduler we work for
+    size_t index;               //  Our index in the worker table
+    pthread_t thread;           //  Thread running s_worker
+    deque_t deque;              //  Tasks ready to run
+} worker_t;
+#endif
+
+
+//  ---------------------------------------------------------------------
+//  Structure of our class
+
+struct _zscheduler_t {
+    zpollset_t *pollset;        //  Tasks waiting for input
+    zsignal_t *wakeup;          //  Wakes the dispatcher
+#if defined (__UNIX__)
+    pthread_t dispatcher;       //  Thread running s_dispatcher
+    task_t *waiting;            //  Tasks in the poll set
+    worker_t *workers;          //  Table of worker threads
+    size_t nbr_workers;         //  Number of worker threads
+    size_t next_worker;         //  Dispatcher deals tasks round-robin
+    pthread_mutex_t mutex;      //  Guards the following properties
+    pthread_cond_t wake;        //  Idle workers wait on this
+    task_t *incoming;           //  Tasks to register with the poll set
+    size_t sleepers;            //  Number of idle workers
+    bool terminated;            //  Scheduler is shutting down
+#endif
+};
+
+
+#if defined (__UNIX__)
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Drop a task that has not ended, letting go of its socket
+
+static void
+s_task_drop (task_t *task)
+{
+    if (task->drop)
+        task->drop (task->sock, task->args);
+    else
+        zsock_destroy (&task->sock);
+    free (task);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Add a task at the tail of the deque, or at the head if it's yielding to
+//  other tasks. Returns 0 if OK, -1 if the process ran out of memory.
+
+static int
+s_deque_push (deque_t *deque, task_t *task, bool yield)
+{
+    int rc = 0;
+    pthread_mutex_lock (&deque->mutex);
+    if (deque->size == deque->limit) {
+        size_t limit = deque->limit? deque->limit * 2: DEQUE_INITIAL;
+        task_t **tasks = (task_t **) malloc (limit * sizeof (task_t *));
+        if (tasks) {
+            size_t index;
+            for (index = 0; index < deque->size; index++)
+                tasks [index] = deque->tasks [(deque->head + index) & (deque->limit - 1)];
+            free (deque->tasks);
+            deque->tasks = tasks;
+            deque->limit = limit;
+            deque->head = 0;
+        }
+        else
+            rc = -1;
+    }
+    if (rc == 0) {
+        if (yield) {
+            deque->head = (deque->head - 1) & (deque->limit - 1);
+            deque->tasks [deque->head] = task;
+        }
+        else
+            deque->tasks [(deque->head + deque->size) & (deque->limit - 1)] = task;
+        deque->size++;
+    }
+    pthread_mutex_unlock (&deque->mutex);
+    return rc;
+}
+
+//  Take the newest task from the tail of the deque, or the oldest from its
+//  head if we're stealing it. Returns NULL if the deque is empty.
+
+static task_t *
+s_deque_pop (deque_t *deque, bool steal)
+{
+    task_t *task = NULL;
+    pthread_mutex_lock (&deque->mutex);
+    if (deque->size) {
+        deque->size--;
+        if (steal) {
+            task = deque->tasks [deque->head];
+            deque->head = (deque->head + 1) & (deque->limit - 1);
+        }
+        else
+            task = deque->tasks [(deque->head + deque->size) & (deque->limit - 1)];
+    }
+    pthread_mutex_unlock (&deque->mutex);
+    return task;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Hand a task to the dispatcher, to wait for input. We only wake the
+//  dispatcher if it has nothing else to pick up, as it takes all incoming
+//  tasks at once.
+
+static void
+s_scheduler_incoming (zscheduler_t *self, task_t *task)
+{
+    pthread_mutex_lock (&self->mutex);
+    bool idle = self->incoming == NULL;
+    task->next = self->incoming;
+    self->incoming = task;
+    pthread_mutex_unlock (&self->mutex);
+    if (idle)
+        zsignal_send (self->wakeup, 0);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Give a task that has input to the next worker, and wake a worker if any
+//  are idle, as it may steal the task.
+
+static void
+s_scheduler_deal (zscheduler_t *self, task_t *task)
+{
+    worker_t *worker = &self->workers [self->next_worker++ % self->nbr_workers];
+    int rc = s_deque_push (&worker->deque, task, false);
+    assert (rc == 0);
+
+    pthread_mutex_lock (&self->mutex);
+    if (self->sleepers)
+        pthread_cond_signal (&self->wake);
+    pthread_mutex_unlock (&self->mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  The dispatcher thread waits for input on idle tasks, and deals them out
+//  to workers. It also registers new tasks, and tasks that workers have
+//  finished with.
+
+static void *
+s_dispatcher (void *args)
+{
+    zscheduler_t *self = (zscheduler_t *) args;
+    while (true) {
+        int ready = zpollset_wait (self->pollset, -1);
+        if (ready == -1 && errno != EINTR)
+            //  The context was terminated, so our sockets are dead; don't
+            //  spin while we wait to be destroyed
+            zclock_sleep (10);
+        int index;
+        for (index = 0; index < ready; index++) {
+            void *tag = zpollset_tag (self->pollset, index);
+            if (tag == self->wakeup) {
+                while (zsignal_wait (self->wakeup, 0) != -1)
+                    ;           //  Take all pending wakeups
+            }
+            else {
+                //  Only the worker may use the socket from now on
+                task_t *task = (task_t *) tag;
+                zpollset_remove (self->pollset, task);
+                if (task->prev_waiting)
+                    task->prev_waiting->next_waiting = task->next_waiting;
+                else
+                    self->waiting = task->next_waiting;
+                if (task->next_waiting)
+                    task->next_waiting->prev_waiting = task->prev_waiting;
+                s_scheduler_deal (self, task);
+            }
+        }
+        pthread_mutex_lock (&self->mutex);
+        task_t *task = self->incoming;
+        self->incoming = NULL;
+        bool terminated = self->terminated;
+        pthread_mutex_unlock (&self->mutex);
+        if (terminated) {
+            //  Drop tasks that were still on their way to us, and tasks
+            //  that were waiting for input
+            while (task) {
+                task_t *next = task->next;
+                s_task_drop (task);
+                task = next;
+            }
+            while (self->waiting) {
+                task_t *next = self->waiting->next_waiting;
+                zpollset_remove (self->pollset, self->waiting);
+                s_task_drop (self->waiting);
+                self->waiting = next;
+            }
+            break;
+        }
+        while (task) {
+            task_t *next = task->next;
+            if (zpollset_add (self->pollset, task->sock, 0, ZMQ_POLLIN, task)) {
+                s_task_drop (task);
+                task = next;
+                continue;
+            }
+            task->prev_waiting = NULL;
+            task->next_waiting = self->waiting;
+            if (self->waiting)
+                self->waiting->prev_waiting = task;
+            self->waiting = task;
+            task = next;
+        }
+    }
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Find a task for the worker: its own newest task, else the oldest task
+//  of another worker.
+
+static task_t *
+s_worker_find (worker_t *worker)
+{
+    zscheduler_t *self = worker->scheduler;
+    task_t *task = s_deque_pop (&worker->deque, false);
+    size_t offset;
+    for (offset = 1; !task && offset < self->nbr_workers; offset++) {
+        worker_t *victim = &self->workers [(worker->index + offset) % self->nbr_workers];
+        task = s_deque_pop (&victim->deque, true);
+    }
+    return task;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Run a task while its socket has input, up to the task budget. Then give
+//  the task back to the dispatcher, or if it still has input, put it behind
+//  our other tasks.
+
+static void
+s_worker_run (worker_t *worker, task_t *task)
+{
+    size_t budget = TASK_BUDGET;
+    while (zsock_events (task->sock) & ZMQ_POLLIN) {
+        if (task->handler (task->sock, task->args)) {
+            free (task);        //  Task has ended
+            return;
+        }
+        if (--budget == 0) {
+            int rc = s_deque_push (&worker->deque, task, true);
+            assert (rc == 0);
+            return;
+        }
+    }
+    s_scheduler_incoming (worker->scheduler, task);
+}
+
+
+//  --------------------------------------------------------------------------
+//  The worker thread runs tasks until the scheduler is destroyed.
+
+static void *
+s_worker (void *args)
+{
+    worker_t *worker = (worker_t *) args;
+    zscheduler_t *self = worker->scheduler;
+    while (true) {
+        task_t *task = s_worker_find (worker);
+        if (!task) {
+            //  Look again while holding the lock, so that the dispatcher
+            //  cannot deal a task between our last look and our sleep
+            pthread_mutex_lock (&self->mutex);
+            while (!self->terminated && (task = s_worker_find (worker)) == NULL) {
+                self->sleepers++;
+                pthread_cond_wait (&self->wake, &self->mutex);
+                self->sleepers--;
+            }
+            pthread_mutex_unlock (&self->mutex);
+        }
+        if (!task)
+            break;              //  Scheduler was destroyed
+
+        //  A task that always has input never gets back to the dispatcher,
+        //  so we must not pick it up again once we're shutting down
+        pthread_mutex_lock (&self->mutex);
+        bool terminated = self->terminated;
+        pthread_mutex_unlock (&self->mutex);
+        if (terminated) {
+            s_task_drop (task);
+            break;
+        }
+        s_worker_run (worker, task);
+    }
+    return NULL;
+}
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Create a new scheduler with the specified number of threads, or one
+//  thread per CPU core if threads is zero. Returns NULL if the platform
+//  does not support the scheduler, or the process ran out of resources.
+
+zscheduler_t *
+zscheduler_new (size_t threads)
+{
+#if defined (__UNIX__)
+    zpollset_t *pollset = zpollset_new ();
+    if (!pollset)
+        return NULL;            //  No epoll, so no scheduler
+
+    zscheduler_t *self = (zscheduler_t *) zmalloc (sizeof (zscheduler_t));
+    if (!self) {
+        zpollset_destroy (&pollset);
+        return NULL;
+    }
+    self->pollset = pollset;
+#if defined (_SC_NPROCESSORS_ONLN)
+    if (threads == 0)
+        threads = (size_t) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+    self->nbr_workers = threads? threads: 1;
+    pthread_mutex_init (&self->mutex, NULL);
+    pthread_cond_init (&self->wake, NULL);
+
+    self->wakeup = zsignal_new ();
+    self->workers = (worker_t *) zmalloc (self->nbr_workers * sizeof (worker_t));
+    if (!self->wakeup
+    ||  !self->workers
+    ||  zpollset_add (self->pollset, NULL, zsignal_fd (self->wakeup), ZMQ_POLLIN, self->wakeup)) {
+        free (self->workers);
+        self->workers = NULL;
+        zscheduler_destroy (&self);
+        return NULL;
+    }
+    size_t index;
+    for (index = 0; index < self->nbr_workers; index++) {
+        worker_t *worker = &self->workers [index];
+        worker->scheduler = self;
+        worker->index = index;
+        pthread_mutex_init (&worker->deque.mutex, NULL);
+        pthread_create (&worker->thread, NULL, s_worker, worker);
+    }
+    pthread_create (&self->dispatcher, NULL, s_dispatcher, self);
+    return self;
+#else
+    return NULL;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a scheduler, and stop its threads. Tasks that have not ended
+//  are dropped, without calling their handlers again: the scheduler calls
+//  each task's drop function, or if it has none, destroys its socket.
+
+void
+zscheduler_destroy (zscheduler_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zscheduler_t *self = *self_p;
+#if defined (__UNIX__)
+        if (self->workers) {
+            pthread_mutex_lock (&self->mutex);
+            self->terminated = true;
+            pthread_cond_broadcast (&self->wake);
+            pthread_mutex_unlock (&self->mutex);
+            zsignal_send (self->wakeup, 0);
+            pthread_join (self->dispatcher, NULL);
+
+            size_t index;
+            for (index = 0; index < self->nbr_workers; index++) {
+                worker_t *worker = &self->workers [index];
+                pthread_join (worker->thread, NULL);
+                task_t *task;
+                while ((task = s_deque_pop (&worker->deque, false)))
+                    s_task_drop (task);
+                free (worker->deque.tasks);
+                pthread_mutex_destroy (&worker->deque.mutex);
+            }
+            free (self->workers);
+            //  Workers may have handed back tasks after the dispatcher
+            //  left, so drop those too
+            while (self->incoming) {
+                task_t *next = self->incoming->next;
+                s_task_drop (self->incoming);
+                self->incoming = next;
+            }
+        }
+        pthread_cond_destroy (&self->wake);
+        pthread_mutex_destroy (&self->mutex);
+#endif
+        zpollset_destroy (&self->pollset);
+        zsignal_destroy (&self->wakeup);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a task that calls the handler whenever the socket has input. From
+//  now on, only the scheduler may use the socket, until the task ends.
+//  The drop function may be NULL. Returns 0 if OK, -1 if the process ran
+//  out of memory.
+
+int
+zscheduler_add (zscheduler_t *self, zsock_t *sock, zscheduler_fn *handler,
+                zscheduler_drop_fn *drop, void *args)
+{
+    assert (self);
+    assert (sock);
+    assert (handler);
+    task_t *task = (task_t *) zmalloc (sizeof (task_t));
+    if (!task)
+        return -1;
+    task->sock = sock;
+    task->handler = handler;
+    task->drop = drop;
+    task->args = args;
+#if defined (__UNIX__)
+    s_scheduler_incoming (self, task);
+#endif
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of threads that run tasks
+
+size_t
+zscheduler_threads (zscheduler_t *self)
+{
+    assert (self);
+#if defined (__UNIX__)
+    return self->nbr_workers;
+#else
+    return 0;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+//  Echoes each message back, and ends the task on "END"
+
+typedef struct {
+    size_t handled;             //  Messages echoed
+    zsignal_t *ended;           //  Raised when task ends
+} echo_t;
+
+static int
+s_echo_handler (zsock_t *sock, void *args)
+{
+    echo_t *echo = (echo_t *) args;
+    zmsg_t *msg = zmsg_recv (sock);
+    if (!msg)
+        return -1;
+    char *command = zmsg_popstr (msg);
+    bool end = streq (command, "END");
+    free (command);
+    if (end) {
+        zmsg_destroy (&msg);
+        zsock_destroy (&sock);
+        zsignal_send (echo->ended, 0);
+        return -1;
+    }
+    echo->handled++;
+    return zmsg_send (&msg, sock);
+}
+
+//  Never reads its input, so it always has more
+
+static int
+s_busy_handler (zsock_t *sock, void *args)
+{
+    return 0;
+}
+
+static void
+s_echo_drop (zsock_t *sock, void *args)
+{
+    echo_t *echo = (echo_t *) args;
+    zsock_destroy (&sock);
+    zsignal_send (echo->ended, 0);
+}
+
+void
+zscheduler_test (bool verbose)
+{
+    printf (" * zscheduler: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zscheduler_t *scheduler = zscheduler_new (2);
+    if (scheduler) {
+        assert (zscheduler_threads (scheduler) == 2);
+        zsignal_t *ended = zsignal_new ();
+        assert (ended);
+
+        //  Run a set of echo tasks, more than we have threads
+#       define TASKS 20
+        zsock_t *clients [TASKS];
+        echo_t echoes [TASKS];
+        int index;
+        for (index = 0; index < TASKS; index++) {
+            char endpoint [32];
+            sprintf (endpoint, "inproc://zscheduler-%d", index);
+            zsock_t *server = zsock_new (ZMQ_PAIR);
+            assert (server);
+            int rc = zsock_bind (server, "%s", endpoint);
+            assert (rc == 0);
+            clients [index] = zsock_new (ZMQ_PAIR);
+            assert (clients [index]);
+            rc = zsock_connect (clients [index], "%s", endpoint);
+            assert (rc == 0);
+            echoes [index].handled = 0;
+            echoes [index].ended = ended;
+            rc = zscheduler_add (scheduler, server, s_echo_handler, NULL, &echoes [index]);
+            assert (rc == 0);
+        }
+        //  Send a burst to each task, more than its budget
+        int count;
+        for (index = 0; index < TASKS; index++)
+            for (count = 0; count < 50; count++)
+                zstr_sendx (clients [index], "ECHO", "Hello", NULL);
+
+        for (index = 0; index < TASKS; index++)
+            for (count = 0; count < 50; count++) {
+                char *string = zstr_recv (clients [index]);
+                assert (string);
+                assert (streq (string, "Hello"));
+                free (string);
+            }
+        for (index = 0; index < TASKS; index++) {
+            assert (echoes [index].handled == 50);
+            zstr_send (clients [index], "END");
+        }
+        for (index = 0; index < TASKS; index++) {
+            int rc = zsignal_wait (ended, 1000);
+            assert (rc == 0);
+            zsock_destroy (&clients [index]);
+        }
+        //  Tasks that are still running when we stop get dropped
+        zsock_t *idle = zsock_new (ZMQ_PAIR);
+        assert (idle);
+        int rc = zscheduler_add (scheduler, idle, s_echo_handler, s_echo_drop, &echoes [0]);
+        assert (rc == 0);
+        zsock_t *orphan = zsock_new (ZMQ_PAIR);
+        assert (orphan);
+        rc = zscheduler_add (scheduler, orphan, s_echo_handler, NULL, &echoes [1]);
+        assert (rc == 0);
+
+        //  A task that is never idle does not keep us from stopping
+        zsock_t *busy = zsock_new_pair ("@inproc://zscheduler-busy");
+        assert (busy);
+        zsock_t *feeder = zsock_new_pair (">inproc://zscheduler-busy");
+        assert (feeder);
+        zstr_send (feeder, "Hello");
+        rc = zscheduler_add (scheduler, busy, s_busy_handler, s_echo_drop, &echoes [2]);
+        assert (rc == 0);
+        zclock_sleep (10);
+        zscheduler_destroy (&scheduler);
+        assert (scheduler == NULL);
+        zsock_destroy (&feeder);
+        rc = zsignal_wait (ended, 0);
+        assert (rc == 0);
+        rc = zsignal_wait (ended, 0);
+        assert (rc == 0);
+        zsignal_destroy (&ended);
+    }
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,74 @@
+/*  =========================================================================
+    zscheduler - run socket handlers on a pool of threads, used internally
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZSCHEDULER_H_INCLUDED__
+#define __ZSCHEDULER_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Opaque class structure
+typedef struct _zscheduler_t zscheduler_t;
+
+//  @interface
+//  Callback function for a task. It is called from one of the pool threads
+//  when the task's socket has input, and must receive one message from the
+//  socket. Returns 0 to keep the task going, or -1 to end it. A task that
+//  ends may destroy its socket before returning.
+typedef int (zscheduler_fn) (zsock_t *sock, void *args);
+
+//  Callback function for a task that the scheduler drops when it is
+//  destroyed, before the task ended. It is called from the thread that
+//  holds the task, and must destroy the socket.
+typedef void (zscheduler_drop_fn) (zsock_t *sock, void *args);
+
+//  Create a new scheduler with the specified number of threads, or one
+//  thread per CPU core if threads is zero. Returns NULL if the platform
+//  does not support the scheduler, or the process ran out of resources.
+CZMQ_EXPORT zscheduler_t *
+    zscheduler_new (size_t threads);
+
+//  Destroy a scheduler, and stop its threads. Tasks that have not ended
+//  are dropped, without calling their handlers again: the scheduler calls
+//  each task's drop function, or if it has none, destroys its socket.
+CZMQ_EXPORT void
+    zscheduler_destroy (zscheduler_t **self_p);
+
+//  Add a task that calls the handler whenever the socket has input. From
+//  now on, only the scheduler may use the socket, until the task ends.
+//  The drop function may be NULL. Returns 0 if OK, -1 if the process ran
+//  out of memory.
+CZMQ_EXPORT int
+    zscheduler_add (zscheduler_t *self, zsock_t *sock, zscheduler_fn *handler,
+                    zscheduler_drop_fn *drop, void *args);
+
+//  Return the number of threads that run tasks
+CZMQ_EXPORT size_t
+    zscheduler_threads (zscheduler_t *self);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zscheduler_test (bool verbose);
+//  @end
+
+//  Return the process-wide scheduler for pooled actors, creating it the
+//  first time; implemented by zsys
+CZMQ_EXPORT zscheduler_t *
+    zsys_scheduler (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+/*  =========================================================================
+    zsignal - lightweight pollable signal between threads
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zsignal class lets one thread wake another, carrying a one-byte
+    status code, without going through a ZeroMQ socket. It costs one system
+    call to raise a signal, and one to take it. A signal is also a file
+    descriptor, so you can wait for it in a zpoller or zloop, together with
+    your sockets. A zactor can use a zsignal for its handshakes, so that
+    actor startup, shutdown, and zsock_signal replies skip the message pipe.
+@discuss
+    On Linux, a signal is an eventfd in semaphore mode, and the status
+    codes wait in a queue beside it. On other UNIX systems, it is a pipe,
+    which carries the status codes itself. Signals are counted, so each
+    wait takes one signal, and returns its status, in the order they were
+    raised. zsignal is not yet available on Windows, and zsignal_new
+    returns NULL there.
+@end
+*/
+
+#include "../include/czmq.h"
+#include "zsys_mutex.h"
+#if defined (__UTYPE_LINUX)
+#   include <sys/eventfd.h>
+#endif
+
+//  Initial size of the status queue, must be a power of two
+#define STATUS_QUEUE_INITIAL    8
+
+//  Structure of our class
+
+struct _zsignal_t {
+    SOCKET fd;                  //  Readable end, must come first
+    SOCKET write_fd;            //  Writable end, may be the same
+#if defined (__UTYPE_LINUX)
+    //  An eventfd only counts signals, so we queue their statuses here
+    zsys_mutex_t mutex;         //  Guards the status queue
+    byte *statuses;             //  Ring of statuses, oldest at head
+    size_t limit;               //  Size of ring, a power of two
+    size_t head;                //  Index of oldest status
+    size_t size;                //  Number of statuses queued
+#endif
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a new signal. Returns NULL if the platform does not support
+//  signals, or the process ran out of file handles.
+
+zsignal_t *
+zsignal_new (void)
+{
+#if defined (__UNIX__)
+    zsignal_t *self = (zsignal_t *) zmalloc (sizeof (zsignal_t));
+    if (!self)
+        return NULL;
+#   if defined (__UTYPE_LINUX)
+    //  In semaphore mode, each read takes one from the count
+    self->fd = eventfd (0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    self->write_fd = self->fd;
+    self->limit = STATUS_QUEUE_INITIAL;
+    self->statuses = (byte *) malloc (self->limit);
+    if (self->fd == -1 || !self->statuses) {
+        if (self->fd != -1)
+            close (self->fd);
+        free (self->statuses);
+        free (self);
+        return NULL;
+    }
+    ZMUTEX_INIT (self->mutex);
+#   else
+    //  A pipe holds one byte per signal
+    int fds [2];
+    if (pipe (fds)) {
+        free (self);
+        return NULL;
+    }
+    self->fd = fds [0];
+    self->write_fd = fds [1];
+    int index;
+    for (index = 0; index < 2; index++) {
+        fcntl (fds [index], F_SETFL, fcntl (fds [index], F_GETFL) | O_NONBLOCK);
+        fcntl (fds [index], F_SETFD, FD_CLOEXEC);
+    }
+#   endif
+    return self;
+#else
+    return NULL;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a signal
+
+void
+zsignal_destroy (zsignal_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zsignal_t *self = *self_p;
+#if defined (__UNIX__)
+        close (self->fd);
+        if (self->write_fd != self->fd)
+            close (self->write_fd);
+#endif
+#if defined (__UTYPE_LINUX)
+        ZMUTEX_DESTROY (self->mutex);
+        free (self->statuses);
+#endif
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Raise the signal with a status code (by convention, 0 means OK). Any
+//  thread may call this. Returns 0 if OK, -1 if the signal could not be
+//  raised.
+
+int
+zsignal_send (zsignal_t *self, byte status)
+{
+    assert (self);
+#if defined (__UTYPE_LINUX)
+    //  Status must be queued before the waiter can see the signal
+    ZMUTEX_LOCK (self->mutex);
+    if (self->size == self->limit) {
+        byte *statuses = (byte *) malloc (self->limit * 2);
+        if (!statuses) {
+            ZMUTEX_UNLOCK (self->mutex);
+            return -1;
+        }
+        size_t index;
+        for (index = 0; index < self->size; index++)
+            statuses [index] = self->statuses [(self->head + index) & (self->limit - 1)];
+        free (self->statuses);
+        self->statuses = statuses;
+        self->limit *= 2;
+        self->head = 0;
+    }
+    self->statuses [(self->head + self->size) & (self->limit - 1)] = status;
+    self->size++;
+    ZMUTEX_UNLOCK (self->mutex);
+
+    uint64_t count = 1;
+    if (write (self->write_fd, &count, sizeof (count)) == sizeof (count))
+        return 0;
+
+    //  The write only fails if the count would overflow; drop the newest
+    //  status, so the queue matches the count again
+    ZMUTEX_LOCK (self->mutex);
+    self->size--;
+    ZMUTEX_UNLOCK (self->mutex);
+#elif defined (__UNIX__)
+    if (write (self->write_fd, &status, 1) == 1)
+        return 0;
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Take one signal if there is one pending. Returns its status if OK, else
+//  -1 with errno set to EAGAIN if no signal was pending.
+
+static int
+s_signal_take (zsignal_t *self)
+{
+#if defined (__UTYPE_LINUX)
+    uint64_t count;
+    if (read (self->fd, &count, sizeof (count)) == sizeof (count)) {
+        //  Each signal we can read has a status queued for it
+        ZMUTEX_LOCK (self->mutex);
+        assert (self->size);
+        byte status = self->statuses [self->head];
+        self->head = (self->head + 1) & (self->limit - 1);
+        self->size--;
+        ZMUTEX_UNLOCK (self->mutex);
+        return status;
+    }
+#elif defined (__UNIX__)
+    byte status;
+    if (read (self->fd, &status, 1) == 1)
+        return status;
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Wait for the signal to be raised, for up to timeout msecs, or forever if
+//  timeout is -1. Each wait consumes one signal. Returns the status of the
+//  signal it consumed, in the order signals were raised, or -1 if the
+//  timeout expired or the call was interrupted.
+
+int
+zsignal_wait (zsignal_t *self, int timeout)
+{
+    assert (self);
+    int64_t deadline = zclock_mono () + timeout;
+    while (true) {
+        //  If the signal was already raised, we don't need to poll
+        int status = s_signal_take (self);
+        if (status != -1)
+            return status;
+        if (errno != EAGAIN && errno != EINTR)
+            return -1;
+
+        //  Another thread may take the signal before we get to it, so
+        //  we loop until we have it, or time runs out
+        int64_t wait = timeout;
+        if (timeout >= 0) {
+            wait = deadline - zclock_mono ();
+            if (wait <= 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        zmq_pollitem_t item = { NULL, self->fd, ZMQ_POLLIN, 0 };
+        if (zmq_poll (&item, 1, (long) wait * ZMQ_POLL_MSEC) == -1)
+            return -1;          //  Interrupted
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the file descriptor that becomes readable when the signal is
+//  raised. A zsignal_t also starts with this descriptor, so you can pass
+//  it as-is to zpoller_add, and zpoller_wait will return it.
+
+SOCKET
+zsignal_fd (zsignal_t *self)
+{
+    assert (self);
+    return self->fd;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+static void
+s_signal_actor (zsock_t *pipe, void *args)
+{
+    zsock_signal (pipe, 0);
+    zsignal_send ((zsignal_t *) args, 42);
+    char *command = zstr_recv (pipe);
+    free (command);
+}
+
+void
+zsignal_test (bool verbose)
+{
+    printf (" * zsignal: ");
+
+    //  @selftest
+#if defined (__UNIX__)
+    zsignal_t *signal = zsignal_new ();
+    assert (signal);
+    assert (zsignal_fd (signal) != INVALID_SOCKET);
+
+    //  Signals are counted, and each carries its own status
+    assert (zsignal_wait (signal, 0) == -1);
+    int rc = zsignal_send (signal, 7);
+    assert (rc == 0);
+    assert (zsignal_wait (signal, 0) == 7);
+    assert (zsignal_wait (signal, 0) == -1);
+    int index;
+    for (index = 0; index < 20; index++)
+        zsignal_send (signal, (byte) index);
+    for (index = 0; index < 20; index++)
+        assert (zsignal_wait (signal, -1) == index);
+
+    //  Wait times out if no signal is raised
+    int64_t start = zclock_mono ();
+    assert (zsignal_wait (signal, 20) == -1);
+    assert (zclock_mono () - start >= 20);
+
+    //  Signal can be polled alongside sockets
+    zpoller_t *poller = zpoller_new (signal, NULL);
+    assert (poller);
+    assert (zpoller_wait (poller, 0) == NULL);
+    zactor_t *actor = zactor_new (s_signal_actor, signal);
+    assert (actor);
+    assert (zpoller_wait (poller, 1000) == signal);
+    assert (zsignal_wait (signal, 0) == 42);
+    zactor_destroy (&actor);
+    zpoller_destroy (&poller);
+
+    zsignal_destroy (&signal);
+    assert (signal == NULL);
+#endif
+    //  @end
+
+    printf ("OK\n");
+}
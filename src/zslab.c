@@ -0,0 +1,472 @@
+/*  =========================================================================
+    zslab - fixed-size object pool, used internally by containers
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zslab class is a simple pool of fixed-size objects, which the zlist,
+    zring, and zhash containers use for their internal nodes. Objects are
+    carved out of larger slabs, and freed objects go onto a free list for
+    reuse, so a container that has reached its working size does no more
+    heap allocation when items come and go.
+@discuss
+    Each container owns its own pool, so there is no locking, and a
+    container can be passed between threads as before. Slabs start small
+    and double in size as the pool grows, up to a maximum. The pool keeps
+    its high-water mark, so a container that fills and drains over and
+    over does not churn the heap; empty slabs go back to the heap only
+    when the container is purged.
+@end
+*/
+
+#include "../include/czmq.h"
+#include "zslab.h"
+
+//  Pool performance parameters
+
+#define SLAB_INITIAL     8    //  Objects in first slab
+#define SLAB_MAXIMUM  1024    //  Maximum objects in a slab, when growing
+
+//  Objects and slab headers are aligned to this
+
+typedef union {
+    void *pointer;
+    double number;
+} align_t;
+
+#define ALIGNED(size) (((size) + sizeof (align_t) - 1) / sizeof (align_t) * sizeof (align_t))
+
+//  Free object, used internally only; overlays the start of the object
+
+typedef struct _object_t {
+    struct _object_t *next;
+} object_t;
+
+//  Slab header, objects follow it
+
+typedef struct _slab_t {
+    struct _slab_t *prev;       //  Previous slab with free objects
+    struct _slab_t *next;       //  Next slab with free objects
+    object_t *free_list;        //  Free objects in this slab
+    size_t count;               //  Number of objects in slab
+    size_t in_use;              //  Number of objects handed out
+} slab_t;
+
+
+//  ---------------------------------------------------------------------
+//  Structure of our class
+
+struct _zslab_t {
+    size_t object_size;         //  Size of each object, rounded up
+    slab_t **slabs;             //  All slabs, in address order
+    size_t nbr_slabs;           //  Number of slabs
+    size_t slabs_limit;         //  Allocated size of slabs table
+    slab_t *partial;            //  Slabs that have free objects
+    size_t capacity;            //  Objects allocated from heap
+    size_t available;           //  Objects that are free
+    size_t reserved;            //  Capacity we keep, set by zslab_reserve
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a new pool for objects of the specified size. Does not allocate
+//  any objects until they are needed.
+
+zslab_t *
+zslab_new (size_t object_size)
+{
+    assert (object_size);
+    zslab_t *self = (zslab_t *) zmalloc (sizeof (zslab_t));
+    if (self)
+        //  Every object must be able to hold a free list link, and keep
+        //  the next object in the slab aligned
+        self->object_size = ALIGNED (object_size);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a pool, and all objects allocated from it, whether or not they
+//  were given back to the pool.
+
+void
+zslab_destroy (zslab_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zslab_t *self = *self_p;
+        size_t index;
+        for (index = 0; index < self->nbr_slabs; index++)
+            free (self->slabs [index]);
+        free (self->slabs);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Return the first object in a slab
+
+static byte *
+s_slab_objects (slab_t *slab)
+{
+    return (byte *) slab + ALIGNED (sizeof (slab_t));
+}
+
+//  Put a slab at the head of the list of slabs with free objects, or take
+//  it off that list
+
+static void
+s_slab_link (zslab_t *self, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = self->partial;
+    if (self->partial)
+        self->partial->prev = slab;
+    self->partial = slab;
+}
+
+static void
+s_slab_unlink (zslab_t *self, slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        self->partial = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->prev = slab->next = NULL;
+}
+
+//  Return the index of the last slab that starts at or before the address,
+//  which is the slab holding it, if any
+
+static size_t
+s_slab_index (zslab_t *self, void *address)
+{
+    size_t low = 0;
+    size_t high = self->nbr_slabs;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if ((byte *) self->slabs [middle] <= (byte *) address)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+//  Allocate a new slab holding the specified number of objects, and make
+//  all its objects free. Returns 0 if OK, else -1.
+
+static int
+s_slab_new (zslab_t *self, size_t count)
+{
+    if (self->nbr_slabs == self->slabs_limit) {
+        size_t limit = self->slabs_limit? self->slabs_limit * 2: 4;
+        slab_t **slabs = (slab_t **) realloc (self->slabs, limit * sizeof (slab_t *));
+        if (!slabs)
+            return -1;
+        self->slabs = slabs;
+        self->slabs_limit = limit;
+    }
+    slab_t *slab = (slab_t *) malloc (ALIGNED (sizeof (slab_t)) + self->object_size * count);
+    if (!slab)
+        return -1;
+
+    //  Chain objects in address order, so fresh objects are used in order
+    byte *objects = s_slab_objects (slab);
+    slab->free_list = NULL;
+    size_t index = count;
+    while (index) {
+        object_t *object = (object_t *) (objects + --index * self->object_size);
+        object->next = slab->free_list;
+        slab->free_list = object;
+    }
+    slab->count = count;
+    slab->in_use = 0;
+    s_slab_link (self, slab);
+
+    //  Keep slabs in address order, so we can find an object's slab
+    index = self->nbr_slabs? s_slab_index (self, slab): 0;
+    if (index < self->nbr_slabs && self->slabs [index] < slab)
+        index++;
+    memmove (&self->slabs [index + 1], &self->slabs [index],
+             (self->nbr_slabs - index) * sizeof (slab_t *));
+    self->slabs [index] = slab;
+    self->nbr_slabs++;
+
+    self->capacity += count;
+    self->available += count;
+    return 0;
+}
+
+//  Give an empty slab back to the heap
+
+static void
+s_slab_destroy (zslab_t *self, size_t index)
+{
+    slab_t *slab = self->slabs [index];
+    assert (slab->in_use == 0);
+    s_slab_unlink (self, slab);
+    self->nbr_slabs--;
+    memmove (&self->slabs [index], &self->slabs [index + 1],
+             (self->nbr_slabs - index) * sizeof (slab_t *));
+    self->capacity -= slab->count;
+    self->available -= slab->count;
+    free (slab);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a zeroed object from the pool. Takes a free object if there is
+//  one, else allocates a new slab of objects from the heap. Returns NULL if
+//  the process ran out of heap memory.
+
+void *
+zslab_alloc (zslab_t *self)
+{
+    assert (self);
+    if (!self->partial) {
+        //  Grow pool by its current capacity, within limits
+        size_t count = self->capacity;
+        if (count < SLAB_INITIAL)
+            count = SLAB_INITIAL;
+        else
+        if (count > SLAB_MAXIMUM)
+            count = SLAB_MAXIMUM;
+        if (s_slab_new (self, count))
+            return NULL;
+    }
+    slab_t *slab = self->partial;
+    object_t *object = slab->free_list;
+    slab->free_list = object->next;
+    if (!slab->free_list)
+        s_slab_unlink (self, slab);
+    slab->in_use++;
+    self->available--;
+    memset (object, 0, self->object_size);
+    return object;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Give an object back to the pool, so it can be reused. The object must
+//  have come from this pool. Never gives memory back to the heap; call
+//  zslab_trim for that.
+
+void
+zslab_free (zslab_t *self, void *object)
+{
+    assert (self);
+    if (object) {
+        size_t index = s_slab_index (self, object);
+        slab_t *slab = self->slabs [index];
+        assert ((byte *) object >= s_slab_objects (slab)
+            &&  (byte *) object < s_slab_objects (slab) + slab->count * self->object_size);
+        if (!slab->free_list)
+            s_slab_link (self, slab);
+        ((object_t *) object)->next = slab->free_list;
+        slab->free_list = (object_t *) object;
+        slab->in_use--;
+        self->available++;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Give all empty slabs back to the heap, except for the capacity asked
+//  for by zslab_reserve. Containers call this when they are purged.
+
+void
+zslab_trim (zslab_t *self)
+{
+    assert (self);
+    size_t index = self->nbr_slabs;
+    while (index--) {
+        slab_t *slab = self->slabs [index];
+        if (slab->in_use == 0
+        &&  self->capacity - slab->count >= self->reserved)
+            s_slab_destroy (self, index);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Make sure at least the specified number of objects are free in the
+//  pool, so that many calls to zslab_alloc will not touch the heap. The
+//  pool keeps this capacity until it is destroyed, or reserve is called
+//  again. Returns 0 if OK, or -1 if the process ran out of heap memory.
+
+int
+zslab_reserve (zslab_t *self, size_t count)
+{
+    assert (self);
+    self->reserved = self->capacity - self->available + count;
+    return zslab_grow (self, count);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Make sure at least the specified number of objects are free in the
+//  pool, like zslab_reserve, but without keeping that capacity: the next
+//  zslab_trim may give it back to the heap. Returns 0 if OK, or -1 if the
+//  process ran out of heap memory.
+
+int
+zslab_grow (zslab_t *self, size_t count)
+{
+    assert (self);
+    if (count > self->available)
+        return s_slab_new (self, count - self->available);
+    else
+        return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of objects the pool has allocated from the heap
+
+size_t
+zslab_capacity (zslab_t *self)
+{
+    assert (self);
+    return self->capacity;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of objects that are free in the pool
+
+size_t
+zslab_available (zslab_t *self)
+{
+    assert (self);
+    return self->available;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+zslab_test (bool verbose)
+{
+    printf (" * zslab: ");
+
+    //  @selftest
+    zslab_t *slab = zslab_new (3);
+    assert (slab);
+    assert (zslab_capacity (slab) == 0);
+    assert (zslab_available (slab) == 0);
+
+    //  Objects are zeroed, aligned, and do not overlap
+    char *first = (char *) zslab_alloc (slab);
+    char *second = (char *) zslab_alloc (slab);
+    assert (first && second);
+    assert (first [0] == 0 && first [2] == 0);
+    assert ((size_t) first % sizeof (void *) == 0);
+    assert ((size_t) second % sizeof (void *) == 0);
+    assert (second - first >= 3 || first - second >= 3);
+    strcpy (first, "ab");
+    strcpy (second, "cd");
+    assert (streq (first, "ab"));
+    assert (zslab_capacity (slab) == zslab_available (slab) + 2);
+
+    //  Freed objects are reused before the pool grows
+    size_t capacity = zslab_capacity (slab);
+    zslab_free (slab, first);
+    char *third = (char *) zslab_alloc (slab);
+    assert (third == first);
+    assert (third [0] == 0);
+    assert (zslab_capacity (slab) == capacity);
+    zslab_free (slab, second);
+    zslab_free (slab, third);
+    assert (zslab_available (slab) == capacity);
+
+    //  Reserved objects are handed out without touching the heap
+    int rc = zslab_reserve (slab, 1000);
+    assert (rc == 0);
+    capacity = zslab_capacity (slab);
+    assert (capacity == 1000);
+    assert (zslab_available (slab) == 1000);
+    void *objects [1000];
+    int index;
+    for (index = 0; index < 1000; index++) {
+        objects [index] = zslab_alloc (slab);
+        assert (objects [index]);
+    }
+    assert (zslab_capacity (slab) == capacity);
+    assert (zslab_available (slab) == 0);
+    for (index = 0; index < 1000; index++)
+        zslab_free (slab, objects [index]);
+    assert (zslab_available (slab) == 1000);
+
+    //  Reserving what we already have does nothing
+    rc = zslab_reserve (slab, 10);
+    assert (rc == 0);
+    assert (zslab_capacity (slab) == capacity);
+    zslab_destroy (&slab);
+
+    //  A pool keeps its high-water mark, so refilling it is free
+    slab = zslab_new (sizeof (int));
+    assert (slab);
+    for (index = 0; index < 1000; index++)
+        objects [index] = zslab_alloc (slab);
+    capacity = zslab_capacity (slab);
+    assert (capacity >= 1000);
+    for (index = 0; index < 1000; index++)
+        zslab_free (slab, objects [index]);
+    assert (zslab_capacity (slab) == capacity);
+    assert (zslab_available (slab) == capacity);
+    for (index = 0; index < 1000; index++)
+        objects [index] = zslab_alloc (slab);
+    assert (zslab_capacity (slab) == capacity);
+    for (index = 0; index < 1000; index++)
+        zslab_free (slab, objects [index]);
+
+    //  Trimming gives back every empty slab, down to the reservation
+    zslab_trim (slab);
+    assert (zslab_capacity (slab) == 0);
+    rc = zslab_reserve (slab, 100);
+    assert (rc == 0);
+    assert (zslab_capacity (slab) == 100);
+    zslab_trim (slab);
+    assert (zslab_capacity (slab) == 100);
+    for (index = 0; index < 500; index++)
+        objects [index] = zslab_alloc (slab);
+    for (index = 0; index < 500; index++)
+        zslab_free (slab, objects [index]);
+    zslab_trim (slab);
+    assert (zslab_capacity (slab) >= 100);
+    assert (zslab_capacity (slab) < 500);
+
+    //  Growing the pool does not reserve anything
+    zslab_t *spare = zslab_new (sizeof (int));
+    assert (spare);
+    rc = zslab_grow (spare, 1000);
+    assert (rc == 0);
+    assert (zslab_capacity (spare) == 1000);
+    zslab_trim (spare);
+    assert (zslab_capacity (spare) == 0);
+    zslab_destroy (&spare);
+
+    //  Destroying the pool frees objects still in use
+    assert (zslab_alloc (slab));
+    zslab_destroy (&slab);
+    assert (slab == NULL);
+    //  @end
+
+    printf ("OK\n");
+}
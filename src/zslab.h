@@ -0,0 +1,83 @@
+/*  =========================================================================
+    zslab - fixed-size object pool, used internally by containers
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZSLAB_H_INCLUDED__
+#define __ZSLAB_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Opaque class structure
+typedef struct _zslab_t zslab_t;
+
+//  @interface
+//  Create a new pool for objects of the specified size. Does not allocate
+//  any objects until they are needed.
+CZMQ_EXPORT zslab_t *
+    zslab_new (size_t object_size);
+
+//  Destroy a pool, and all objects allocated from it, whether or not they
+//  were given back to the pool.
+CZMQ_EXPORT void
+    zslab_destroy (zslab_t **self_p);
+
+//  Return a zeroed object from the pool. Takes a free object if there is
+//  one, else allocates a new slab of objects from the heap. Returns NULL if
+//  the process ran out of heap memory.
+CZMQ_EXPORT void *
+    zslab_alloc (zslab_t *self);
+
+//  Give an object back to the pool, so it can be reused. The object must
+//  have come from this pool. Never gives memory back to the heap; call
+//  zslab_trim for that.
+CZMQ_EXPORT void
+    zslab_free (zslab_t *self, void *object);
+
+//  Give all empty slabs back to the heap, except for the capacity asked
+//  for by zslab_reserve. Containers call this when they are purged.
+CZMQ_EXPORT void
+    zslab_trim (zslab_t *self);
+
+//  Make sure at least the specified number of objects are free in the
+//  pool, so that many calls to zslab_alloc will not touch the heap. The
+//  pool keeps this capacity until it is destroyed, or reserve is called
+//  again. Returns 0 if OK, or -1 if the process ran out of heap memory.
+CZMQ_EXPORT int
+    zslab_reserve (zslab_t *self, size_t count);
+
+//  Make sure at least the specified number of objects are free in the
+//  pool, like zslab_reserve, but without keeping that capacity: the next
+//  zslab_trim may give it back to the heap. Returns 0 if OK, or -1 if the
+//  process ran out of heap memory.
+CZMQ_EXPORT int
+    zslab_grow (zslab_t *self, size_t count);
+
+//  Return the number of objects the pool has allocated from the heap
+CZMQ_EXPORT size_t
+    zslab_capacity (zslab_t *self);
+
+//  Return the number of objects that are free in the pool
+CZMQ_EXPORT size_t
+    zslab_available (zslab_t *self);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zslab_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,6 +23,7 @@
 */
 
 #include "../include/czmq.h"
+#include "zpollset.h"
 
 //  zsock_t instances always have this tag as the first 4 octets of
 //  their data, which lets us do runtime object typing & validation.
@@ -33,12 +34,49 @@
 #define DYNAMIC_FIRST       0xc000    // 49152
 #define DYNAMIC_LAST        0xffff    // 65535
 
+//  zsock_resolve remembers this many raw handles per thread; must be a
+//  power of two
+#define RESOLVE_CACHE       64
+
+//  zsock_bsend and zsock_brecv remember this many compiled pictures per
+//  thread, each up to PICTURE_MAX elements long; must be a power of two
+#define PICTURE_CACHE       16
+#define PICTURE_MAX         31
+
+//  Raw handle that zsock_resolve has already probed
+typedef struct {
+    void *self;                 //  Reference passed to zsock_resolve
+    void *handle;               //  What zsock_resolve returned for it
+    uint generation;            //  zsys_handle_generation at the time
+} s_resolved_t;
+
+static CZMQ_THREADLS s_resolved_t s_resolved [RESOLVE_CACHE];
+
+//  Binary picture, checked and sized once for zsock_bsend and zsock_brecv
+typedef struct {
+    const char *picture;        //  Picture string we compiled, if cached
+    char source [PICTURE_MAX + 1];  //  Copy of picture string
+    size_t fixed_size;          //  Octets taken by fixed-size elements
+    size_t strings;             //  Number of string elements
+    bool variable;              //  Any string or data elements?
+} s_bpicture_t;
+
+static CZMQ_THREADLS s_bpicture_t s_bpictures [PICTURE_CACHE];
+
 //  Structure of our class
 
 struct _zsock_t {
     uint32_t tag;               //  Object tag for runtime detection
     void *handle;               //  The libzmq socket handle
     char *endpoint;             //  Last bound endpoint, if any
+    zpollset_t **watchers;      //  Poll sets watching socket, if any
+    size_t nbr_watchers;        //  Number of poll sets watching socket
+    bool dirty;                 //  Used since the poll sets last looked?
+    zmq_msg_t bmsg;             //  Last message from zsock_brecv
+    char *bstrings;             //  Strings from last zsock_brecv
+    size_t bstrings_size;       //  Allocated size of bstrings
+    zsignal_t *signal_out;      //  zsock_signal raises this, if set
+    zsignal_t *signal_in;       //  zsock_wait waits on this, if set
 };
 
 
@@ -55,6 +93,7 @@ zsock_new_ (int type, const char *filename, size_t line_nbr)
     zsock_t *self = (zsock_t *) zmalloc (sizeof (zsock_t));
     if (self) {
         self->tag = ZSOCK_TAG;
+        zmq_msg_init (&self->bmsg);
         self->handle = zsys_socket (type, filename, line_nbr);
         if (!self->handle) {
             zsock_destroy (&self);
@@ -76,6 +115,12 @@ zsock_destroy_ (zsock_t **self_p, const char *filename, size_t line_nbr)
         zsock_t *self = *self_p;
         assert (zsock_is (self));
         self->tag = 0xDeadBeef;
+        size_t index;
+        for (index = 0; index < self->nbr_watchers; index++)
+            zpollset_forget (self->watchers [index], self);
+        free (self->watchers);
+        zmq_msg_close (&self->bmsg);
+        free (self->bstrings);
         int rc = zsys_close (self->handle, filename, line_nbr);
         assert (rc == 0);
         free (self->endpoint);
@@ -765,6 +810,409 @@ zsock_recv (void *self, const char *picture, ...)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Check a binary picture and work out the size of its fixed elements.
+//  Asserts if the picture has an invalid element.
+
+static void
+s_bpicture_compile (const char *picture, s_bpicture_t *compiled)
+{
+    compiled->fixed_size = 0;
+    compiled->strings = 0;
+    compiled->variable = false;
+    const char *element;
+    for (element = picture; *element; element++) {
+        switch (*element) {
+            case '1': compiled->fixed_size += 1; break;
+            case '2': compiled->fixed_size += 2; break;
+            case '4': compiled->fixed_size += 4; break;
+            case '8': compiled->fixed_size += 8; break;
+            case 's': compiled->fixed_size += 1;
+                      compiled->strings++;
+                      compiled->variable = true;
+                      break;
+            case 'S': compiled->fixed_size += 4;
+                      compiled->strings++;
+                      compiled->variable = true;
+                      break;
+            case 'b': compiled->fixed_size += 4;
+                      compiled->variable = true;
+                      break;
+            case 'p': compiled->fixed_size += sizeof (void *); break;
+            default:
+                zsys_error ("zsock: invalid picture element '%c'", *element);
+                assert (false);
+        }
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return the compiled form of a binary picture. Pictures are usually
+//  string constants, so we cache them per thread by address, and check
+//  the text still matches. Longer pictures are compiled into the buffer
+//  the caller provides.
+
+static s_bpicture_t *
+s_bpicture_lookup (const char *picture, s_bpicture_t *buffer)
+{
+    size_t slot = ((uintptr_t) picture >> 3) & (PICTURE_CACHE - 1);
+    s_bpicture_t *compiled = &s_bpictures [slot];
+    if (compiled->picture == picture
+    &&  strncmp (compiled->source, picture, PICTURE_MAX + 1) == 0)
+        return compiled;
+
+    size_t length = strlen (picture);
+    if (length > PICTURE_MAX) {
+        s_bpicture_compile (picture, buffer);
+        return buffer;
+    }
+    s_bpicture_compile (picture, compiled);
+    memcpy (compiled->source, picture, length + 1);
+    compiled->picture = picture;
+    return compiled;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send a binary encoded 'picture' message to the socket (or actor). This
+//  works like zsock_send, except that all arguments go into one frame, in
+//  a compact binary encoding, so sending costs one allocation at most and
+//  no formatting. The picture can contain any of these characters, each
+//  corresponding to one or two arguments:
+//
+//      1 = uint8_t
+//      2 = uint16_t
+//      4 = uint32_t
+//      8 = uint64_t
+//      s = char *, up to 255 characters
+//      S = char *, any length up to 4GB
+//      b = byte *, size_t (2 arguments), up to 4GB
+//      p = void * (sends the pointer value, only meaningful over inproc)
+//
+//  Integers are sent in network byte order. Does not change or take
+//  ownership of any arguments. Returns 0 if successful, -1 if a string or
+//  data is too long, or sending failed for any reason.
+
+int
+zsock_bsend (void *self, const char *picture, ...)
+{
+    assert (self);
+    assert (picture);
+    s_bpicture_t buffer;
+    s_bpicture_t *compiled = s_bpicture_lookup (picture, &buffer);
+
+    //  Only strings and data need a pass to size the frame
+    va_list argptr;
+    size_t frame_size = compiled->fixed_size;
+    if (compiled->variable) {
+        va_start (argptr, picture);
+        const char *element;
+        for (element = picture; *element; element++) {
+            switch (*element) {
+                case '1':
+                case '2': va_arg (argptr, int); break;
+                case '4': va_arg (argptr, uint32_t); break;
+                case '8': va_arg (argptr, uint64_t); break;
+                case 'p': va_arg (argptr, void *); break;
+                case 's':
+                case 'S': {
+                    char *string = va_arg (argptr, char *);
+                    size_t string_size = string? strlen (string): 0;
+                    if (string_size > (*element == 's'? 255: UINT32_MAX)) {
+                        va_end (argptr);
+                        return -1;
+                    }
+                    frame_size += string_size;
+                    break;
+                }
+                case 'b': {
+                    va_arg (argptr, byte *);
+                    size_t size = va_arg (argptr, size_t);
+                    if (size > UINT32_MAX) {
+                        va_end (argptr);
+                        return -1;
+                    }
+                    frame_size += size;
+                    break;
+                }
+            }
+        }
+        va_end (argptr);
+    }
+
+    //  Encode the arguments straight into the frame
+    zmq_msg_t msg;
+    if (zmq_msg_init_size (&msg, frame_size))
+        return -1;
+    byte *needle = (byte *) zmq_msg_data (&msg);
+    va_start (argptr, picture);
+    const char *element;
+    for (element = picture; *element; element++) {
+        switch (*element) {
+            case '1':
+                *needle++ = (byte) va_arg (argptr, int);
+                break;
+            case '2': {
+                uint16_t value = (uint16_t) va_arg (argptr, int);
+                *needle++ = (byte) (value >> 8);
+                *needle++ = (byte) (value);
+                break;
+            }
+            case '4': {
+                uint32_t value = va_arg (argptr, uint32_t);
+                int shift;
+                for (shift = 24; shift >= 0; shift -= 8)
+                    *needle++ = (byte) (value >> shift);
+                break;
+            }
+            case '8': {
+                uint64_t value = va_arg (argptr, uint64_t);
+                int shift;
+                for (shift = 56; shift >= 0; shift -= 8)
+                    *needle++ = (byte) (value >> shift);
+                break;
+            }
+            case 's':
+            case 'S': {
+                char *string = va_arg (argptr, char *);
+                uint32_t string_size = string? (uint32_t) strlen (string): 0;
+                if (*element == 'S') {
+                    *needle++ = (byte) (string_size >> 24);
+                    *needle++ = (byte) (string_size >> 16);
+                    *needle++ = (byte) (string_size >> 8);
+                }
+                *needle++ = (byte) string_size;
+                if (string_size) {
+                    memcpy (needle, string, string_size);
+                    needle += string_size;
+                }
+                break;
+            }
+            case 'b': {
+                byte *data = va_arg (argptr, byte *);
+                uint32_t size = (uint32_t) va_arg (argptr, size_t);
+                *needle++ = (byte) (size >> 24);
+                *needle++ = (byte) (size >> 16);
+                *needle++ = (byte) (size >> 8);
+                *needle++ = (byte) size;
+                if (size) {
+                    memcpy (needle, data, size);
+                    needle += size;
+                }
+                break;
+            }
+            case 'p': {
+                void *pointer = va_arg (argptr, void *);
+                memcpy (needle, &pointer, sizeof (void *));
+                needle += sizeof (void *);
+                break;
+            }
+        }
+    }
+    va_end (argptr);
+    assert (needle == (byte *) zmq_msg_data (&msg) + frame_size);
+
+    if (zmq_sendmsg (zsock_resolve (self), &msg, 0) == -1) {
+        zmq_msg_close (&msg);
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded 'picture' message from the socket (or actor).
+//  See zsock_bsend for the format and meaning of the picture. Returns the
+//  picture elements into a series of pointers as provided by the caller:
+//
+//      1 = uint8_t * (stores integer)
+//      2 = uint16_t * (stores integer)
+//      4 = uint32_t * (stores integer)
+//      8 = uint64_t * (stores integer)
+//      s = char ** (stores pointer into socket buffer)
+//      S = char ** (stores pointer into socket buffer)
+//      b = byte **, size_t * (2 arguments) (stores pointer into frame)
+//      p = void ** (stores pointer)
+//
+//  Note that zsock_brecv does not allocate anything once the socket has
+//  received a message of the same size: data are returned as pointers into
+//  the received frame, and strings as pointers into a buffer the socket
+//  owns. Both stay valid until the next zsock_brecv call, or until the
+//  socket is destroyed. You must copy any values you want to keep beyond
+//  that, and must not change them, as the frame may be shared with other
+//  receivers. Returns 0 if successful, or -1 if it failed to receive a
+//  message, or the message did not match the picture, in which case the
+//  pointers are not all set. If an argument pointer is NULL, does not store
+//  any value (skips it). Takes a zsock_t or zactor_t argument, not a
+//  libzmq socket.
+
+int
+zsock_brecv (void *self, const char *picture, ...)
+{
+    assert (self);
+    assert (picture);
+    zsock_t *sock = zactor_is (self)? zactor_sock ((zactor_t *) self): (zsock_t *) self;
+    assert (zsock_is (sock));
+    s_bpicture_t buffer;
+    s_bpicture_t *compiled = s_bpicture_lookup (picture, &buffer);
+
+    //  The previous frame goes away here, with any pointers into it
+    if (zmq_recvmsg (zsock_resolve (sock), &sock->bmsg, 0) == -1)
+        return -1;              //  Interrupted
+    if (zsock_rcvmore (sock)) {
+        zsock_flush (sock);
+        return -1;              //  Not a binary picture message
+    }
+    const byte *needle = (const byte *) zmq_msg_data (&sock->bmsg);
+    const byte *ceiling = needle + zmq_msg_size (&sock->bmsg);
+    size_t frame_size = zmq_msg_size (&sock->bmsg);
+    if (frame_size < compiled->fixed_size
+    || (!compiled->variable && frame_size != compiled->fixed_size))
+        return -1;              //  Message does not match picture
+
+    //  We copy strings out so we can null-terminate them, as the frame may
+    //  be shared. Each string loses a length header of at least one octet
+    //  and gains a null, so they all fit into the size of the frame.
+    char *string_needle = NULL;
+    if (compiled->strings) {
+        if (sock->bstrings_size < frame_size) {
+            char *bstrings = (char *) realloc (sock->bstrings, frame_size);
+            if (!bstrings)
+                return -1;
+            sock->bstrings = bstrings;
+            sock->bstrings_size = frame_size;
+        }
+        string_needle = sock->bstrings;
+    }
+    int rc = 0;
+    va_list argptr;
+    va_start (argptr, picture);
+    while (*picture && rc == 0) {
+        switch (*picture) {
+            case '1': {
+                uint8_t *number_p = va_arg (argptr, uint8_t *);
+                if (needle + 1 > ceiling)
+                    rc = -1;
+                else {
+                    if (number_p)
+                        *number_p = *needle;
+                    needle += 1;
+                }
+                break;
+            }
+            case '2': {
+                uint16_t *number_p = va_arg (argptr, uint16_t *);
+                if (needle + 2 > ceiling)
+                    rc = -1;
+                else {
+                    if (number_p)
+                        *number_p = ((uint16_t) needle [0] << 8)
+                                  +  (uint16_t) needle [1];
+                    needle += 2;
+                }
+                break;
+            }
+            case '4': {
+                uint32_t *number_p = va_arg (argptr, uint32_t *);
+                if (needle + 4 > ceiling)
+                    rc = -1;
+                else {
+                    if (number_p)
+                        *number_p = ((uint32_t) needle [0] << 24)
+                                  + ((uint32_t) needle [1] << 16)
+                                  + ((uint32_t) needle [2] << 8)
+                                  +  (uint32_t) needle [3];
+                    needle += 4;
+                }
+                break;
+            }
+            case '8': {
+                uint64_t *number_p = va_arg (argptr, uint64_t *);
+                if (needle + 8 > ceiling)
+                    rc = -1;
+                else {
+                    if (number_p) {
+                        uint64_t value = 0;
+                        int index;
+                        for (index = 0; index < 8; index++)
+                            value = (value << 8) + needle [index];
+                        *number_p = value;
+                    }
+                    needle += 8;
+                }
+                break;
+            }
+            case 's':
+            case 'S': {
+                char **string_p = va_arg (argptr, char **);
+                size_t header = *picture == 's'? 1: 4;
+                size_t string_size = 0;
+                if (needle + header > ceiling)
+                    rc = -1;
+                else {
+                    size_t index;
+                    for (index = 0; index < header; index++)
+                        string_size = (string_size << 8) + needle [index];
+                    if (string_size > (size_t) (ceiling - needle - header))
+                        rc = -1;
+                }
+                if (rc == 0) {
+                    memcpy (string_needle, needle + header, string_size);
+                    string_needle [string_size] = 0;
+                    if (string_p)
+                        *string_p = string_needle;
+                    string_needle += string_size + 1;
+                    needle += header + string_size;
+                }
+                break;
+            }
+            case 'b': {
+                byte **data_p = va_arg (argptr, byte **);
+                size_t *size_p = va_arg (argptr, size_t *);
+                size_t size = 0;
+                if (needle + 4 > ceiling)
+                    rc = -1;
+                else {
+                    size = ((size_t) needle [0] << 24)
+                         + ((size_t) needle [1] << 16)
+                         + ((size_t) needle [2] << 8)
+                         +  (size_t) needle [3];
+                    if (size > (size_t) (ceiling - needle - 4))
+                        rc = -1;
+                }
+                if (rc == 0) {
+                    if (data_p)
+                        *data_p = (byte *) needle + 4;
+                    if (size_p)
+                        *size_p = size;
+                    needle += 4 + size;
+                }
+                break;
+            }
+            case 'p': {
+                void **pointer_p = va_arg (argptr, void **);
+                if (needle + sizeof (void *) > ceiling)
+                    rc = -1;
+                else {
+                    if (pointer_p)
+                        memcpy (pointer_p, needle, sizeof (void *));
+                    needle += sizeof (void *);
+                }
+                break;
+            }
+        }
+        picture++;
+    }
+    va_end (argptr);
+    if (needle != ceiling)
+        rc = -1;                //  Message is longer than picture
+    return rc;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Set socket to use unbounded pipes (HWM=0); use this in cases when you are
 //  totally certain the message volume can fit in memory. This method works
@@ -781,55 +1229,103 @@ zsock_set_unbounded (void *self)
 #endif
 }
 
+//  --------------------------------------------------------------------------
+//  Local helper function
+//  Return the zsock_t behind a polymorphic socket reference, or NULL if it
+//  is a libzmq socket handle.
+
+static zsock_t *
+s_zsock_of (void *self)
+{
+    if (zsock_is (self))
+        return (zsock_t *) self;
+    else
+    if (zactor_is (self))
+        return zactor_sock ((zactor_t *) self);
+    else
+        return NULL;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Send a signal over a socket. A signal is a short message carrying a
 //  success/failure code (by convention, 0 means OK). Signals are encoded
-//  to be distinguishable from "normal" messages. Accepts a zock_t or a
-//  zactor_t argument, and returns 0 if successful, -1 if the signal could
-//  not be sent. Takes a polymorphic socket reference.
+//  to be distinguishable from "normal" messages. If the socket has an
+//  outgoing zsignal_t, as an actor's pipe does when it was created with
+//  zactor_options_set_signals, the signal goes through that instead of the
+//  socket. Accepts a zock_t or a zactor_t argument, and returns 0 if
+//  successful, -1 if the signal could not be sent. Takes a polymorphic
+//  socket reference.
 
 int
 zsock_signal (void *self, byte status)
 {
     assert (self);
+    zsock_t *sock = s_zsock_of (self);
+    if (sock && sock->signal_out)
+        return zsignal_send (sock->signal_out, status);
+
+    //  Send the signal as a single frame, without building a zmsg_t
     int64_t signal_value = 0x7766554433221100L + status;
-    zmsg_t *msg = zmsg_new ();
-    int rc = zmsg_addmem (msg, &signal_value, 8);
-    if (rc == 0)
-        rc = zmsg_send (&msg, self);
-    return rc;
+    zmq_msg_t msg;
+    if (zmq_msg_init_size (&msg, 8))
+        return -1;
+    memcpy (zmq_msg_data (&msg), &signal_value, 8);
+    if (zmq_sendmsg (zsock_resolve (self), &msg, 0) == -1) {
+        zmq_msg_close (&msg);
+        return -1;
+    }
+    return 0;
 }
 
 
 //  --------------------------------------------------------------------------
 //  Wait on a signal. Use this to coordinate between threads, over pipe
-//  pairs. Blocks until the signal is received. Returns -1 on error, 0 or
-//  greater on success. Accepts a zsock_t or a zactor_t as argument.
-//  Takes a polymorphic socket reference.
+//  pairs. Blocks until the signal is received, or the socket's receive
+//  timeout expires. If the socket has an incoming zsignal_t, as a zactor
+//  does when created with zactor_options_set_signals, waits on that
+//  instead of the socket. Returns -1 on error, 0 or greater on success.
+//  Accepts a zsock_t or a zactor_t as argument. Takes a polymorphic socket
+//  reference.
 
 int
 zsock_wait (void *self)
 {
     assert (self);
+    zsock_t *sock = s_zsock_of (self);
+    if (sock && sock->signal_in)
+#if (ZMQ_VERSION_MAJOR == 2)
+        return zsignal_wait (sock->signal_in, -1);
+#else
+        return zsignal_wait (sock->signal_in, zsock_rcvtimeo (sock));
+#endif
 
     //  A signal is a message containing one frame with our 8-byte magic
     //  value. If we get anything else, we discard it and continue to look
     //  for the signal message
+    void *handle = zsock_resolve (self);
+    zmq_msg_t msg;
+    zmq_msg_init (&msg);
     while (true) {
-        zmsg_t *msg = zmsg_recv (self);
-        if (!msg)
-            return -1;
-        if (  zmsg_size (msg) == 1
-           && zmsg_content_size (msg) == 8) {
-            zframe_t *frame = zmsg_first (msg);
-            int64_t signal_value = *((int64_t *) zframe_data (frame));
+        if (zmq_recvmsg (handle, &msg, 0) == -1)
+            break;
+        if (zsock_rcvmore (self)) {
+            //  Skip the rest of this message
+            while (zsock_rcvmore (self))
+                if (zmq_recvmsg (handle, &msg, 0) == -1)
+                    break;
+        }
+        else
+        if (zmq_msg_size (&msg) == 8) {
+            int64_t signal_value;
+            memcpy (&signal_value, zmq_msg_data (&msg), 8);
             if ((signal_value & 0xFFFFFFFFFFFFFF00L) == 0x7766554433221100L) {
-                zmsg_destroy (&msg);
+                zmq_msg_close (&msg);
                 return signal_value & 255;
             }
         }
-        zmsg_destroy (&msg);
     }
+    zmq_msg_close (&msg);
     return -1;
 }
 
@@ -863,35 +1359,132 @@ zsock_is (void *self)
 
 //  --------------------------------------------------------------------------
 //  Probe the supplied reference. If it looks like a zsock_t instance, return
-//  the underlying libzmq socket handle; elsie if it looks like a file
+//  the underlying libzmq socket handle; else if it looks like a file
 //  descriptor, return NULL; else if it looks like a libzmq socket handle,
-//  return the supplied value. Takes a polymorphic socket reference.
+//  return the supplied value. Takes a polymorphic socket reference. The
+//  answer for libzmq handles and file descriptors is cached per thread, so
+//  only the first call for each costs a system call; a file descriptor must
+//  be valid when it is passed.
 
 void *
 zsock_resolve (void *self)
 {
     assert (self);
-    if (zsock_is (self))
-        return ((zsock_t *) self)->handle;
+    if (zsock_is (self)) {
+        zsock_t *sock = (zsock_t *) self;
+        //  If the socket is in epoll-based poll sets, tell them that the
+        //  socket is in use, as that may change its state silently. We do
+        //  this once, until a poll set rechecks the socket, so that a busy
+        //  socket pays only for a flag test on each send and receive.
+        if (sock->nbr_watchers && !sock->dirty) {
+            sock->dirty = true;
+            size_t index;
+            for (index = 0; index < sock->nbr_watchers; index++)
+                zpollset_touch (sock->watchers [index], sock);
+        }
+        return sock->handle;
+    }
     else
     if (zactor_is (self))
         return zactor_resolve (self);
 
+    //  Telling a libzmq handle from a file descriptor takes a system call,
+    //  so we remember the answer for each reference. Whenever a ZMQ socket
+    //  is closed, its memory may be reused, so we then start afresh.
+    uint generation = zsys_handle_generation ();
+    s_resolved_t *resolved =
+        &s_resolved [((size_t) self / sizeof (int)) & (RESOLVE_CACHE - 1)];
+    if (resolved->self == self && resolved->generation == generation)
+        return resolved->handle;
+
+    void *handle = self;
     int sock_type = -1;
     //  TODO: this code should move to zsys_isfd ()
 #if defined (__WINDOWS__)
     int sock_type_size = sizeof (int);
     int rc = getsockopt (*(SOCKET *) self, SOL_SOCKET, SO_TYPE, (char *) &sock_type, &sock_type_size);
     if (rc == 0)
-        return NULL;        //  It's a socket descriptor
+        handle = NULL;      //  It's a socket descriptor
 #else
     socklen_t sock_type_size = sizeof (socklen_t);
     int rc = getsockopt (*(SOCKET *) self, SOL_SOCKET, SO_TYPE, (char *) &sock_type, &sock_type_size);
     if (rc == 0 || (rc == -1 && errno == ENOTSOCK))
-        return NULL;        //  It's a socket FD or FD
+        handle = NULL;      //  It's a socket FD or FD
 #endif
-    //  Socket appears to be something else, return it as-is
-    return self;
+    //  Else socket appears to be something else, return it as-is
+    resolved->self = self;
+    resolved->handle = handle;
+    resolved->generation = generation;
+    return handle;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set or clear the zsignal_t objects that zsock_signal and zsock_wait use
+//  instead of the socket. Used by zactor only; the caller keeps ownership
+//  of the signals.
+
+void
+zsock_set_signals (zsock_t *self, zsignal_t *signal_out, zsignal_t *signal_in)
+{
+    assert (self);
+    self->signal_out = signal_out;
+    self->signal_in = signal_in;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a poll set to the ones that watch a socket. A socket may be in any
+//  number of poll sets. Used by zpollset only. Returns 0 if OK, -1 if the
+//  process ran out of heap memory.
+
+int
+zsock_add_watcher (zsock_t *self, zpollset_t *watcher)
+{
+    assert (self);
+    assert (watcher);
+    zpollset_t **watchers = (zpollset_t **) realloc (self->watchers,
+        (self->nbr_watchers + 1) * sizeof (zpollset_t *));
+    if (!watchers)
+        return -1;
+    self->watchers = watchers;
+    self->watchers [self->nbr_watchers++] = watcher;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Remove a poll set from the ones that watch a socket. Does nothing if
+//  the poll set does not watch the socket. Used by zpollset only.
+
+void
+zsock_remove_watcher (zsock_t *self, zpollset_t *watcher)
+{
+    assert (self);
+    size_t index;
+    for (index = 0; index < self->nbr_watchers; index++)
+        if (self->watchers [index] == watcher) {
+            self->watchers [index] = self->watchers [--self->nbr_watchers];
+            if (self->nbr_watchers == 0) {
+                free (self->watchers);
+                self->watchers = NULL;
+            }
+            break;
+        }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Tell the socket that a poll set is about to recheck its state, so the
+//  next send or receive must tell its poll sets again. Every poll set that
+//  watches the socket was told about the last use, and rechecks it in its
+//  own time. Used by zpollset only.
+
+void
+zsock_set_clean (zsock_t *self)
+{
+    assert (self);
+    self->dirty = false;
 }
 
 
@@ -936,6 +1529,22 @@ zsock_test (bool verbose)
     // Test resolve fd
     int fd = zsock_fd (reader);
     assert (zsock_resolve ((void *) &fd) == NULL);
+    assert (zsock_resolve ((void *) &fd) == NULL);
+
+    //  Test resolve raw libzmq handle, before and after a socket is
+    //  created and closed; both must expire cached results
+    void *handle = zsock_resolve (reader);
+    assert (zsock_resolve (handle) == handle);
+    assert (zsock_resolve (handle) == handle);
+    uint generation = zsys_handle_generation ();
+    zsock_t *closed = zsock_new (ZMQ_PAIR);
+    assert (closed);
+    assert (zsys_handle_generation () != generation);
+    generation = zsys_handle_generation ();
+    zsock_destroy (&closed);
+    assert (zsys_handle_generation () != generation);
+    assert (zsock_resolve (handle) == handle);
+    assert (zsock_resolve ((void *) &fd) == NULL);
 
     zstr_send (writer, "Hello, World");
     zmsg_t *msg = zmsg_recv (reader);
@@ -970,6 +1579,8 @@ zsock_test (bool verbose)
     //  Test zsock_recv into each supported type
     zsock_send (writer, "izsbcfhp",
                 -12345, "This is a string", "ABCDE", 5, chunk, frame, hash, original);
+    //  The message has its own copy of the frame data
+    memcpy (zframe_data (frame), "EARTH", 5);
     zframe_destroy (&frame);
     zchunk_destroy (&chunk);
     zhash_destroy (&hash);
@@ -1042,6 +1653,113 @@ zsock_test (bool verbose)
     assert (zchunk_size (chunk) == 5);
     zchunk_destroy (&chunk);
 
+    //  Test zsock_bsend/brecv binary pictures
+    rc = zsock_bsend (writer, "1248sSbp",
+                      0xAB, 0xABCD, 0xABCDEF01, 0x0123456789ABCDEFULL,
+                      "short", "This is a longer string", "ABCDE", (size_t) 5,
+                      original);
+    assert (rc == 0);
+    uint8_t number1;
+    uint16_t number2;
+    uint32_t number4;
+    uint64_t number8;
+    char *long_string;
+    rc = zsock_brecv (reader, "1248sSbp",
+                      &number1, &number2, &number4, &number8,
+                      &string, &long_string, &data, &size, &pointer);
+    assert (rc == 0);
+    assert (number1 == 0xAB);
+    assert (number2 == 0xABCD);
+    assert (number4 == 0xABCDEF01);
+    assert (number8 == 0x0123456789ABCDEFULL);
+    assert (streq (string, "short"));
+    assert (streq (long_string, "This is a longer string"));
+    assert (size == 5);
+    assert (memcmp (data, "ABCDE", 5) == 0);
+    assert (pointer == original);
+
+    //  Empty values, and null arguments, are allowed
+    rc = zsock_bsend (writer, "sb", "", NULL, (size_t) 0);
+    assert (rc == 0);
+    rc = zsock_brecv (reader, "sb", &string, NULL, &size);
+    assert (rc == 0);
+    assert (streq (string, ""));
+    assert (size == 0);
+
+    //  A message that does not match the picture is rejected
+    rc = zsock_bsend (writer, "4", 1);
+    assert (rc == 0);
+    rc = zsock_brecv (reader, "8", &number8);
+    assert (rc == -1);
+    rc = zsock_bsend (writer, "8", (uint64_t) 1);
+    assert (rc == 0);
+    rc = zsock_brecv (reader, "4", &number4);
+    assert (rc == -1);
+    zsock_send (writer, "ss", "two", "frames");
+    rc = zsock_brecv (reader, "s", &string);
+    assert (rc == -1);
+
+    //  Short strings must fit their one-octet length
+    char long_buffer [300];
+    memset (long_buffer, 'x', 299);
+    long_buffer [299] = 0;
+    rc = zsock_bsend (writer, "s", long_buffer);
+    assert (rc == -1);
+    rc = zsock_bsend (writer, "S", long_buffer);
+    assert (rc == 0);
+    rc = zsock_brecv (reader, "S", &string);
+    assert (rc == 0);
+    assert (streq (string, long_buffer));
+
+    //  Data longer than 4GB cannot be sent
+#if (SIZE_MAX > UINT32_MAX)
+    rc = zsock_bsend (writer, "b", long_buffer, (size_t) UINT32_MAX + 1);
+    assert (rc == -1);
+#endif
+    //  Receivers that share one frame all see the same values
+    zsock_t *publisher = zsock_new_pub ("@inproc://zsock.bpicture");
+    assert (publisher);
+    zsock_t *subscriber1 = zsock_new (ZMQ_SUB);
+    assert (subscriber1);
+    zsock_set_subscribe (subscriber1, "");
+    rc = zsock_connect (subscriber1, "inproc://zsock.bpicture");
+    assert (rc == 0);
+    zsock_t *subscriber2 = zsock_new (ZMQ_SUB);
+    assert (subscriber2);
+    zsock_set_subscribe (subscriber2, "");
+    rc = zsock_connect (subscriber2, "inproc://zsock.bpicture");
+    assert (rc == 0);
+    //  Wait until both subscriptions have reached the publisher
+    zsock_set_rcvtimeo (subscriber1, 10);
+    zsock_set_rcvtimeo (subscriber2, 10);
+    bool ready1 = false;
+    bool ready2 = false;
+    while (!ready1 || !ready2) {
+        zsock_bsend (publisher, "S", "");
+        if (zsock_brecv (subscriber1, "S", NULL) == 0)
+            ready1 = true;
+        if (zsock_brecv (subscriber2, "S", NULL) == 0)
+            ready2 = true;
+    }
+    while (zsock_brecv (subscriber1, "S", NULL) == 0) ;
+    while (zsock_brecv (subscriber2, "S", NULL) == 0) ;
+    zsock_set_rcvtimeo (subscriber1, -1);
+    zsock_set_rcvtimeo (subscriber2, -1);
+    rc = zsock_bsend (publisher, "sS", "A string shared by several readers",
+                      long_buffer);
+    assert (rc == 0);
+    char *long_string2;
+    rc = zsock_brecv (subscriber1, "sS", &string, &long_string);
+    assert (rc == 0);
+    rc = zsock_brecv (subscriber2, "sS", NULL, &long_string2);
+    assert (rc == 0);
+    assert (streq (string, "A string shared by several readers"));
+    assert (streq (long_string, long_buffer));
+    assert (streq (long_string2, long_buffer));
+    zsock_destroy (&subscriber1);
+    zsock_destroy (&subscriber2);
+    zsock_destroy (&publisher);
+
     //  Test binding to ephemeral ports, sequential and random
     int port = zsock_bind (writer, "tcp://127.0.0.1:*");
     assert (port >= DYNAMIC_FIRST && port <= DYNAMIC_LAST);
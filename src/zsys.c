@@ -21,8 +21,14 @@
 @end
 */
 
+//  We need GNU extensions for CPU affinity and thread names
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
 #include "platform.h"
 #include "../include/czmq.h"
+#include "zscheduler.h"
+#include "zsys_mutex.h"
 
 //  --------------------------------------------------------------------------
 //  Signal handling
@@ -69,6 +75,11 @@ static size_t s_linger = 0;         //  ZSYS_LINGER=0
 static size_t s_sndhwm = 1000;      //  ZSYS_SNDHWM=1000
 static size_t s_rcvhwm = 1000;      //  ZSYS_RCVHWM=1000
 static size_t s_pipehwm = 1000;     //  ZSYS_PIPEHWM=1000
+static size_t s_pool_threads = 0;   //  ZSYS_POOL_THREADS=0
+static size_t s_stack_size = 0;     //  ZSYS_THREAD_STACK_SIZE=0
+static char *s_io_cpus = NULL;      //  ZSYS_IO_THREAD_CPUS=
+static int s_io_policy = -1;        //  I/O thread scheduling policy
+static int s_io_priority = -1;      //  I/O thread priority
 static int s_ipv6 = 0;              //  ZSYS_IPV6=0
 static char *s_interface = NULL;    //  ZSYS_INTERFACE=
 static char *s_logident = NULL;     //  ZSYS_LOGIDENT=
@@ -79,6 +90,12 @@ static void *s_logsender = NULL;    //  ZSYS_LOGSENDER=
 //  Track number of open sockets so we can zmq_term() safely
 static size_t s_open_sockets = 0;
 
+//  Runs pooled actors, created when the first one starts
+static zscheduler_t *s_scheduler = NULL;
+
+//  Counts closed sockets, so zsock_resolve can expire what it has cached
+static volatile uint s_handle_generation = 0;
+
 //  We keep a list of open sockets to report leaks to developers
 static zlist_t *s_sockref_list = NULL;
 
@@ -90,25 +107,86 @@ typedef struct {
     size_t line_nbr;
 } s_sockref_t;
 
-//  Mutex macros
-#if defined (__UNIX__)
-typedef pthread_mutex_t zsys_mutex_t;
-#   define ZMUTEX_INIT(m)    pthread_mutex_init (&m, NULL);
-#   define ZMUTEX_LOCK(m)    pthread_mutex_lock (&m);
-#   define ZMUTEX_UNLOCK(m)  pthread_mutex_unlock (&m);
-#   define ZMUTEX_DESTROY(m) pthread_mutex_destroy (&m);
-#elif defined (__WINDOWS__)
-typedef CRITICAL_SECTION zsys_mutex_t;
-#   define ZMUTEX_INIT(m)    InitializeCriticalSection (&m);
-#   define ZMUTEX_LOCK(m)    EnterCriticalSection (&m);
-#   define ZMUTEX_UNLOCK(m)  LeaveCriticalSection (&m);
-#   define ZMUTEX_DESTROY(m) DeleteCriticalSection (&m);
-#endif
-
 //  Mutex to guard socket counter
 static zsys_mutex_t s_mutex;
 
 
+//  --------------------------------------------------------------------------
+//  Local helper functions
+//  Parse a list of CPUs like "0-3,8" into a CPU set, keeping only the CPUs
+//  this process may run on. Returns 0 if OK, -1 if the list is not valid
+//  or names no CPU we can use.
+
+#if defined (__UTYPE_LINUX)
+static int
+s_cpu_list_parse (const char *cpus, cpu_set_t *set)
+{
+    CPU_ZERO (set);
+    const char *next = cpus;
+    while (true) {
+        char *end;
+        long first = strtol (next, &end, 10);
+        if (end == next || first < 0)
+            return -1;
+        long last = first;
+        if (*end == '-') {
+            next = end + 1;
+            last = strtol (next, &end, 10);
+            if (end == next || last < first)
+                return -1;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (; first <= last; first++)
+            CPU_SET (first, set);
+        if (*end == ',')
+            next = end + 1;
+        else
+        if (*end == 0 || *end == '\n')
+            break;
+        else
+            return -1;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity (0, sizeof (allowed), &allowed) == 0)
+        CPU_AND (set, set, &allowed);
+    return CPU_COUNT (set)? 0: -1;
+}
+#endif
+
+#if defined (ZMQ_THREAD_AFFINITY_CPU_ADD) && defined (__UTYPE_LINUX)
+//  Pass our I/O thread settings to a libzmq context that has not started
+//  its threads yet. The option is ZMQ_THREAD_AFFINITY_CPU_ADD to set the
+//  CPUs, or ZMQ_THREAD_AFFINITY_CPU_REMOVE to clear them.
+
+static void
+s_io_thread_affinity (int option)
+{
+    cpu_set_t set;
+    if (s_io_cpus && s_cpu_list_parse (s_io_cpus, &set) == 0) {
+        int cpu;
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET (cpu, &set))
+                zmq_ctx_set (s_process_ctx, option, cpu);
+    }
+}
+#endif
+
+static void
+s_configure_io_threads (void)
+{
+#if defined (ZMQ_THREAD_AFFINITY_CPU_ADD) && defined (__UTYPE_LINUX)
+    s_io_thread_affinity (ZMQ_THREAD_AFFINITY_CPU_ADD);
+#endif
+#if defined (ZMQ_THREAD_SCHED_POLICY)
+    if (s_io_policy != -1)
+        zmq_ctx_set (s_process_ctx, ZMQ_THREAD_SCHED_POLICY, s_io_policy);
+    if (s_io_priority != -1)
+        zmq_ctx_set (s_process_ctx, ZMQ_THREAD_PRIORITY, s_io_priority);
+#endif
+}
+
+
 //  --------------------------------------------------------------------------
 //  Initialize CZMQ zsys layer; this happens automatically when you create
 //  a socket or an actor; however this call lets you force initialization
@@ -142,6 +220,15 @@ zsys_init (void)
     if (getenv ("ZSYS_PIPEHWM"))
         s_pipehwm = atoi (getenv ("ZSYS_PIPEHWM"));
 
+    if (getenv ("ZSYS_POOL_THREADS"))
+        s_pool_threads = atoi (getenv ("ZSYS_POOL_THREADS"));
+
+    if (getenv ("ZSYS_THREAD_STACK_SIZE"))
+        s_stack_size = atoi (getenv ("ZSYS_THREAD_STACK_SIZE"));
+
+    if (getenv ("ZSYS_IO_THREAD_CPUS"))
+        s_io_cpus = strdup (getenv ("ZSYS_IO_THREAD_CPUS"));
+
     if (getenv ("ZSYS_IPV6"))
         s_ipv6 = atoi (getenv ("ZSYS_IPV6"));
 
@@ -184,6 +271,7 @@ zsys_init (void)
     //  valid socket on zmq_socket(), after this...
     zmq_ctx_set (s_process_ctx, ZMQ_MAX_SOCKETS, s_max_sockets);
 #endif
+    s_configure_io_threads ();
     s_initialized = true;
 
     //  The following functions call zsys_init(), so they MUST be called after
@@ -221,6 +309,9 @@ zsys_shutdown (void)
     if (busy)
         zclock_sleep (200);
 
+    //  Stop the pooled actor threads, so they let go of their sockets
+    zscheduler_destroy (&s_scheduler);
+
     //  No matter, we are now going to shut down
     //  Print the source reference for any sockets the app did not
     //  destroy properly.
@@ -253,6 +344,8 @@ zsys_shutdown (void)
     //  Free dynamically allocated properties
     free (s_interface);
     free (s_logident);
+    free (s_io_cpus);
+    s_io_cpus = NULL;
 
 #if defined (__UNIX__)
     closelog ();                //  Just to be pedantic
@@ -279,6 +372,9 @@ zsys_socket (int type, const char *filename, size_t line_nbr)
     zsys_init ();
     ZMUTEX_LOCK (s_mutex);
     void *handle = zmq_socket (s_process_ctx, type);
+    //  The new socket may occupy memory that zsock_resolve has cached as
+    //  something else, e.g. a freed object that started with a file handle
+    zsys_handle_closed ();
     //  Configure socket with process defaults
     zsocket_set_linger (handle, (int) s_linger);
 #if (ZMQ_VERSION_MAJOR == 2)
@@ -332,11 +428,44 @@ zsys_close (void *handle, const char *filename, size_t line_nbr)
     }
     s_open_sockets--;
     zmq_close (handle);
+    //  Expire cached handles only once the socket is gone, so no thread can
+    //  cache the dying handle again after we bumped the generation
+    zsys_handle_closed ();
     ZMUTEX_UNLOCK (s_mutex);
     return 0;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Tell CZMQ that a ZMQ socket was created or closed, so that zsock_resolve
+//  forgets what it knows about handles at that address. zsys_socket,
+//  zsys_close and the zsocket class do this for you; call it after you
+//  create or close raw sockets with zmq_socket and zmq_close, if the process
+//  may also pass CZMQ objects or file descriptors from reused memory.
+
+void
+zsys_handle_closed (void)
+{
+#if defined (__WINDOWS__)
+    InterlockedIncrement ((volatile LONG *) &s_handle_generation);
+#else
+    __sync_fetch_and_add (&s_handle_generation, 1);
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of times a ZMQ socket has been created or closed, as
+//  counted by zsys_handle_closed. Used by zsock_resolve to expire cached
+//  results.
+
+uint
+zsys_handle_generation (void)
+{
+    return s_handle_generation;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return ZMQ socket name for socket type
 
@@ -1091,6 +1220,7 @@ zsys_set_io_threads (size_t io_threads)
     //  valid socket on zmq_socket(), after this...
     zmq_ctx_set (s_process_ctx, ZMQ_MAX_SOCKETS, s_max_sockets);
 #endif
+    s_configure_io_threads ();
     ZMUTEX_UNLOCK (s_mutex);
 }
 
@@ -1220,6 +1350,224 @@ zsys_pipehwm (void)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Configure the number of threads that run pooled actors. The default is
+//  zero, meaning one thread per CPU core. If the environment variable
+//  ZSYS_POOL_THREADS is defined, that provides the default. Note that this
+//  method is valid only before any pooled actor is created.
+
+void
+zsys_set_pool_threads (size_t pool_threads)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    if (s_scheduler)
+        zsys_error ("zsys_pool_threads() is not valid after creating pooled actors");
+    else
+        s_pool_threads = pool_threads;
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of threads that run pooled actors, where zero means
+//  one thread per CPU core.
+
+size_t
+zsys_pool_threads (void)
+{
+    return s_pool_threads;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure the stack size, in bytes, for new zactor threads. The default
+//  is zero, meaning the operating system default. If the environment
+//  variable ZSYS_THREAD_STACK_SIZE is defined, that provides the default.
+
+void
+zsys_set_thread_stack_size (size_t stack_size)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    s_stack_size = stack_size;
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the stack size for new zactor threads, where zero means the
+//  operating system default.
+
+size_t
+zsys_thread_stack_size (void)
+{
+    return s_stack_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure the CPUs that ZeroMQ's I/O threads may run on, as a list like
+//  "0-3,8"; NULL means any CPU. CPUs that this process may not use are
+//  ignored. If the environment variable ZSYS_IO_THREAD_CPUS is defined,
+//  that provides the default. Returns 0 if OK, -1 if the list is not valid
+//  or the platform cannot pin threads. Note that this method is valid only
+//  before any socket is created.
+
+int
+zsys_set_io_thread_cpus (const char *cpus)
+{
+    zsys_init ();
+#if defined (ZMQ_THREAD_AFFINITY_CPU_ADD) && defined (__UTYPE_LINUX)
+    cpu_set_t set;
+    if (cpus && s_cpu_list_parse (cpus, &set))
+        return -1;
+    ZMUTEX_LOCK (s_mutex);
+    if (s_open_sockets)
+        zsys_error ("zsys_io_thread_cpus() is not valid after creating sockets");
+    assert (s_open_sockets == 0);
+    s_io_thread_affinity (ZMQ_THREAD_AFFINITY_CPU_REMOVE);
+    free (s_io_cpus);
+    s_io_cpus = cpus? strdup (cpus): NULL;
+    s_io_thread_affinity (ZMQ_THREAD_AFFINITY_CPU_ADD);
+    ZMUTEX_UNLOCK (s_mutex);
+    return 0;
+#else
+    return cpus? -1: 0;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure the scheduling policy and priority of ZeroMQ's I/O threads,
+//  as for zsys_thread_set_sched. The default for each is -1, meaning the
+//  operating system default. libzmq aborts if it cannot apply these, so
+//  use a real-time policy only where the process has the privileges. Note
+//  that this method is valid only before any socket is created.
+
+void
+zsys_set_io_thread_sched (int policy, int priority)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    if (s_open_sockets)
+        zsys_error ("zsys_io_thread_sched() is not valid after creating sockets");
+    assert (s_open_sockets == 0);
+    s_io_policy = policy;
+    s_io_priority = priority;
+    s_configure_io_threads ();
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pin the calling thread to a list of CPUs, like "0-3,8". CPUs that this
+//  process may not use are ignored. Actors call this at startup, before
+//  zsock_signal, or zactor_new_with calls it for them. Returns 0 if OK, -1
+//  if the list is not valid, or the platform cannot pin threads.
+
+int
+zsys_thread_set_cpus (const char *cpus)
+{
+    assert (cpus);
+#if defined (__UTYPE_LINUX)
+    cpu_set_t set;
+    if (s_cpu_list_parse (cpus, &set) == 0
+    &&  pthread_setaffinity_np (pthread_self (), sizeof (set), &set) == 0)
+        return 0;
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pin the calling thread to the CPUs of a NUMA node. Memory is placed on
+//  the node of the thread that first touches it, so an actor that pins
+//  itself before it allocates will mostly use local memory. Returns 0 if
+//  OK, -1 if there is no such node, or the platform cannot pin threads.
+
+int
+zsys_thread_set_numa_node (int node)
+{
+#if defined (__UTYPE_LINUX)
+    char path [64];
+    snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *file = fopen (path, "r");
+    if (file) {
+        char cpus [1024];
+        char *line = fgets (cpus, sizeof (cpus), file);
+        fclose (file);
+        if (line)
+            return zsys_thread_set_cpus (cpus);
+    }
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Name the calling thread, so that it shows up in debuggers and tools
+//  like top. Linux keeps only the first 15 characters. Returns 0 if OK,
+//  -1 if the platform cannot name threads.
+
+int
+zsys_thread_set_name (const char *name)
+{
+    assert (name);
+#if defined (__UTYPE_LINUX)
+    char short_name [16];
+    strncpy (short_name, name, 15);
+    short_name [15] = 0;
+    if (pthread_setname_np (pthread_self (), short_name) == 0)
+        return 0;
+#elif defined (__UTYPE_OSX)
+    if (pthread_setname_np (name) == 0)
+        return 0;
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the scheduling policy and priority of the calling thread. On UNIX,
+//  the policy is SCHED_OTHER, SCHED_FIFO, or SCHED_RR; real-time policies
+//  need privileges. On Windows, the policy is ignored and the priority is
+//  passed to SetThreadPriority. Returns 0 if OK, -1 if not allowed.
+
+int
+zsys_thread_set_sched (int policy, int priority)
+{
+#if defined (__UNIX__)
+    struct sched_param param;
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = priority;
+    if (pthread_setschedparam (pthread_self (), policy, &param) == 0)
+        return 0;
+#elif defined (__WINDOWS__)
+    if (SetThreadPriority (GetCurrentThread (), priority))
+        return 0;
+#endif
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the process-wide scheduler for pooled actors, creating it the
+//  first time. Returns NULL if the platform has no scheduler.
+
+zscheduler_t *
+zsys_scheduler (void)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    if (!s_scheduler)
+        s_scheduler = zscheduler_new (s_pool_threads);
+    zscheduler_t *scheduler = s_scheduler;
+    ZMUTEX_UNLOCK (s_mutex);
+    return scheduler;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Configure use of IPv6 for new zsock instances. By default sockets accept
 //  and make only IPv4 connections. When you enable IPv6, sockets will accept
@@ -1475,6 +1823,36 @@ zsys_debug (const char *format, ...)
 //  --------------------------------------------------------------------------
 //  Selftest
 
+//  Actor that sets up its own thread, and then waits for $TERM
+
+static void
+s_thread_actor (zsock_t *pipe, void *args)
+{
+    //  We may lack the privileges to pin or name threads, but a bad
+    //  CPU list or NUMA node must always fail
+    assert (zsys_thread_set_cpus ("3-1") == -1);
+    assert (zsys_thread_set_cpus ("0,nonsense") == -1);
+    assert (zsys_thread_set_numa_node (-1) == -1);
+#if defined (__UNIX__)
+    int rc = zsys_thread_set_sched (SCHED_OTHER, 0);
+    assert (rc == 0);
+#endif
+#if defined (__UTYPE_LINUX)
+    char cpus [16];
+    sprintf (cpus, "%d", sched_getcpu ());
+    rc = zsys_thread_set_cpus (cpus);
+    assert (rc == 0);
+    rc = zsys_thread_set_name ("zsys-test-actor");
+    assert (rc == 0);
+    char name [16];
+    pthread_getname_np (pthread_self (), name, sizeof (name));
+    assert (streq (name, "zsys-test-actor"));
+#endif
+    zsock_signal (pipe, 0);
+    char *command = zstr_recv (pipe);
+    free (command);
+}
+
 void
 zsys_test (bool verbose)
 {
@@ -1495,12 +1873,31 @@ zsys_test (bool verbose)
         zsys_info ("system limit is %zd ZeroMQ sockets", zsys_socket_limit ());
     }
     zsys_set_io_threads (1);
+    assert (zsys_set_io_thread_cpus ("0-") == -1);
+    rc = zsys_set_io_thread_cpus (NULL);
+    assert (rc == 0);
+#if defined (ZMQ_THREAD_AFFINITY_CPU_ADD) && defined (__UTYPE_LINUX)
+    //  Any CPU we may use, so as not to slow down the other tests
+    rc = zsys_set_io_thread_cpus ("0-1023");
+    assert (rc == 0);
+#endif
+    zsys_set_io_thread_sched (-1, -1);
     zsys_set_max_sockets (0);
     zsys_set_linger (0);
     zsys_set_sndhwm (1000);
     zsys_set_rcvhwm (1000);
     zsys_set_pipehwm (2500);
     assert (zsys_pipehwm () == 2500);
+    zsys_set_pool_threads (2);
+    assert (zsys_pool_threads () == 2);
+
+    //  Actors can set up their own threads
+    zsys_set_thread_stack_size (1024 * 1024);
+    assert (zsys_thread_stack_size () == 1024 * 1024);
+    zactor_t *actor = zactor_new (s_thread_actor, NULL);
+    assert (actor);
+    zactor_destroy (&actor);
+    zsys_set_thread_stack_size (0);
 
     zsys_set_ipv6 (0);
 
@@ -0,0 +1,32 @@
+/*  =========================================================================
+    zsys_mutex - portable mutex macros, used internally
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZSYS_MUTEX_H_INCLUDED__
+#define __ZSYS_MUTEX_H_INCLUDED__
+
+//  Mutex macros
+#if defined (__UNIX__)
+typedef pthread_mutex_t zsys_mutex_t;
+#   define ZMUTEX_INIT(m)    pthread_mutex_init (&m, NULL);
+#   define ZMUTEX_LOCK(m)    pthread_mutex_lock (&m);
+#   define ZMUTEX_UNLOCK(m)  pthread_mutex_unlock (&m);
+#   define ZMUTEX_DESTROY(m) pthread_mutex_destroy (&m);
+#elif defined (__WINDOWS__)
+typedef CRITICAL_SECTION zsys_mutex_t;
+#   define ZMUTEX_INIT(m)    InitializeCriticalSection (&m);
+#   define ZMUTEX_LOCK(m)    EnterCriticalSection (&m);
+#   define ZMUTEX_UNLOCK(m)  LeaveCriticalSection (&m);
+#   define ZMUTEX_DESTROY(m) DeleteCriticalSection (&m);
+#endif
+
+#endif